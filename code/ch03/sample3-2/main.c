@@ -7,6 +7,8 @@
 #include <sys/mman.h>
 
 #include <wayland-client.h>
+#include "damage.h"
+#include "fill.h"
 #include "xdg-shell-client-protocol.h"  // 需要用 wayland-scanner 生成
 
 struct wl_compositor *compositor = NULL;
@@ -29,6 +31,8 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
     // 理想情况下，应该根据 configure 事件传递的尺寸来创建 buffer
     create_and_attach_buffer(200, 200);
     wl_surface_attach(surface, buffer, 0, 0);
+    // 新缓冲区的内容全部是新的，报告整个缓冲区为损坏区域
+    damage_surface(surface, 0, 0, 200, 200);
     wl_surface_commit(surface);
 }
 
@@ -125,7 +129,7 @@ static void create_and_attach_buffer(int width, int height) {
     }
 
     // 填充黑色背景 (XRGB8888, Alpha被忽略，所以0x00000000就是黑色)
-    memset(data, 0x00, size);
+    fill_solid(data, width, height, stride, 0x00000000);
     munmap(data, size); // 解除映射，因为 wl_shm_pool 已经接管
 
     struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
@@ -1,67 +1,20 @@
 #define _POSIX_C_SOURCE 200112L
-#include <errno.h>
-#include <fcntl.h>
-#include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <time.h>
-#include <unistd.h>
 #include <wayland-client.h>
+#include "damage.h"
+#include "fill.h"
+#include "registry.h"
+#include "shm_file.h"
 #include "xdg-shell.h"
 
-/* Shared memory support code */
-static void
-randname(char *buf)
-{
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    long r = ts.tv_nsec;
-    for (int i = 0; i < 6; ++i) {
-        buf[i] = 'A'+(r&15)+(r&16)*2;
-        r >>= 5;
-    }
-}
-
-static int
-create_shm_file(void)
-{
-    int retries = 100;
-    do {
-        char name[] = "/wl_shm-XXXXXX";
-        randname(name + sizeof(name) - 7);
-        --retries;
-        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-        if (fd >= 0) {
-            shm_unlink(name);
-            return fd;
-        }
-    } while (retries > 0 && errno == EEXIST);
-    return -1;
-}
-
-static int
-allocate_shm_file(size_t size)
-{
-    int fd = create_shm_file();
-    if (fd < 0)
-        return -1;
-    int ret;
-    do {
-        ret = ftruncate(fd, size);
-    } while (ret < 0 && errno == EINTR);
-    if (ret < 0) {
-        close(fd);
-        return -1;
-    }
-    return fd;
-}
-
 /* Wayland code */
 struct client_state {
     /* Globals */
     struct wl_display *wl_display;
-    struct wl_registry *wl_registry;
+    struct registry *registry;
     struct wl_shm *wl_shm;
     struct wl_compositor *wl_compositor;
     struct xdg_wm_base *xdg_wm_base;
@@ -89,35 +42,21 @@ draw_frame(struct client_state *state)
     int stride = width * 4;
     int size = stride * height;
 
-    int fd = allocate_shm_file(size);
-    if (fd == -1) {
+    /* Sealed memfd, or a randomly named shm_open file on older kernels */
+    struct shm_file file;
+    if (shm_file_create(&file, size, SHM_FILE_DEFAULT) < 0) {
         return NULL;
     }
 
-    uint32_t *data = mmap(NULL, size,
-            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (data == MAP_FAILED) {
-        close(fd);
-        return NULL;
-    }
-
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->wl_shm, fd, size);
+    struct wl_shm_pool *pool = wl_shm_create_pool(state->wl_shm, file.fd, size);
     struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0,
             width, height, stride, WL_SHM_FORMAT_XRGB8888);
     wl_shm_pool_destroy(pool);
-    close(fd);
 
     /* Draw checkerboxed background */
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            if ((x + y / 8 * 8) % 16 < 8)
-                data[y * width + x] = 0xFF666666;
-            else
-                data[y * width + x] = 0xFFEEEEEE;
-        }
-    }
+    fill_checkerboard(file.data, width, height, stride, 8, 0xFF666666, 0xFFEEEEEE);
 
-    munmap(data, size);
+    shm_file_destroy(&file);
     wl_buffer_add_listener(buffer, &wl_buffer_listener, NULL);
     return buffer;
 }
@@ -131,6 +70,8 @@ xdg_surface_configure(void *data,
 
     struct wl_buffer *buffer = draw_frame(state);
     wl_surface_attach(state->wl_surface, buffer, 0, 0);
+    /* Every pixel of a freshly drawn buffer is new */
+    damage_surface(state->wl_surface, 0, 0, 640, 480);
     wl_surface_commit(state->wl_surface);
 }
 
@@ -148,35 +89,12 @@ static const struct xdg_wm_base_listener xdg_wm_base_listener = {
     .ping = xdg_wm_base_ping,
 };
 
-static void
-registry_global(void *data, struct wl_registry *wl_registry,
-        uint32_t name, const char *interface, uint32_t version)
-{
-    struct client_state *state = data;
-    if (strcmp(interface, wl_shm_interface.name) == 0) {
-        state->wl_shm = wl_registry_bind(
-                wl_registry, name, &wl_shm_interface, 1);
-    } else if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        state->wl_compositor = wl_registry_bind(
-                wl_registry, name, &wl_compositor_interface, 4);
-    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        state->xdg_wm_base = wl_registry_bind(
-                wl_registry, name, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(state->xdg_wm_base,
-                &xdg_wm_base_listener, state);
-    }
-}
-
-static void
-registry_global_remove(void *data,
-        struct wl_registry *wl_registry, uint32_t name)
-{
-    /* This space deliberately left blank */
-}
-
-static const struct wl_registry_listener wl_registry_listener = {
-    .global = registry_global,
-    .global_remove = registry_global_remove,
+/* Globals to bind: interface, min version, max version, slot, listener, required */
+static const struct registry_binding registry_bindings[] = {
+    { &wl_shm_interface, 1, 1, offsetof(struct client_state, wl_shm), NULL, true },
+    { &wl_compositor_interface, 1, 4, offsetof(struct client_state, wl_compositor), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct client_state, xdg_wm_base),
+      &xdg_wm_base_listener, true },
 };
 
 int
@@ -184,9 +102,14 @@ main(int argc, char *argv[])
 {
     struct client_state state = { 0 };
     state.wl_display = wl_display_connect(NULL);
-    state.wl_registry = wl_display_get_registry(state.wl_display);
-    wl_registry_add_listener(state.wl_registry, &wl_registry_listener, &state);
+    state.registry = registry_create(state.wl_display, registry_bindings,
+            sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
     wl_display_roundtrip(state.wl_display);
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "Can't find %s\n", missing);
+        return 1;
+    }
 
     state.wl_surface = wl_compositor_create_surface(state.wl_compositor);
     state.xdg_surface = xdg_wm_base_get_xdg_surface(
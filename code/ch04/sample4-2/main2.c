@@ -6,12 +6,19 @@
 #include <unistd.h>
 #include <sys/mman.h>
 
+#include <stddef.h>
 #include <wayland-client.h>
+#include "damage.h"
+#include "pattern.h"
+#include "registry.h"
 #include "xdg-shell-client-protocol.h"  // 需要用 wayland-scanner 生成
 
-struct wl_compositor *compositor = NULL;
-struct wl_shm *shm = NULL;
-struct xdg_wm_base *wm_base = NULL;
+// 由绑定表填充的全局对象
+struct globals {
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct xdg_wm_base *wm_base;
+} globals;
 
 struct wl_surface *surface = NULL;
 struct wl_buffer *buffer = NULL;
@@ -29,6 +36,8 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
     // 理想情况下，应该根据 configure 事件传递的尺寸来创建 buffer
     create_and_attach_buffer(200, 200);
     wl_surface_attach(surface, buffer, 0, 0);
+    // 新缓冲区的内容全部是新的，报告整个缓冲区为损坏区域
+    damage_surface(surface, 0, 0, 200, 200);
     wl_surface_commit(surface);
 }
 
@@ -66,36 +75,11 @@ static const struct xdg_wm_base_listener wm_base_listener = {
     .ping = xdg_wm_base_ping
 };
 
-static void registry_global_handler(
-    void *data,
-    struct wl_registry *registry,
-    uint32_t name,
-    const char *interface,
-    uint32_t version
-) {
-    if (strcmp(interface, "wl_compositor") == 0) {
-        compositor = wl_registry_bind(registry, name,
-            &wl_compositor_interface, 3);
-    } else if (strcmp(interface, "wl_shm") == 0) {
-        shm = wl_registry_bind(registry, name,
-            &wl_shm_interface, 1);
-    } else if (strcmp(interface, "xdg_wm_base") == 0) {
-        wm_base = wl_registry_bind(registry, name,
-            &xdg_wm_base_interface, 1);
-    }
-}
-
-static void registry_global_remove_handler(
-    void *data,
-    struct wl_registry *registry,
-    uint32_t name
-) {
-    // 忽略
-}
-
-static const struct wl_registry_listener registry_listener = {
-    .global = registry_global_handler,
-    .global_remove = registry_global_remove_handler
+// 全局对象绑定表：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 3, offsetof(struct globals, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct globals, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct globals, wm_base), &wm_base_listener, true },
 };
 
 // 将 Buffer 创建逻辑封装成一个函数
@@ -124,38 +108,18 @@ static void create_and_attach_buffer(int width, int height) {
         exit(1);
     }
 
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            struct pixel {
-                // little-endian ARGB
-                unsigned char blue;
-                unsigned char green;
-                unsigned char red;
-                unsigned char alpha;
-            } *px = (struct pixel *) (data + y * stride + x * 4);
-
-            // draw a stripes pattern
-            if ((x + y) % 30 < 10) {
-                // transparent
-                px->alpha = 0;
-            } else if ((x + y) % 30 < 20) {
-                // yellow
-                px->alpha = 255;
-                px->red = 255;
-                px->green = 255;
-                px->blue = 0;
-            } else {
-                // semitransparent red
-                px->alpha = 128;
-                px->red = 255;
-                px->green = 0;
-                px->blue = 0;
-            }
-        }
-    }
+    // draw a stripes pattern: transparent, yellow, semitransparent red
+    // 只渲染一个周期（30 行），其余行整行复制
+    static const struct pattern stripes = {
+        .kind = PATTERN_STRIPES,
+        .cell = 10,
+        .count = 3,
+        .colors = { 0x00000000, 0xFFFFFF00, 0x80FF0000 },
+    };
+    pattern_render(&stripes, data, width, height, stride);
     munmap(data, size); // 解除映射，因为 wl_shm_pool 已经接管
 
-    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
+    struct wl_shm_pool *pool = wl_shm_create_pool(globals.shm, fd, size);
     buffer = wl_shm_pool_create_buffer(pool,
         0, width, height, stride, WL_SHM_FORMAT_ARGB8888);
 
@@ -173,21 +137,21 @@ int main(void)
         return -1;
     }
 
-    struct wl_registry *registry = wl_display_get_registry(display);
-    wl_registry_add_listener(registry, &registry_listener, NULL);
+    struct registry *registry = registry_create(display, registry_bindings,
+                                                sizeof(registry_bindings) / sizeof(registry_bindings[0]),
+                                                &globals);
 
     wl_display_roundtrip(display);
 
-    if (!compositor || !shm || !wm_base) {
-        fprintf(stderr, "缺少必要的全局对象 (compositor/shm/wm_base)\n");
+    const char *missing = registry_missing(registry);
+    if (missing) {
+        fprintf(stderr, "缺少必要的全局对象 %s\n", missing);
         return -1;
     }
 
-    xdg_wm_base_add_listener(wm_base, &wm_base_listener, NULL);
-
-    surface = wl_compositor_create_surface(compositor);
+    surface = wl_compositor_create_surface(globals.compositor);
 
-    struct xdg_surface *xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, surface);
+    struct xdg_surface *xdg_surface = xdg_wm_base_get_xdg_surface(globals.wm_base, surface);
     struct xdg_toplevel *toplevel = xdg_surface_get_toplevel(xdg_surface);
 
     xdg_toplevel_set_title(toplevel, "黑色窗口");
@@ -220,6 +184,7 @@ int main(void)
     if (toplevel) xdg_toplevel_destroy(toplevel);
     if (xdg_surface) xdg_surface_destroy(xdg_surface);
     if (surface) wl_surface_destroy(surface);
+    registry_destroy(registry);
     if (display) wl_display_disconnect(display);
 
 
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 #include <syscall.h>
 #include <unistd.h>
@@ -8,19 +9,29 @@
 
 #include <wayland-client.h>
 #include <wayland-cursor.h>
+#include "cursor.h"
+#include "cursor-shape-v1-client-protocol.h"
+#include "damage.h"
+#include "fill.h"
+#include "registry.h"
 #include "xdg-shell.h"  // 需要用 wayland-scanner 生成
 
-struct wl_compositor *compositor = NULL;
-struct wl_shm *shm = NULL;
-struct xdg_wm_base *wm_base = NULL;
+/* 由绑定表填充的全局对象 */
+struct globals {
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct xdg_wm_base *wm_base;
+    struct wl_seat *seat;
+    struct wp_cursor_shape_manager_v1 *cursor_shape_manager;
+} globals;
+struct registry *registry;
 
 struct wl_surface *surface = NULL;
 struct wl_buffer *buffer = NULL;
 
-struct wl_seat *seat;
 struct wl_pointer *pointer;
-struct wl_surface *cursor_surface;
-struct wl_cursor_image *cursor_image;
+struct cursor_manager *cursors;
+struct cursor_pointer *cursor;
 
 // 函数前向声明
 static void create_and_attach_buffer(int width, int height);
@@ -35,6 +46,8 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
     // 理想情况下，应该根据 configure 事件传递的尺寸来创建 buffer
     create_and_attach_buffer(200, 200);
     wl_surface_attach(surface, buffer, 0, 0);
+    // 新缓冲区的内容全部是新的，报告整个缓冲区为损坏区域
+    damage_surface(surface, 0, 0, 200, 200);
     wl_surface_commit(surface);
 }
 
@@ -72,39 +85,36 @@ static const struct xdg_wm_base_listener wm_base_listener = {
     .ping = xdg_wm_base_ping
 };
 
-static void registry_global_handler(
-    void *data,
-    struct wl_registry *registry,
-    uint32_t name,
-    const char *interface,
-    uint32_t version
-) {
-    if (strcmp(interface, "wl_compositor") == 0) {
-        compositor = wl_registry_bind(registry, name,
-            &wl_compositor_interface, 3);
-    } else if (strcmp(interface, "wl_shm") == 0) {
-        shm = wl_registry_bind(registry, name,
-            &wl_shm_interface, 1);
-    } else if (strcmp(interface, "xdg_wm_base") == 0) {
-        wm_base = wl_registry_bind(registry, name,
-            &xdg_wm_base_interface, 1);
-    } else if (strcmp(interface, "wl_seat") == 0) {
-        seat = wl_registry_bind(registry, name,
-            &wl_seat_interface, 1);
+// 座位被移除时连同它的 pointer 一起销毁
+static void seat_removed(void *data, void *proxy)
+{
+    cursor_pointer_destroy(cursor);
+    cursor = NULL;
+    if (pointer) {
+        wl_pointer_destroy(pointer);
+        pointer = NULL;
     }
+    wl_seat_destroy(proxy);
 }
 
-static void registry_global_remove_handler(
-    void *data,
-    struct wl_registry *registry,
-    uint32_t name
-) {
-    // 忽略
+// 形状协议消失后，光标管理器退回到主题光标
+static void cursor_shape_manager_removed(void *data, void *proxy)
+{
+    if (cursors) cursor_manager_set_shape_manager(cursors, NULL);
+    wp_cursor_shape_manager_v1_destroy(proxy);
 }
 
-static const struct wl_registry_listener registry_listener = {
-    .global = registry_global_handler,
-    .global_remove = registry_global_remove_handler
+// 全局对象绑定表：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 3, offsetof(struct globals, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct globals, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct globals, wm_base), &wm_base_listener, true },
+    // 有形状协议时光标由合成器绘制，客户端不必加载主题
+    { &wp_cursor_shape_manager_v1_interface, 1, 1, offsetof(struct globals, cursor_shape_manager), NULL, false,
+      NULL, cursor_shape_manager_removed },
+    // 指针监听器只处理版本 1 的事件，版本 5 起的 wl_pointer.frame 用不上
+    { &wl_seat_interface, 1, 4, offsetof(struct globals, seat), NULL, true,
+      NULL, seat_removed },
 };
 
 void pointer_enter_handler
@@ -117,8 +127,7 @@ void pointer_enter_handler
     wl_fixed_t y
 )
 {
-    wl_pointer_set_cursor(pointer, serial, cursor_surface,
-        cursor_image->hotspot_x, cursor_image->hotspot_y);
+    cursor_pointer_set(cursor, serial, "default");
 }
 
 void pointer_leave_handler
@@ -195,27 +204,11 @@ static void create_and_attach_buffer(int width, int height) {
         exit(1);
     }
 
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-
-            struct pixel {
-                // little-endian ARGB
-                unsigned char blue;
-                unsigned char green;
-                unsigned char red;
-                unsigned char alpha;
-            } *px = (struct pixel *) (data + y * stride + x * 4);
-
-            // yellow
-            px->alpha = 255;
-            px->red = 255;
-            px->green = 255;
-            px->blue = 0;
-        }
-    }
+    // 行主序填充纯黄色
+    fill_solid(data, width, height, stride, 0xFFFFFF00);
     munmap(data, size); // 解除映射，因为 wl_shm_pool 已经接管
 
-    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
+    struct wl_shm_pool *pool = wl_shm_create_pool(globals.shm, fd, size);
     buffer = wl_shm_pool_create_buffer(pool,
         0, width, height, stride, WL_SHM_FORMAT_ARGB8888);
 
@@ -233,24 +226,29 @@ int main(void)
         return -1;
     }
 
-    struct wl_registry *registry = wl_display_get_registry(display);
-    wl_registry_add_listener(registry, &registry_listener, NULL);
+    registry = registry_create(display, registry_bindings,
+                               sizeof(registry_bindings) / sizeof(registry_bindings[0]),
+                               &globals);
 
     wl_display_roundtrip(display);
 
-    if (!compositor || !shm || !wm_base || !seat) {
-        fprintf(stderr, "缺少必要的全局对象 (compositor/shm/wm_base/seat)\n");
+    const char *missing = registry_missing(registry);
+    if (missing) {
+        fprintf(stderr, "缺少必要的全局对象 %s\n", missing);
         return -1;
     }
 
-    pointer = wl_seat_get_pointer(seat);
-    wl_pointer_add_listener(pointer, &pointer_listener, NULL);
+    // 光标主题按需加载，同一尺寸只加载一次
+    cursors = cursor_manager_create(globals.compositor, globals.shm, NULL, 0);
+    cursor_manager_set_shape_manager(cursors, globals.cursor_shape_manager);
 
-    xdg_wm_base_add_listener(wm_base, &wm_base_listener, NULL);
+    pointer = wl_seat_get_pointer(globals.seat);
+    cursor = cursor_pointer_create(cursors, pointer);
+    wl_pointer_add_listener(pointer, &pointer_listener, NULL);
 
-    surface = wl_compositor_create_surface(compositor);
+    surface = wl_compositor_create_surface(globals.compositor);
 
-    struct xdg_surface *xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, surface);
+    struct xdg_surface *xdg_surface = xdg_wm_base_get_xdg_surface(globals.wm_base, surface);
     struct xdg_toplevel *toplevel = xdg_surface_get_toplevel(xdg_surface);
 
     xdg_toplevel_set_title(toplevel, "黑色窗口");
@@ -266,18 +264,6 @@ int main(void)
     wl_surface_commit(surface);
     printf("Initial wl_surface_commit sent\n"); // 调试输出
 
-    struct wl_cursor_theme *cursor_theme =
-        wl_cursor_theme_load(NULL, 24, shm);
-    struct wl_cursor *cursor =
-        wl_cursor_theme_get_cursor(cursor_theme, "left_ptr");
-    cursor_image = cursor->images[0];
-    struct wl_buffer *cursor_buffer =
-        wl_cursor_image_get_buffer(cursor_image);
-
-    cursor_surface = wl_compositor_create_surface(compositor);
-    wl_surface_attach(cursor_surface, cursor_buffer, 0, 0);
-    wl_surface_commit(cursor_surface);
-
 
     // 注释掉在这里创建 buffer 的代码，将其移到 configure 回调中
     /*
@@ -291,10 +277,16 @@ int main(void)
     }
 
     // 清理资源 (虽然在这个例子中，程序退出时会自动清理)
+    cursor_pointer_destroy(cursor);
+    if (pointer) wl_pointer_destroy(pointer);
+    cursor_manager_destroy(cursors);
     if (buffer) wl_buffer_destroy(buffer);
     if (toplevel) xdg_toplevel_destroy(toplevel);
     if (xdg_surface) xdg_surface_destroy(xdg_surface);
     if (surface) wl_surface_destroy(surface);
+    if (globals.seat) wl_seat_destroy(globals.seat);
+    if (globals.cursor_shape_manager) wp_cursor_shape_manager_v1_destroy(globals.cursor_shape_manager);
+    registry_destroy(registry);
     if (display) wl_display_disconnect(display);
 
 
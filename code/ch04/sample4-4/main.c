@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 #include <syscall.h>
 #include <unistd.h>
@@ -8,19 +9,31 @@
 
 #include <wayland-client.h>
 #include <wayland-cursor.h>
+#include "cursor.h"
+#include "cursor-shape-v1-client-protocol.h"
+#include "damage.h"
+#include "fill.h"
+#include "pointer_input.h"
+#include "registry.h"
 #include "xdg-shell.h"  // 需要用 wayland-scanner 生成
 
-struct wl_compositor *compositor = NULL;
-struct wl_shm *shm = NULL;
-struct xdg_wm_base *wm_base = NULL;
+/* 由绑定表填充的全局对象 */
+struct globals {
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct xdg_wm_base *wm_base;
+    struct wl_seat *seat;
+    struct wp_cursor_shape_manager_v1 *cursor_shape_manager;
+} globals;
+struct registry *registry;
 
 struct wl_surface *surface = NULL;
 struct wl_buffer *buffer = NULL;
 
-struct wl_seat *seat;
 struct wl_pointer *pointer;
-struct wl_surface *cursor_surface;
-struct wl_cursor_image *cursor_image;
+struct pointer_input pointer_input;
+struct cursor_manager *cursors;
+struct cursor_pointer *cursor;
 
 // 函数前向声明
 static void create_and_attach_buffer(int width, int height);
@@ -35,6 +48,8 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
     // 理想情况下，应该根据 configure 事件传递的尺寸来创建 buffer
     create_and_attach_buffer(200, 200);
     wl_surface_attach(surface, buffer, 0, 0);
+    // 新缓冲区的内容全部是新的，报告整个缓冲区为损坏区域
+    damage_surface(surface, 0, 0, 200, 200);
     wl_surface_commit(surface);
 }
 
@@ -72,116 +87,68 @@ static const struct xdg_wm_base_listener wm_base_listener = {
     .ping = xdg_wm_base_ping
 };
 
-static void registry_global_handler(
-    void *data,
-    struct wl_registry *registry,
-    uint32_t name,
-    const char *interface,
-    uint32_t version
-) {
-    if (strcmp(interface, "wl_compositor") == 0) {
-        compositor = wl_registry_bind(registry, name,
-            &wl_compositor_interface, 3);
-    } else if (strcmp(interface, "wl_shm") == 0) {
-        shm = wl_registry_bind(registry, name,
-            &wl_shm_interface, 1);
-    } else if (strcmp(interface, "xdg_wm_base") == 0) {
-        wm_base = wl_registry_bind(registry, name,
-            &xdg_wm_base_interface, 1);
-    } else if (strcmp(interface, "wl_seat") == 0) {
-        seat = wl_registry_bind(registry, name,
-            &wl_seat_interface, 1);
-    }
-}
-
-static void registry_global_remove_handler(
-    void *data,
-    struct wl_registry *registry,
-    uint32_t name
-) {
-    // 忽略
-}
-
-static const struct wl_registry_listener registry_listener = {
-    .global = registry_global_handler,
-    .global_remove = registry_global_remove_handler
-};
-
-void pointer_enter_handler
-(
-    void *data,
-    struct wl_pointer *pointer,
-    uint32_t serial,
-    struct wl_surface *surface,
-    wl_fixed_t x,
-    wl_fixed_t y
-)
+// 座位被移除时连同它的 pointer 一起销毁
+static void seat_removed(void *data, void *proxy)
 {
-    wl_pointer_set_cursor(pointer, serial, cursor_surface,
-        cursor_image->hotspot_x, cursor_image->hotspot_y);
-    printf("enter:\t%d %d\n",
-        wl_fixed_to_int(x),
-        wl_fixed_to_int(y));
-}
-
-void pointer_leave_handler
-(
-    void *data,
-    struct wl_pointer *pointer,
-    uint32_t serial,
-    struct wl_surface *surface
-)
-{
-    printf("leave\n");
+    cursor_pointer_destroy(cursor);
+    cursor = NULL;
+    if (pointer) {
+        wl_pointer_destroy(pointer);
+        pointer = NULL;
+    }
+    wl_seat_destroy(proxy);
 }
 
-void pointer_motion_handler
-(
-    void *data,
-    struct wl_pointer *pointer,
-    uint32_t time,
-    wl_fixed_t x,
-    wl_fixed_t y
-)
+// 形状协议消失后，光标管理器退回到主题光标
+static void cursor_shape_manager_removed(void *data, void *proxy)
 {
-    printf("motion:\t%d %d\n",
-        wl_fixed_to_int(x),
-        wl_fixed_to_int(y));
+    if (cursors) cursor_manager_set_shape_manager(cursors, NULL);
+    wp_cursor_shape_manager_v1_destroy(proxy);
 }
 
-void pointer_button_handler
-(
-    void *data,
-    struct wl_pointer *pointer,
-    uint32_t serial,
-    uint32_t time,
-    uint32_t button,
-    uint32_t state
-)
-{
-    printf("button: 0x%x state: %d\n", button, state);
-}
+// 全局对象绑定表：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 3, offsetof(struct globals, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct globals, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct globals, wm_base), &wm_base_listener, true },
+    // 有形状协议时光标由合成器绘制，客户端不必加载主题
+    { &wp_cursor_shape_manager_v1_interface, 1, 1, offsetof(struct globals, cursor_shape_manager), NULL, false,
+      NULL, cursor_shape_manager_removed },
+    // 版本 5 起有 wl_pointer.frame，版本 8 起滚轮使用 axis_value120
+    { &wl_seat_interface, 1, 8, offsetof(struct globals, seat), NULL, true,
+      NULL, seat_removed },
+};
 
-void pointer_axis_handler
-(
-    void *data,
-    struct wl_pointer *pointer,
-    uint32_t time,
-    uint32_t axis,
-    wl_fixed_t value
-)
+// 指针事件按 wl_pointer.frame 聚合：一帧里的多个 motion 合并成一次，
+// 高回报率鼠标每秒上千个 motion 也只在每帧输出一行
+void pointer_frame_handler(void *data, const struct pointer_event *event)
 {
-    printf("axis: %d %f\n", axis, wl_fixed_to_double(value));
+    if (event->mask & POINTER_EVENT_ENTER) {
+        cursor_pointer_set(cursor, event->enter_serial, "default");
+        printf("enter:\t%d %d\n", (int)event->x, (int)event->y);
+    }
+    if (event->mask & POINTER_EVENT_MOTION) {
+        printf("motion:\t%d %d (%u events)\n",
+            (int)event->x, (int)event->y, event->motions);
+    }
+    for (int i = 0; i < event->button_count; i++) {
+        printf("button: 0x%x state: %d\n",
+            event->buttons[i].button, event->buttons[i].state);
+    }
+    if (event->mask & POINTER_EVENT_AXIS) {
+        for (int axis = 0; axis < 2; axis++) {
+            const struct pointer_axis *a = &event->axes[axis];
+            if (a->valid) {
+                // value120：一格滚轮为 120，高精度滚轮会给出更小的值
+                printf("axis: %d %f value120: %d\n", axis, a->value, a->value120);
+            }
+        }
+    }
+    if (event->mask & POINTER_EVENT_LEAVE) {
+        printf("leave\n");
+    }
 }
 
-const struct wl_pointer_listener pointer_listener = {
-    .enter = pointer_enter_handler,
-    .leave = pointer_leave_handler,
-    .motion = pointer_motion_handler,
-    .button = pointer_button_handler,
-    .axis = pointer_axis_handler
-};
-
 // 将 Buffer 创建逻辑封装成一个函数
 static void create_and_attach_buffer(int width, int height) {
     if (buffer) {
@@ -208,27 +175,11 @@ static void create_and_attach_buffer(int width, int height) {
         exit(1);
     }
 
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-
-            struct pixel {
-                // little-endian ARGB
-                unsigned char blue;
-                unsigned char green;
-                unsigned char red;
-                unsigned char alpha;
-            } *px = (struct pixel *) (data + y * stride + x * 4);
-
-            // yellow
-            px->alpha = 255;
-            px->red = 255;
-            px->green = 255;
-            px->blue = 0;
-        }
-    }
+    // 行主序填充纯黄色
+    fill_solid(data, width, height, stride, 0xFFFFFF00);
     munmap(data, size); // 解除映射，因为 wl_shm_pool 已经接管
 
-    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
+    struct wl_shm_pool *pool = wl_shm_create_pool(globals.shm, fd, size);
     buffer = wl_shm_pool_create_buffer(pool,
         0, width, height, stride, WL_SHM_FORMAT_ARGB8888);
 
@@ -246,24 +197,29 @@ int main(void)
         return -1;
     }
 
-    struct wl_registry *registry = wl_display_get_registry(display);
-    wl_registry_add_listener(registry, &registry_listener, NULL);
+    registry = registry_create(display, registry_bindings,
+                               sizeof(registry_bindings) / sizeof(registry_bindings[0]),
+                               &globals);
 
     wl_display_roundtrip(display);
 
-    if (!compositor || !shm || !wm_base || !seat) {
-        fprintf(stderr, "缺少必要的全局对象 (compositor/shm/wm_base/seat)\n");
+    const char *missing = registry_missing(registry);
+    if (missing) {
+        fprintf(stderr, "缺少必要的全局对象 %s\n", missing);
         return -1;
     }
 
-    pointer = wl_seat_get_pointer(seat);
-    wl_pointer_add_listener(pointer, &pointer_listener, NULL);
+    // 光标主题按需加载，同一尺寸只加载一次
+    cursors = cursor_manager_create(globals.compositor, globals.shm, NULL, 0);
+    cursor_manager_set_shape_manager(cursors, globals.cursor_shape_manager);
 
-    xdg_wm_base_add_listener(wm_base, &wm_base_listener, NULL);
+    pointer = wl_seat_get_pointer(globals.seat);
+    cursor = cursor_pointer_create(cursors, pointer);
+    pointer_input_init(&pointer_input, pointer, pointer_frame_handler, NULL);
 
-    surface = wl_compositor_create_surface(compositor);
+    surface = wl_compositor_create_surface(globals.compositor);
 
-    struct xdg_surface *xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, surface);
+    struct xdg_surface *xdg_surface = xdg_wm_base_get_xdg_surface(globals.wm_base, surface);
     struct xdg_toplevel *toplevel = xdg_surface_get_toplevel(xdg_surface);
 
     xdg_toplevel_set_title(toplevel, "黑色窗口");
@@ -279,18 +235,6 @@ int main(void)
     wl_surface_commit(surface);
     printf("Initial wl_surface_commit sent\n"); // 调试输出
 
-    struct wl_cursor_theme *cursor_theme =
-        wl_cursor_theme_load(NULL, 24, shm);
-    struct wl_cursor *cursor =
-        wl_cursor_theme_get_cursor(cursor_theme, "left_ptr");
-    cursor_image = cursor->images[0];
-    struct wl_buffer *cursor_buffer =
-        wl_cursor_image_get_buffer(cursor_image);
-
-    cursor_surface = wl_compositor_create_surface(compositor);
-    wl_surface_attach(cursor_surface, cursor_buffer, 0, 0);
-    wl_surface_commit(cursor_surface);
-
 
     // 注释掉在这里创建 buffer 的代码，将其移到 configure 回调中
     /*
@@ -304,10 +248,16 @@ int main(void)
     }
 
     // 清理资源 (虽然在这个例子中，程序退出时会自动清理)
+    cursor_pointer_destroy(cursor);
+    if (pointer) wl_pointer_destroy(pointer);
+    cursor_manager_destroy(cursors);
     if (buffer) wl_buffer_destroy(buffer);
     if (toplevel) xdg_toplevel_destroy(toplevel);
     if (xdg_surface) xdg_surface_destroy(xdg_surface);
     if (surface) wl_surface_destroy(surface);
+    if (globals.seat) wl_seat_destroy(globals.seat);
+    if (globals.cursor_shape_manager) wp_cursor_shape_manager_v1_destroy(globals.cursor_shape_manager);
+    registry_destroy(registry);
     if (display) wl_display_disconnect(display);
 
 
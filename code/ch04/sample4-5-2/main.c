@@ -1,54 +1,157 @@
 #define _GNU_SOURCE
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/mman.h>
 #include <linux/input-event-codes.h>
 
 #include <wayland-client.h>
+#include "csd.h"
+#include "cursor.h"
+#include "cursor-shape-v1-client-protocol.h"
+#include "damage.h"
+#include "fill.h"
+#include "frame_scheduler.h"
+#include "pointer_input.h"
+#include "queue_thread.h"
+#include "raster_pool.h"
+#include "registry.h"
+#include "shm_file.h"
+#include "surface_region.h"
 #include "xdg-shell-client-protocol.h"
 
+/* Window size, titlebar included */
 #define WIDTH 640
 #define HEIGHT 480
-#define TITLEBAR_HEIGHT 30
-#define BUTTON_WIDTH 40
+#define MIN_WIDTH (CSD_BUTTON_COUNT * CSD_BUTTON_WIDTH + 2 * CSD_RESIZE_MARGIN)
+#define MIN_HEIGHT (CSD_TITLEBAR_HEIGHT + 2 * CSD_RESIZE_MARGIN)
+
+/* Content buffers carry no alpha; the opaque region is derived from it */
+#define BUFFER_FORMAT WL_SHM_FORMAT_XRGB8888
+
+/* Two buffers are enough when the compositor releases promptly; a third
+ * is only allocated under SWAPCHAIN_ALLOCATE. */
+#define MIN_BUFFERS 2
+#define MAX_BUFFERS 3
+
+/* What draw_frame() does when every buffer is still held by the compositor */
+enum swapchain_policy {
+    SWAPCHAIN_ALLOCATE,   /* add a buffer (up to MAX_BUFFERS), then wait */
+    SWAPCHAIN_WAIT,       /* redraw as soon as a buffer is released */
+    SWAPCHAIN_DROP,       /* skip the frame */
+};
+
+struct app_state;
+
+struct shm_buffer {
+    struct app_state *state;
+    struct wl_buffer *wl_buffer;
+    struct shm_file file;
+    int width;
+    int height;
+    int busy;
+    uint64_t frame;       /* damage tracker frame of its contents, 0 = none */
+};
 
 struct app_state {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
+    struct wl_subcompositor *subcompositor;
     struct wl_shm *shm;
     struct xdg_wm_base *xdg_wm_base;
+    struct wp_cursor_shape_manager_v1 *cursor_shape_manager;
 
-    struct wl_seat *seat;
+    struct wl_seat *seat;         /* owned by the input thread */
     struct wl_pointer *pointer;
 
+    /* Content; the titlebar is a subsurface of it, placed above */
     struct wl_surface *surface;
+    struct wl_surface *titlebar;  /* csd.surface, fixed once created */
     struct xdg_surface *xdg_surface;
     struct xdg_toplevel *xdg_toplevel;
 
-    struct wl_buffer *buffer;
-
-    int running;
+    /* Three threads, each dispatching its own queue and touching only its
+     * own fields: main handles the registry and xdg-shell, input owns the
+     * pointer, render owns drawing, buffers and frame callbacks. */
+    struct queue_thread main_thread;
+    struct queue_thread input_thread;
+    struct queue_thread render_thread;
+    /* Wrappers whose new objects (pools, buffers, frame callbacks) report
+     * to the render queue */
+    struct wl_shm *render_shm;
+    struct wl_surface *render_surface;
+    /* Same for cursor surfaces on the input queue */
+    struct wl_compositor *input_compositor;
+    struct wl_shm *input_shm;
+
+    /* main thread */
+    int pending_width;
+    int pending_height;
+
+    /* input thread; the window size is published by the render thread */
+    atomic_int hit_width;
+    atomic_int hit_height;
     int maximized;
 
-    int pointer_x;
-    int pointer_y;
-    uint32_t last_serial;
-
+    struct pointer_input pointer_input;
+    struct cursor_manager *cursors;
+    struct cursor_pointer *cursor;
+    const char *cursor_name;
+    int hover_button;             /* -1 when not over a button */
+    int pressed_button;
+
+    /* Button states packed two bits each, handed to the render thread */
+    atomic_int decoration_states;
+
+    /* render thread */
+    struct shm_buffer buffers[MAX_BUFFERS];
+    enum swapchain_policy swapchain_policy;
+    int redraw_pending;
+    struct damage_tracker damage;
+    struct frame_scheduler frames;
+    struct raster_pool *raster;
+    struct surface_region region;
+    struct csd csd;
+    int configured;
+
+    /* Content size, i.e. the window minus the titlebar */
     int width;
     int height;
 };
 
-/* ---------------- shm helper ---------------- */
+/* ---------------- swapchain ---------------- */
 
 static void
-buffer_release(void *data, struct wl_buffer *buffer)
+destroy_buffer(struct shm_buffer *buffer)
 {
-    wl_buffer_destroy(buffer);
+    if (buffer->wl_buffer)
+        wl_buffer_destroy(buffer->wl_buffer);
+    if (buffer->file.data)
+        shm_file_destroy(&buffer->file);
+
+    buffer->wl_buffer = NULL;
+    buffer->busy = 0;
+}
+
+static void
+buffer_release(void *data, struct wl_buffer *wl_buffer)
+{
+    struct shm_buffer *buffer = data;
+    struct app_state *state = buffer->state;
+
+    buffer->busy = 0;
+
+    /* The window was resized while the compositor still held this one */
+    if (buffer->width != state->width || buffer->height != state->height)
+        destroy_buffer(buffer);
+
+    if (state->redraw_pending) {
+        state->redraw_pending = 0;
+        frame_scheduler_schedule(&state->frames);
+    }
 }
 
 static const struct wl_buffer_listener buffer_listener = {
@@ -56,86 +159,148 @@ static const struct wl_buffer_listener buffer_listener = {
 };
 
 static int
-create_shm_file(off_t size)
+init_buffer(struct app_state *state, struct shm_buffer *buffer)
 {
-    char name[] = "/wayland-shm-XXXXXX";
-    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-    if (fd < 0)
+    int stride = state->width * 4;
+    size_t size = (size_t)stride * state->height;
+
+    /* Sealed memfd with a fallback to a randomly named shm_open file */
+    if (shm_file_create(&buffer->file, size, SHM_FILE_DEFAULT) < 0)
         return -1;
 
-    shm_unlink(name);
+    struct wl_shm_pool *pool =
+        wl_shm_create_pool(state->render_shm, buffer->file.fd, size);
 
-    if (ftruncate(fd, size) < 0) {
-        close(fd);
-        return -1;
-    }
-    return fd;
-}
+    buffer->wl_buffer =
+        wl_shm_pool_create_buffer(pool, 0,
+                                  state->width, state->height,
+                                  stride,
+                                  BUFFER_FORMAT);
+    wl_buffer_add_listener(buffer->wl_buffer,
+                           &buffer_listener,
+                           buffer);
 
-/* ---------------- drawing ---------------- */
+    wl_shm_pool_destroy(pool);
 
-static void
-draw_frame(struct app_state *state)
+    buffer->state = state;
+    buffer->width = state->width;
+    buffer->height = state->height;
+    buffer->busy = 0;
+    buffer->frame = 0;
+    return 0;
+}
+
+/* Returns an idle buffer of the current size, or NULL if all are busy */
+static struct shm_buffer *
+acquire_buffer(struct app_state *state)
 {
-    int stride = state->width * 4;
-    int size = stride * state->height;
+    struct shm_buffer *empty = NULL;
+    int live = 0;
+
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        struct shm_buffer *buffer = &state->buffers[i];
+
+        if (buffer->wl_buffer && !buffer->busy &&
+            (buffer->width != state->width ||
+             buffer->height != state->height))
+            destroy_buffer(buffer);
 
-    int fd = create_shm_file(size);
-    uint32_t *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (!buffer->wl_buffer) {
+            if (!empty)
+                empty = buffer;
+            continue;
+        }
 
-    for (int y = 0; y < state->height; y++) {
-        for (int x = 0; x < state->width; x++) {
-            uint32_t color = 0xFFFFFFFF;
+        live++;
+        if (!buffer->busy)
+            return buffer;
+    }
 
-            if (y < TITLEBAR_HEIGHT) {
-                color = 0xFF444444;
+    int limit = state->swapchain_policy == SWAPCHAIN_ALLOCATE ?
+                MAX_BUFFERS : MIN_BUFFERS;
+    if (empty && live < limit && init_buffer(state, empty) == 0)
+        return empty;
 
-                if (x > state->width - BUTTON_WIDTH)
-                    color = 0xFFFF0000;       // close
-                else if (x > state->width - 2 * BUTTON_WIDTH)
-                    color = 0xFF00FF00;       // maximize
-                else if (x > state->width - 3 * BUTTON_WIDTH)
-                    color = 0xFFFFFF00;       // minimize
-            }
+    return NULL;
+}
 
-            data[y * state->width + x] = color;
-        }
+/* ---------------- drawing ---------------- */
+
+/* Paints one tile of the content; tiles of the same frame run
+ * concurrently. The titlebar lives in its own subsurface and is never
+ * repainted here. */
+static void
+paint_tile(void *data, uint32_t *pixels, int stride,
+           int x0, int y0, int width, int height)
+{
+    fill_solid(pixels + (size_t)y0 * (stride / 4) + x0,
+               width, height, stride, 0xFFFFFFFF);
+}
+
+/* Called by the frame scheduler, at most once per frame callback */
+static void
+draw_frame(void *data, uint32_t time)
+{
+    struct app_state *state = data;
+    struct shm_buffer *buffer = acquire_buffer(state);
+    if (!buffer) {
+        /* Never scribble on a buffer the compositor may still be reading */
+        if (state->swapchain_policy != SWAPCHAIN_DROP)
+            state->redraw_pending = 1;
+        return;
     }
 
-    struct wl_shm_pool *pool =
-        wl_shm_create_pool(state->shm, fd, size);
+    /* Bring the buffer up to date: only what changed since it was last
+     * committed needs painting, which is nothing for a same-size configure */
+    struct damage_region repaint;
+    damage_tracker_repaint(&state->damage, buffer->frame, &repaint);
+
+    /* Spread each rect over the raster threads; every tile is written
+     * by the time run returns, so the buffer is safe to attach */
+    for (int i = 0; i < repaint.count; i++) {
+        const struct damage_rect *r = &repaint.rects[i];
+        raster_pool_run(state->raster, buffer->file.data, state->width * 4,
+                        r->x, r->y, r->width, r->height,
+                        paint_tile, state);
+    }
 
-    state->buffer =
-        wl_shm_pool_create_buffer(pool, 0,
-                                  state->width, state->height,
-                                  stride,
-                                  WL_SHM_FORMAT_XRGB8888);
-    wl_buffer_add_listener(state->buffer,
-                       &buffer_listener,
-                       NULL);
+    buffer->busy = 1;
+    wl_surface_attach(state->surface, buffer->wl_buffer, 0, 0);
+    /* XRGB content is opaque whatever its size; only a resize resends it */
+    surface_region_set_opaque(&state->region, state->width, state->height,
+                              !shm_format_has_alpha(BUFFER_FORMAT),
+                              NULL);
+    buffer->frame = damage_tracker_commit(&state->damage, state->surface);
+    frame_scheduler_commit(&state->frames);
+}
 
-    wl_shm_pool_destroy(pool);
-    close(fd);
+/* Render thread: bring the titlebar up to the button states published by
+ * the input thread. The subsurface is synchronized, so its commit only
+ * shows once the content surface is committed too. */
+static void
+update_decorations(void *data)
+{
+    struct app_state *state = data;
+    int packed = atomic_load(&state->decoration_states);
 
-    wl_surface_attach(state->surface, state->buffer, 0, 0);
-    wl_surface_damage(state->surface, 0, 0, state->width, state->height);
-    wl_surface_commit(state->surface);
+    for (int i = 0; i < CSD_BUTTON_COUNT; i++)
+        csd_set_button_state(&state->csd, i, (packed >> (2 * i)) & 3);
 
-    munmap(data, size);
+    if (csd_update(&state->csd) == 1 && state->configured)
+        wl_surface_commit(state->surface);
 }
 
 /* ---------------- pointer logic ---------------- */
 
 static void
-handle_click(struct app_state *state, int x, int y, uint32_t serial)
+activate_button(struct app_state *state, enum csd_button button)
 {
-    if (y >= TITLEBAR_HEIGHT)
-        return;
-
-    if (x > state->width - BUTTON_WIDTH) {
+    switch (button) {
+    case CSD_BUTTON_CLOSE:
         printf("close\n");
-        state->running = 0;
-    } else if (x > state->width - 2 * BUTTON_WIDTH) {
+        queue_thread_quit(&state->main_thread);
+        break;
+    case CSD_BUTTON_MAXIMIZE:
         printf("maximize / restore\n");
         if (state->maximized)
             xdg_toplevel_unset_maximized(state->xdg_toplevel);
@@ -143,99 +308,107 @@ handle_click(struct app_state *state, int x, int y, uint32_t serial)
             xdg_toplevel_set_maximized(state->xdg_toplevel);
 
         state->maximized = !state->maximized;
-    } else if (x > state->width - 3 * BUTTON_WIDTH) {
+        break;
+    default:
         printf("minimize\n");
         xdg_toplevel_set_minimized(state->xdg_toplevel);
-    } else {
-        printf("move\n");
-        xdg_toplevel_move(state->xdg_toplevel,
-                          state->seat,
-                          serial);
+        break;
     }
 }
 
 static void
-pointer_enter(void *data,
-              struct wl_pointer *pointer,
-              uint32_t serial,
-              struct wl_surface *surface,
-              wl_fixed_t sx,
-              wl_fixed_t sy)
+handle_press(struct app_state *state, const struct csd_hit *hit,
+             uint32_t serial)
 {
-    struct app_state *state = data;
-    state->last_serial = serial;
-    state->pointer_x = wl_fixed_to_int(sx);
-    state->pointer_y = wl_fixed_to_int(sy);
+    switch (hit->kind) {
+    case CSD_HIT_BUTTON:
+        state->pressed_button = hit->button;
+        break;
+    case CSD_HIT_TITLEBAR:
+        printf("move\n");
+        xdg_toplevel_move(state->xdg_toplevel, state->seat, serial);
+        break;
+    case CSD_HIT_RESIZE:
+        xdg_toplevel_resize(state->xdg_toplevel, state->seat, serial,
+                            hit->edges);
+        break;
+    default:
+        break;
+    }
 }
 
-static void pointer_leave(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface) {}
-
+/* A button is pressed while held on it, hovered while the pointer is over
+ * it with nothing held; only a change is sent to the render thread, which
+ * then repaints just the buttons that differ. */
 static void
-pointer_motion(void *data,
-               struct wl_pointer *pointer,
-               uint32_t time,
-               wl_fixed_t sx,
-               wl_fixed_t sy)
+publish_decorations(struct app_state *state)
 {
-    struct app_state *state = data;
-    state->pointer_x = wl_fixed_to_int(sx);
-    state->pointer_y = wl_fixed_to_int(sy);
+    int packed = 0;
+
+    for (int i = 0; i < CSD_BUTTON_COUNT; i++) {
+        enum csd_button_state s = CSD_BUTTON_NORMAL;
+
+        if (i == state->pressed_button && i == state->hover_button)
+            s = CSD_BUTTON_PRESSED;
+        else if (i == state->hover_button && state->pressed_button < 0)
+            s = CSD_BUTTON_HOVER;
+        packed |= s << (2 * i);
+    }
+
+    if (atomic_exchange(&state->decoration_states, packed) != packed)
+        queue_thread_post(&state->render_thread, update_decorations, state);
 }
 
+/* Events between two wl_pointer.frame are one logical event: motion
+ * bursts from high-rate mice collapse into a single position, and a
+ * click is handled at the position the frame ends on. */
 static void
-pointer_button(void *data,
-               struct wl_pointer *pointer,
-               uint32_t serial,
-               uint32_t time,
-               uint32_t button,
-               uint32_t state)
+pointer_frame(void *data, const struct pointer_event *event)
 {
-    struct app_state *state_app = data;
+    struct app_state *state = data;
 
-    if (button == BTN_LEFT &&
-        state == WL_POINTER_BUTTON_STATE_PRESSED) {
+    if (!event->surface) {
+        state->hover_button = -1;
+        state->pressed_button = -1;
+        state->cursor_name = NULL;
+        publish_decorations(state);
+        return;
+    }
 
-        handle_click(state_app,
-                     state_app->pointer_x,
-                     state_app->pointer_y,
-                     serial);
+    /* Window coordinates: the titlebar sits right above the content */
+    double y = event->y;
+    if (event->surface != state->titlebar)
+        y += CSD_TITLEBAR_HEIGHT;
+
+    struct csd_hit hit =
+        csd_hit_test(atomic_load(&state->hit_width),
+                     atomic_load(&state->hit_height), event->x, y);
+    state->hover_button = hit.kind == CSD_HIT_BUTTON ? (int)hit.button : -1;
+
+    const char *name = csd_hit_cursor(&hit);
+    if (state->cursor &&
+        ((event->mask & POINTER_EVENT_ENTER) || name != state->cursor_name))
+        cursor_pointer_set(state->cursor, event->enter_serial, name);
+    state->cursor_name = name;
+
+    const struct pointer_button *press =
+        pointer_event_find_button(event, BTN_LEFT,
+                                  WL_POINTER_BUTTON_STATE_PRESSED);
+    const struct pointer_button *release =
+        pointer_event_find_button(event, BTN_LEFT,
+                                  WL_POINTER_BUTTON_STATE_RELEASED);
+
+    if (press)
+        handle_press(state, &hit, press->serial);
+    if (release && state->pressed_button >= 0) {
+        /* Like any button, it only fires if released where it was pressed */
+        if (state->pressed_button == state->hover_button)
+            activate_button(state, state->pressed_button);
+        state->pressed_button = -1;
     }
-}
 
-static void pointer_axis(void *data,
-                         struct wl_pointer *pointer,
-                         uint32_t time,
-                         uint32_t axis,
-                         wl_fixed_t value) {}
-
-static void pointer_frame(void *data,
-                          struct wl_pointer *pointer) {}
-
-static void pointer_axis_source(void *data,
-                                struct wl_pointer *pointer,
-                                uint32_t source) {}
-
-static void pointer_axis_stop(void *data,
-                              struct wl_pointer *pointer,
-                              uint32_t time,
-                              uint32_t axis) {}
-
-static void pointer_axis_discrete(void *data,
-                                  struct wl_pointer *pointer,
-                                  uint32_t axis,
-                                  int32_t discrete) {}
-
-static const struct wl_pointer_listener pointer_listener = {
-    .enter  = pointer_enter,
-    .leave  = pointer_leave,
-    .motion = pointer_motion,
-    .button = pointer_button,
-    .axis          = pointer_axis,
-    .frame         = pointer_frame,
-    .axis_source   = pointer_axis_source,
-    .axis_stop     = pointer_axis_stop,
-    .axis_discrete = pointer_axis_discrete,
-};
+    publish_decorations(state);
+}
 
 /* ---------------- xdg-shell ---------------- */
 
@@ -251,13 +424,66 @@ static const struct xdg_wm_base_listener wm_base_listener = {
     .ping = xdg_wm_base_ping
 };
 
+struct configure {
+    struct app_state *state;
+    uint32_t serial;
+    int width;
+    int height;
+};
+
+/* Runs on the render thread: the ack has to go out after any commit of
+ * the old size, so it is sent from the thread that commits */
+static void
+apply_configure(void *data)
+{
+    struct configure *configure = data;
+    struct app_state *state = configure->state;
+    int height = configure->height - CSD_TITLEBAR_HEIGHT;
+
+    if (!state->configured ||
+        configure->width != state->width || height != state->height) {
+        state->width  = configure->width;
+        state->height = height;
+        damage_tracker_resize(&state->damage, state->width, state->height);
+        atomic_store(&state->hit_width, configure->width);
+        atomic_store(&state->hit_height, configure->height);
+
+        /* The window geometry reaches up over the titlebar subsurface */
+        xdg_surface_set_window_geometry(state->xdg_surface,
+                                        0, -CSD_TITLEBAR_HEIGHT,
+                                        configure->width, configure->height);
+        csd_set_width(&state->csd, state->width);
+    }
+    /* Committed together with the next frame of content */
+    csd_update(&state->csd);
+    xdg_surface_ack_configure(state->xdg_surface, configure->serial);
+    state->configured = 1;
+
+    /* A resize drag sends configures faster than we can present; only
+     * the newest one gets drawn, on the next frame callback */
+    frame_scheduler_schedule(&state->frames);
+    free(configure);
+}
+
 static void
 xdg_surface_configure(void *data,
                       struct xdg_surface *surface,
                       uint32_t serial)
 {
-    xdg_surface_ack_configure(surface, serial);
-    draw_frame(data);
+    struct app_state *state = data;
+    struct configure *configure = malloc(sizeof(*configure));
+    if (!configure)
+        return;
+
+    *configure = (struct configure){
+        .state  = state,
+        .serial = serial,
+        .width  = state->pending_width,
+        .height = state->pending_height,
+    };
+    if (queue_thread_post(&state->render_thread,
+                          apply_configure, configure) < 0)
+        free(configure);
 }
 
 static const struct xdg_surface_listener xdg_surface_listener = {
@@ -273,8 +499,8 @@ xdg_toplevel_configure(void *data,
 {
     struct app_state *state = data;
     if (width > 0 && height > 0) {
-        state->width  = width;
-        state->height = height;
+        state->pending_width  = width < MIN_WIDTH ? MIN_WIDTH : width;
+        state->pending_height = height < MIN_HEIGHT ? MIN_HEIGHT : height;
     }
 }
 
@@ -282,7 +508,7 @@ static void
 xdg_toplevel_close(void *data,
                    struct xdg_toplevel *toplevel)
 {
-    ((struct app_state *)data)->running = 0;
+    queue_thread_quit(&((struct app_state *)data)->main_thread);
 }
 
 static const struct xdg_toplevel_listener xdg_toplevel_listener = {
@@ -292,47 +518,76 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 
 /* ---------------- registry ---------------- */
 
+/* Seats can be hot-plugged; the first one drives the pointer. Both ends
+ * run on the input thread, which owns state->seat and state->pointer. */
 static void
-registry_global(void *data,
-                struct wl_registry *registry,
-                uint32_t name,
-                const char *interface,
-                uint32_t version)
+attach_seat(void *data)
 {
-    struct app_state *state = data;
+    struct wl_seat *seat = data;
+    struct app_state *state = wl_seat_get_user_data(seat);
 
-    if (strcmp(interface, wl_compositor_interface.name) == 0)
-        state->compositor =
-            wl_registry_bind(registry, name,
-                             &wl_compositor_interface, 4);
-
-    else if (strcmp(interface, wl_shm_interface.name) == 0)
-        state->shm =
-            wl_registry_bind(registry, name,
-                             &wl_shm_interface, 1);
-
-    else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        state->xdg_wm_base =
-            wl_registry_bind(registry, name,
-                             &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(state->xdg_wm_base,
-                                 &wm_base_listener,
-                                 state);
-    }
-    else if (strcmp(interface, wl_seat_interface.name) == 0) {
-        state->seat =
-            wl_registry_bind(registry, name,
-                             &wl_seat_interface, 7);
-        state->pointer = wl_seat_get_pointer(state->seat);
-        wl_pointer_add_listener(state->pointer,
-                                &pointer_listener,
-                                state);
+    if (state->seat)
+        return;
+    state->seat = seat;
+
+    /* Pointer events are dispatched on the input thread */
+    struct wl_seat *wrapper =
+        queue_thread_wrap(&state->input_thread, seat);
+    state->pointer = wl_seat_get_pointer(wrapper);
+    wl_proxy_wrapper_destroy(wrapper);
+    pointer_input_init(&state->pointer_input, state->pointer,
+                       pointer_frame, state);
+    if (state->cursors)
+        state->cursor = cursor_pointer_create(state->cursors, state->pointer);
+}
+
+static void
+detach_seat(void *data)
+{
+    struct wl_seat *seat = data;
+    struct app_state *state = wl_seat_get_user_data(seat);
+
+    if (seat == state->seat) {
+        if (state->cursor)
+            cursor_pointer_destroy(state->cursor);
+        state->cursor = NULL;
+        state->cursor_name = NULL;
+        wl_pointer_destroy(state->pointer);
+        state->pointer = NULL;
+        state->seat = NULL;
     }
+    wl_seat_destroy(seat);
+}
+
+static void
+seat_bound(void *data, void *proxy, uint32_t version)
+{
+    struct app_state *state = data;
+    wl_proxy_set_user_data(proxy, state);
+    queue_thread_post(&state->input_thread, attach_seat, proxy);
+}
+
+static void
+seat_removed(void *data, void *proxy)
+{
+    struct app_state *state = data;
+    queue_thread_post(&state->input_thread, detach_seat, proxy);
 }
 
-static const struct wl_registry_listener registry_listener = {
-    .global = registry_global,
-    .global_remove = NULL
+/* interface, min/max version, slot, listener, required, hot-plug hooks */
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4,
+      offsetof(struct app_state, compositor), NULL, true },
+    { &wl_subcompositor_interface, 1, 1,
+      offsetof(struct app_state, subcompositor), NULL, true },
+    { &wl_shm_interface, 1, 1,
+      offsetof(struct app_state, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1,
+      offsetof(struct app_state, xdg_wm_base), &wm_base_listener, true },
+    { &wp_cursor_shape_manager_v1_interface, 1, 1,
+      offsetof(struct app_state, cursor_shape_manager), NULL, false },
+    { &wl_seat_interface, 1, 8,
+      REGISTRY_NO_SLOT, NULL, false, seat_bound, seat_removed },
 };
 
 /* ---------------- main ---------------- */
@@ -341,21 +596,76 @@ int
 main(void)
 {
     struct app_state state = {
-        .running = 1,
         .width = WIDTH,
-        .height = HEIGHT,
+        .height = HEIGHT - CSD_TITLEBAR_HEIGHT,
+        .pending_width = WIDTH,
+        .pending_height = HEIGHT,
+        .hit_width = WIDTH,
+        .hit_height = HEIGHT,
+        .hover_button = -1,
+        .pressed_button = -1,
+        .swapchain_policy = SWAPCHAIN_ALLOCATE,
     };
+    damage_tracker_init(&state.damage, state.width, state.height);
 
     state.display = wl_display_connect(NULL);
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry,
-                             &registry_listener,
-                             &state);
+    if (!state.display)
+        return 1;
+
+    if (queue_thread_init(&state.main_thread, state.display,
+                          true, "main") < 0 ||
+        queue_thread_init(&state.input_thread, state.display,
+                          false, "input") < 0 ||
+        queue_thread_init(&state.render_thread, state.display,
+                          false, "render") < 0)
+        return 1;
+
+    state.registry =
+        registry_create(state.display, registry_bindings,
+                        sizeof(registry_bindings) /
+                        sizeof(registry_bindings[0]),
+                        &state);
     wl_display_roundtrip(state.display);
 
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "missing global %s\n", missing);
+        return 1;
+    }
+
     state.surface =
         wl_compositor_create_surface(state.compositor);
 
+    /* A NULL pool just paints on the render thread */
+    state.raster = raster_pool_create(0);
+
+    state.render_shm =
+        queue_thread_wrap(&state.render_thread, state.shm);
+    state.render_surface =
+        queue_thread_wrap(&state.render_thread, state.surface);
+
+    frame_scheduler_init(&state.frames, state.render_surface,
+                         draw_frame, &state);
+    surface_region_init(&state.region, state.compositor, state.surface);
+
+    /* Titlebar buffers are released on the render queue as well */
+    if (csd_init(&state.csd, state.compositor, state.subcompositor,
+                 state.render_shm, state.surface,
+                 update_decorations, &state) < 0)
+        return 1;
+    state.titlebar = state.csd.surface;
+
+    /* Cursor surfaces animate from frame callbacks on the input queue */
+    state.input_compositor =
+        queue_thread_wrap(&state.input_thread, state.compositor);
+    state.input_shm =
+        queue_thread_wrap(&state.input_thread, state.shm);
+    state.cursors = cursor_manager_create(state.input_compositor,
+                                          state.input_shm, NULL, 0);
+    if (state.cursors && state.cursor_shape_manager)
+        cursor_manager_set_shape_manager(state.cursors,
+                                         state.cursor_shape_manager);
+
     state.xdg_surface =
         xdg_wm_base_get_xdg_surface(state.xdg_wm_base,
                                     state.surface);
@@ -373,12 +683,44 @@ main(void)
 
     xdg_toplevel_set_title(state.xdg_toplevel,
                            "Wayland CSD Demo");
+    xdg_toplevel_set_min_size(state.xdg_toplevel, MIN_WIDTH, MIN_HEIGHT);
 
     wl_surface_commit(state.surface);
 
-    while (state.running &&
-           wl_display_dispatch(state.display) != -1) {
-    }
+    if (queue_thread_start(&state.input_thread) < 0 ||
+        queue_thread_start(&state.render_thread) < 0)
+        return 1;
+
+    queue_thread_run(&state.main_thread);
+
+    /* Stop the workers before tearing down what they own */
+    queue_thread_join(&state.input_thread);
+    queue_thread_join(&state.render_thread);
+
+    frame_stats_print(&state.frames.stats, stderr);
+    frame_scheduler_finish(&state.frames);
+
+    raster_pool_destroy(state.raster);
+    for (int i = 0; i < MAX_BUFFERS; i++)
+        destroy_buffer(&state.buffers[i]);
+    csd_finish(&state.csd);
+
+    if (state.cursor)
+        cursor_pointer_destroy(state.cursor);
+    if (state.cursors)
+        cursor_manager_destroy(state.cursors);
+    if (state.pointer)
+        wl_pointer_destroy(state.pointer);
+    wl_proxy_wrapper_destroy(state.input_shm);
+    wl_proxy_wrapper_destroy(state.input_compositor);
+    wl_proxy_wrapper_destroy(state.render_surface);
+    wl_proxy_wrapper_destroy(state.render_shm);
+
+    queue_thread_finish(&state.input_thread);
+    queue_thread_finish(&state.render_thread);
+    queue_thread_finish(&state.main_thread);
+
+    registry_destroy(state.registry);
 
     wl_display_disconnect(state.display);
     return 0;
@@ -4,17 +4,32 @@
 #include <wayland-client.h>
 #include <wayland-egl.h>
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
+#include <time.h>
+#include "damage.h"
+#include "egl_config.h"
+#include "frame_scheduler.h"
+#include "registry.h"
+#include "startup.h"
+#include "surface_region.h"
 #include "xdg-shell.h" // 替换 wl_shell 为现代的 xdg-shell
 
 struct wl_display *display = NULL;
-struct wl_compositor *compositor = NULL;
+struct registry *registry;
+struct startup_timer startup;
+
+/* 由绑定表填充的全局对象 */
+struct globals {
+    struct wl_compositor *compositor;
+    struct xdg_wm_base *wm_base;
+} globals;
+
 struct wl_surface *surface;
 struct wl_egl_window *egl_window;
-struct wl_region *region;
+struct surface_region region;
 
 // 替换 wl_shell 相关的全局变量
-struct xdg_wm_base *wm_base = NULL;
 struct xdg_surface *xdg_surface;
 struct xdg_toplevel *xdg_toplevel;
 
@@ -22,6 +37,30 @@ EGLDisplay egl_display;
 EGLConfig egl_conf;
 EGLSurface egl_surface;
 EGLContext egl_context;
+EGLint egl_alpha_size;
+
+/* 可选的 EGL 扩展，驱动不支持时为 NULL / false，退回整帧重画 */
+bool has_buffer_age;
+PFNEGLSETDAMAGEREGIONKHRPROC set_damage_region;
+PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_buffers_with_damage;
+
+/* 渲染循环：帧回调驱动，damage 记录每帧变化，配合 buffer age 只重画缺的部分 */
+struct frame_scheduler frames;
+struct damage_tracker damage;
+struct timespec start_time;
+
+#define SQUARE_SIZE 64
+
+/* 两种清屏颜色，RGBA；窗口里的每个像素都是其中之一 */
+static const GLfloat background_color[4] = { 1.0, 1.0, 0.0, 1.0 };   // 黄色背景
+static const GLfloat square_color[4] = { 0.2, 0.4, 0.9, 1.0 };       // 蓝色方块
+
+int width = 480, height = 360;          // 当前窗口尺寸
+int pending_width, pending_height;      // toplevel configure 给出的尺寸，0 表示由我们决定
+int square_x = -1, square_y = -1;       // 上一帧方块的位置，-1 表示还没画过
+bool first_frame = true;
+
+int configured = 0;
 
 /* XDG Shell 的 Ping-Pong 机制：混成器用来检查程序是否卡死 */
 static void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial) {
@@ -32,22 +71,29 @@ static const struct xdg_wm_base_listener xdg_wm_base_listener = {
     .ping = xdg_wm_base_ping,
 };
 
+static void apply_size(int new_width, int new_height);
+
 /* 响应 XDG Surface 配置事件（必须回应 Ack） */
 static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
     xdg_surface_ack_configure(xdg_surface, serial);
+    configured = 1;
+    apply_size(pending_width > 0 ? pending_width : width,
+               pending_height > 0 ? pending_height : height);
 }
 
 static const struct xdg_surface_listener xdg_surface_listener = {
     .configure = xdg_surface_configure,
 };
 
-/* 响应窗口大小变化及关闭请求 */
+/* 响应窗口大小变化及关闭请求：尺寸先记下来，等 xdg_surface.configure 时一起生效 */
 static void xdg_toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel,
-                                   int32_t width, int32_t height, struct wl_array *states) {
-    // 可以在这里改变 egl_window 的大小：wl_egl_window_resize(...)
+                                   int32_t new_width, int32_t new_height, struct wl_array *states) {
+    pending_width = new_width;
+    pending_height = new_height;
 }
 
 static void xdg_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel) {
+    frame_stats_print(&frames.stats, stderr);
     exit(0);
 }
 
@@ -56,45 +102,184 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
     .close = xdg_toplevel_close,
 };
 
-/* 注册表监听器 */
+/* 全局对象绑定表：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需 */
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct globals, compositor), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct globals, wm_base), &xdg_wm_base_listener, true },
+};
+
+/* 不透明区域跟着窗口尺寸走：配置没有 alpha 通道，或者所有清屏颜色的 alpha 都为 1
+ * （clear_alpha 取其中最小的），画出来的每个像素都是不透明的，
+ * 合成器可以不混合、直接剔除下面的窗口 */
 static void
-global_registry_handler(void *data, struct wl_registry *registry, uint32_t id,
-                        const char *interface, uint32_t version)
-{
-    printf("Got a registry event for %s id %d\n", interface, id);
-    if (strcmp(interface, "wl_compositor") == 0) {
-        compositor = wl_registry_bind(registry, id, &wl_compositor_interface, 1);
-    } else if (strcmp(interface, "xdg_wm_base") == 0) {
-        // 绑定现代的 xdg_wm_base
-        wm_base = wl_registry_bind(registry, id, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(wm_base, &xdg_wm_base_listener, NULL);
+update_opaque_region(int width, int height, float clear_alpha) {
+    surface_region_set_opaque(&region, width, height,
+                              egl_alpha_size == 0 || clear_alpha >= 1.0f, NULL);
+}
+
+/* 方块在 [0, range] 之间来回移动的三角波 */
+static int
+bounce(long t, int range) {
+    if (range <= 0) {
+        return 0;
+    }
+    t %= 2 * range;
+    return t < range ? t : 2 * range - t;
+}
+
+/* damage 用左上角为原点的表面坐标，EGL 的矩形以左下角为原点 */
+static int
+to_egl_rects(const struct damage_region *region, EGLint *rects) {
+    for (int i = 0; i < region->count; i++) {
+        const struct damage_rect *r = &region->rects[i];
+        rects[i * 4 + 0] = r->x;
+        rects[i * 4 + 1] = height - r->y - r->height;
+        rects[i * 4 + 2] = r->width;
+        rects[i * 4 + 3] = r->height;
     }
+    return region->count;
 }
 
 static void
-global_registry_remover(void *data, struct wl_registry *registry, uint32_t id)
-{
-    printf("Got a registry losing event for %d\n", id);
+clear_rect(int x, int y, int w, int h) {
+    if (w > 0 && h > 0) {
+        glScissor(x, height - y - h, w, h);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
 }
 
-static const struct wl_registry_listener registry_listener = {
-    global_registry_handler,
-    global_registry_remover
-};
+/* 只重画 repaint 里的矩形：先铺背景，再补上落在矩形里的那部分方块 */
+static void
+paint_region(const struct damage_region *repaint) {
+    glEnable(GL_SCISSOR_TEST);
+    for (int i = 0; i < repaint->count; i++) {
+        const struct damage_rect *r = &repaint->rects[i];
+        glClearColor(background_color[0], background_color[1], background_color[2], background_color[3]);
+        clear_rect(r->x, r->y, r->width, r->height);
+
+        int x0 = r->x > square_x ? r->x : square_x;
+        int y0 = r->y > square_y ? r->y : square_y;
+        int x1 = r->x + r->width < square_x + SQUARE_SIZE ? r->x + r->width : square_x + SQUARE_SIZE;
+        int y1 = r->y + r->height < square_y + SQUARE_SIZE ? r->y + r->height : square_y + SQUARE_SIZE;
+        glClearColor(square_color[0], square_color[1], square_color[2], square_color[3]);
+        clear_rect(x0, y0, x1 - x0, y1 - y0);
+    }
+    glDisable(GL_SCISSOR_TEST);
+}
 
+/* 每个帧回调画一帧。swap interval 为 0，eglSwapBuffers 不会阻塞等待合成器，
+ * 节奏完全由我们自己挂的帧回调决定 */
 static void
-create_opaque_region() {
-    region = wl_compositor_create_region(compositor);
-    wl_region_add(region, 0, 0, 480, 360);
-    wl_surface_set_opaque_region(surface, region);
-    
-    // 设置完不透明区域后，应当释放这个 region 句柄，避免内存泄漏
-    wl_region_destroy(region);
+draw_frame(void *data, uint32_t time) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (now.tv_sec - start_time.tv_sec) * 1000 + (now.tv_nsec - start_time.tv_nsec) / 1000000;
+
+    // 这一帧的变化：方块的旧位置和新位置
+    int x = bounce(ms / 4, width - SQUARE_SIZE);
+    int y = bounce(ms / 6, height - SQUARE_SIZE);
+    if (x != square_x || y != square_y) {
+        if (square_x >= 0) {
+            damage_tracker_add(&damage, square_x, square_y, SQUARE_SIZE, SQUARE_SIZE);
+        }
+        damage_tracker_add(&damage, x, y, SQUARE_SIZE, SQUARE_SIZE);
+        square_x = x;
+        square_y = y;
+    }
+
+    // buffer age 为 n 表示后缓冲里是 n 帧之前的内容，0 表示内容未知
+    EGLint age = 0;
+    if (has_buffer_age) {
+        eglQuerySurface(egl_display, egl_surface, EGL_BUFFER_AGE_EXT, &age);
+    }
+    uint64_t buffer_frame = age > 0 && (uint64_t)age <= damage.frame ? damage.frame - age + 1 : 0;
+    struct damage_region repaint;
+    damage_tracker_repaint(&damage, buffer_frame, &repaint);
+
+    EGLint rects[DAMAGE_MAX_RECTS * 4];
+    if (set_damage_region) {
+        // 告诉驱动这一帧只写这些区域，其余部分它可以不必准备（tiler 上省带宽）
+        set_damage_region(egl_display, egl_surface, rects, to_egl_rects(&repaint, rects));
+    }
+    paint_region(&repaint);
+
+    // 报告给合成器的只是本帧的变化，与补画旧缓冲区的区域无关
+    int n_rects = to_egl_rects(&damage.pending, rects);
+    update_opaque_region(width, height, background_color[3] < square_color[3] ?
+                                        background_color[3] : square_color[3]);
+    if (first_frame) {
+        startup_first_commit(&startup, surface);
+        first_frame = false;
+    }
+    // eglSwapBuffers 内部会 attach 并 commit，帧回调要在它之前挂上
+    frame_scheduler_prepare_commit(&frames);
+    damage_tracker_commit(&damage, NULL);
+
+    EGLBoolean swapped = swap_buffers_with_damage
+        ? swap_buffers_with_damage(egl_display, egl_surface, rects, n_rects)
+        : eglSwapBuffers(egl_display, egl_surface);
+    if (!swapped) {
+        fprintf(stderr, "Swapped buffers failed: 0x%x\n", eglGetError());
+    }
+
+    // 持续动画：下一个帧回调到来时再画一帧
+    frame_scheduler_schedule(&frames);
+}
+
+/* 尺寸变化：EGL 窗口在下一次 swap 时换成新尺寸的缓冲区，旧缓冲区的内容全部作废 */
+static void
+apply_size(int new_width, int new_height) {
+    if (new_width == width && new_height == height) {
+        return;
+    }
+    width = new_width;
+    height = new_height;
+    if (!egl_window) {
+        return;
+    }
+    wl_egl_window_resize(egl_window, width, height, 0, 0);
+    glViewport(0, 0, width, height);
+    damage_tracker_resize(&damage, width, height);
+    frame_scheduler_schedule(&frames);
+}
+
+static bool
+has_extension(const char *extensions, const char *name) {
+    size_t len = strlen(name);
+    for (const char *p = extensions; p && (p = strstr(p, name)); p += len) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* 查询局部重画相关的扩展，llvmpipe 等软件渲染器缺哪个就退回哪个 */
+static void
+init_extensions() {
+    const char *extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+
+    has_buffer_age = has_extension(extensions, "EGL_EXT_buffer_age");
+    if (has_extension(extensions, "EGL_KHR_partial_update")) {
+        set_damage_region = (PFNEGLSETDAMAGEREGIONKHRPROC)eglGetProcAddress("eglSetDamageRegionKHR");
+        // partial update 自带 buffer age 查询
+        has_buffer_age = true;
+    }
+    if (has_extension(extensions, "EGL_KHR_swap_buffers_with_damage")) {
+        swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    } else if (has_extension(extensions, "EGL_EXT_swap_buffers_with_damage")) {
+        swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+    }
+    fprintf(stderr, "buffer age: %s, partial update: %s, swap with damage: %s\n",
+            has_buffer_age ? "yes" : "no", set_damage_region ? "yes" : "no",
+            swap_buffers_with_damage ? "yes" : "no");
 }
 
 static void
 create_window() {
-    egl_window = wl_egl_window_create(surface, 480, 360);
+    egl_window = wl_egl_window_create(surface, width, height);
     if (egl_window == NULL) { // 修正: wl_egl_window 失败应判断 NULL，而不是 EGL_NO_SURFACE
         fprintf(stderr, "Can't create egl window\n");
         exit(1);
@@ -110,22 +295,25 @@ create_window() {
         fprintf(stderr, "Made current failed\n");
     }
 
-    // 取消了注释：在 Wayland 下如果不渲染内容直接交换缓冲区，可能导致窗口不更新或者花屏
-    glClearColor(1.0, 1.0, 0.0, 1.0); // 黄色背景
-    glClear(GL_COLOR_BUFFER_BIT);
-    glFlush();
-
-    if (eglSwapBuffers(egl_display, egl_surface)) {
-        fprintf(stderr, "Swapped buffers\n");
-    } else {
-        fprintf(stderr, "Swapped buffers failed\n");
-    }
+    // 默认的 swap interval 1 会让 eglSwapBuffers 在内部等帧回调，
+    // 和我们自己的帧回调叠在一起就会多等一帧
+    eglSwapInterval(egl_display, 0);
+    init_extensions();
+    glViewport(0, 0, width, height);
+
+    // 第一帧立即画出来，之后由帧回调驱动
+    damage_tracker_init(&damage, width, height);
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    frame_scheduler_init(&frames, surface, draw_frame, NULL);
+    frame_scheduler_schedule(&frames);
 }
 
-static void
-init_egl() {
-    EGLint major, minor, count, n, size;
+/* 旧的做法：枚举全部配置、逐个打印，拿第一个。只留给 EGL_CONFIG_BENCH 做对比 */
+static EGLConfig
+choose_config_enumerate() {
+    EGLint count, n, size;
     EGLConfig *configs;
+    EGLConfig conf = NULL;
     int i;
     EGLint config_attribs[] = {
         EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
@@ -136,11 +324,75 @@ init_egl() {
         EGL_NONE
     };
 
+    eglGetConfigs(egl_display, NULL, 0, &count);
+    printf("EGL has %d configs\n", count);
+
+    configs = calloc(count, sizeof *configs);
+    eglChooseConfig(egl_display, config_attribs, configs, count, &n);
+    for (i = 0; i < n; i++) {
+        eglGetConfigAttrib(egl_display, configs[i], EGL_BUFFER_SIZE, &size);
+        printf("Buffer size for config %d is %d\n", i, size);
+        eglGetConfigAttrib(egl_display, configs[i], EGL_RED_SIZE, &size);
+        printf("Red size for config %d is %d\n", i, size);
+        conf = configs[i];
+        break;
+    }
+    free(configs);
+    return conf;
+}
+
+static double
+elapsed_us(const struct timespec *from) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - from->tv_sec) * 1e6 + (now.tv_nsec - from->tv_nsec) / 1e3;
+}
+
+/* EGL_CONFIG_BENCH=N：三种选配置的方式各跑 N 次，输出平均耗时后退出 */
+static void
+bench_config_choice(const struct egl_config_request *request, int runs) {
+    struct timespec start;
+    double enumerate_us, score_us, cached_us;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < runs; i++) {
+        choose_config_enumerate();
+    }
+    enumerate_us = elapsed_us(&start) / runs;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < runs; i++) {
+        egl_config_choose(egl_display, request);
+    }
+    score_us = elapsed_us(&start) / runs;
+
+    egl_config_choose_cached(egl_display, request); // 确保缓存已写入
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < runs; i++) {
+        egl_config_choose_cached(egl_display, request);
+    }
+    cached_us = elapsed_us(&start) / runs;
+
+    fprintf(stderr, "config choice over %d runs: enumerate %.1f us, score %.1f us, cached %.1f us\n",
+            runs, enumerate_us, score_us, cached_us);
+    exit(0);
+}
+
+static void
+init_egl() {
+    EGLint major, minor, id;
+
     static const EGLint context_attribs[] = {
         EGL_CONTEXT_CLIENT_VERSION, 2,
         EGL_NONE
     };
 
+    /* 只清屏、不做深度测试，也不需要透明窗口：要 XRGB8888，不要深度、模板和多重采样 */
+    static const struct egl_config_request config_request = {
+        .alpha = false,
+    };
+
     egl_display = eglGetDisplay((EGLNativeDisplayType) display);
     if (egl_display == EGL_NO_DISPLAY) {
         fprintf(stderr, "Can't create egl display\n");
@@ -155,25 +407,22 @@ init_egl() {
     }
     printf("EGL major: %d, minor %d\n", major, minor);
 
-    eglGetConfigs(egl_display, NULL, 0, &count);
-    printf("EGL has %d configs\n", count);
+    const char *bench = getenv("EGL_CONFIG_BENCH");
+    if (bench && atoi(bench) > 0) {
+        bench_config_choice(&config_request, atoi(bench));
+    }
 
-    configs = calloc(count, sizeof *configs);
-    
-    eglChooseConfig(egl_display, config_attribs, configs, count, &n);
-    
-    for (i = 0; i < n; i++) {
-        eglGetConfigAttrib(egl_display, configs[i], EGL_BUFFER_SIZE, &size);
-        printf("Buffer size for config %d is %d\n", i, size);
-        eglGetConfigAttrib(egl_display, configs[i], EGL_RED_SIZE, &size);
-        printf("Red size for config %d is %d\n", i, size);
-        
-        egl_conf = configs[i];
-        break;
+    egl_conf = egl_config_choose_cached(egl_display, &config_request);
+    if (!egl_conf) {
+        fprintf(stderr, "No suitable EGL config\n");
+        exit(1);
     }
+    eglGetConfigAttrib(egl_display, egl_conf, EGL_CONFIG_ID, &id);
+    eglGetConfigAttrib(egl_display, egl_conf, EGL_ALPHA_SIZE, &egl_alpha_size);
+    printf("Chose EGL config %d (score %d)\n", id,
+           egl_config_score(egl_display, egl_conf, &config_request));
 
     egl_context = eglCreateContext(egl_display, egl_conf, EGL_NO_CONTEXT, context_attribs);
-    free(configs); // 释放之前申请的内存
 }
 
 static void
@@ -185,14 +434,15 @@ get_server_references(void) {
     }
     printf("connected to display\n");
 
-    struct wl_registry *registry = wl_display_get_registry(display);
-    wl_registry_add_listener(registry, &registry_listener, NULL);
+    registry = registry_create(display, registry_bindings,
+                               sizeof(registry_bindings) / sizeof(registry_bindings[0]),
+                               &globals);
 
-    wl_display_dispatch(display);
-    wl_display_roundtrip(display);
+    startup_roundtrip(&startup, display);
 
-    if (compositor == NULL || wm_base == NULL) {
-        fprintf(stderr, "Can't find compositor or xdg_wm_base\n");
+    const char *missing = registry_missing(registry);
+    if (missing) {
+        fprintf(stderr, "Can't find %s\n", missing);
         exit(1);
     } else {
         fprintf(stderr, "Found compositor and xdg_wm_base\n");
@@ -200,9 +450,10 @@ get_server_references(void) {
 }
 
 int main(int argc, char **argv) {
+    startup_begin(&startup);
     get_server_references();
 
-    surface = wl_compositor_create_surface(compositor);
+    surface = wl_compositor_create_surface(globals.compositor);
     if (surface == NULL) {
         fprintf(stderr, "Can't create surface\n");
         exit(1);
@@ -211,7 +462,7 @@ int main(int argc, char **argv) {
     }
 
     // --- XDG Shell 核心逻辑 ---
-    xdg_surface = xdg_wm_base_get_xdg_surface(wm_base, surface);
+    xdg_surface = xdg_wm_base_get_xdg_surface(globals.wm_base, surface);
     xdg_surface_add_listener(xdg_surface, &xdg_surface_listener, NULL);
 
     xdg_toplevel = xdg_surface_get_toplevel(xdg_surface);
@@ -220,11 +471,15 @@ int main(int argc, char **argv) {
 
     // 注意：xdg-shell 规定必须先发出一次 commit 以触发服务器发回 configure 事件
     // 只有收到并 Ack 了 configure 后，才能通过 EGL 渲染。
+    surface_region_init(&region, globals.compositor, surface);
     wl_surface_commit(surface);
-    wl_display_roundtrip(display);
+    wl_display_flush(display);
 
-    create_opaque_region();
+    // 初始化 EGL 与等待 configure 互不依赖，趁 configure 在路上先把 EGL 准备好
     init_egl();
+    while (!configured && wl_display_dispatch(display) != -1) {
+        // 等待第一次 configure
+    }
     create_window();
 
     while (wl_display_dispatch(display) != -1) {
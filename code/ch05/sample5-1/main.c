@@ -1,67 +1,41 @@
 #define _POSIX_C_SOURCE 200112L
-#include <errno.h>
-#include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <time.h>
 #include <unistd.h>
 #include <wayland-client.h>
+#include "damage.h"
+#include "frame_scheduler.h"
+#include "raster_pool.h"
+#include "registry.h"
+#include "shm_file.h"
 #include "xdg-shell-client-protocol.h"
 
-/* Shared memory support code */
-static void
-randname(char *buf)
-{
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    long r = ts.tv_nsec;
-    for (int i = 0; i < 6; ++i) {
-        buf[i] = 'A'+(r&15)+(r&16)*2;
-        r >>= 5;
-    }
-}
-
-static int
-create_shm_file(void)
-{
-    int retries = 100;
-    do {
-        char name[] = "/wl_shm-XXXXXX";
-        randname(name + sizeof(name) - 7);
-        --retries;
-        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-        if (fd >= 0) {
-            shm_unlink(name);
-            return fd;
-        }
-    } while (retries > 0 && errno == EEXIST);
-    return -1;
-}
-
-static int
-allocate_shm_file(size_t size)
-{
-    int fd = create_shm_file();
-    if (fd < 0)
-        return -1;
-    int ret;
-    do {
-        ret = ftruncate(fd, size);
-    } while (ret < 0 && errno == EINTR);
-    if (ret < 0) {
-        close(fd);
-        return -1;
-    }
-    return fd;
-}
-
 /* Wayland code */
+#define POOL_WIDTH 640
+#define POOL_HEIGHT 480
+#define POOL_SLOTS 3
+/* The checkerboard repeats every 16 pixels and its cells are 8 wide */
+#define CHECKER_CELL 8
+#define TILE_WIDTH (POOL_WIDTH + 2 * CHECKER_CELL)
+/* Dump frame timing every this many frames */
+#define STATS_INTERVAL 600
+
+struct pool_buffer {
+    struct wl_buffer *wl_buffer;
+    uint32_t *data;
+    bool busy;
+    /* Damage tracker frame this buffer was last committed in, 0 if never */
+    uint64_t frame;
+};
+
 struct client_state {
     /* Globals */
     struct wl_display *wl_display;
-    struct wl_registry *wl_registry;
+    struct registry *registry;
     struct wl_shm *wl_shm;
     struct wl_compositor *wl_compositor;
     struct xdg_wm_base *xdg_wm_base;
@@ -69,6 +43,22 @@ struct client_state {
     struct wl_surface *wl_surface;
     struct xdg_surface *xdg_surface;
     struct xdg_toplevel *xdg_toplevel;
+    /* Buffer pool */
+    struct wl_shm_pool *wl_shm_pool;
+    struct shm_file pool_file;
+    struct pool_buffer buffers[POOL_SLOTS];
+    /* Pre-rendered rows for both cell parities, two cells wider than
+     * the window so any scroll offset is a plain memcpy */
+    uint32_t *tile;
+    /* Threads that copy the tile rows into a buffer in parallel */
+    struct raster_pool *raster;
+    /* Scroll offset of the last committed frame, -1 before the first */
+    int drawn_offset;
+    /* What changed in each recent frame, so a buffer coming back from
+     * the compositor only has its stale parts redrawn */
+    struct damage_tracker damage;
+    /* Renders at most once per frame callback */
+    struct frame_scheduler frames;
     /* State */
     float offset;
     uint32_t last_frame;
@@ -78,54 +68,187 @@ static void
 wl_buffer_release(void *data, struct wl_buffer *wl_buffer)
 {
     /* Sent by the compositor when it's no longer using this buffer */
-    wl_buffer_destroy(wl_buffer);
+    struct pool_buffer *buffer = data;
+    buffer->busy = false;
 }
 
 static const struct wl_buffer_listener wl_buffer_listener = {
     .release = wl_buffer_release,
 };
 
-static struct wl_buffer *
-draw_frame(struct client_state *state)
+static int
+create_buffer_pool(struct client_state *state)
 {
-    const int width = 640, height = 480;
-    int stride = width * 4;
-    int size = stride * height;
+    /* One file, one mapping and one wl_shm_pool for every slot */
+    int stride = POOL_WIDTH * 4;
+    int size = stride * POOL_HEIGHT;
+    if (shm_file_create(&state->pool_file, (size_t)size * POOL_SLOTS,
+            SHM_FILE_DEFAULT) < 0) {
+        return -1;
+    }
 
-    int fd = allocate_shm_file(size);
-    if (fd == -1) {
-        return NULL;
+    state->wl_shm_pool = wl_shm_create_pool(state->wl_shm,
+            state->pool_file.fd, state->pool_file.size);
+
+    /* Carve the buffers out of the pool at fixed offsets */
+    for (int i = 0; i < POOL_SLOTS; ++i) {
+        struct pool_buffer *buffer = &state->buffers[i];
+        buffer->wl_buffer = wl_shm_pool_create_buffer(state->wl_shm_pool,
+                size * i, POOL_WIDTH, POOL_HEIGHT, stride,
+                WL_SHM_FORMAT_XRGB8888);
+        buffer->data = (uint32_t *)state->pool_file.data
+                + (size_t)i * POOL_WIDTH * POOL_HEIGHT;
+        buffer->busy = false;
+        wl_buffer_add_listener(buffer->wl_buffer, &wl_buffer_listener, buffer);
     }
+    return 0;
+}
 
-    uint32_t *data = mmap(NULL, size,
-            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (data == MAP_FAILED) {
-        close(fd);
-        return NULL;
+static void
+destroy_buffer_pool(struct client_state *state)
+{
+    for (int i = 0; i < POOL_SLOTS; ++i) {
+        if (state->buffers[i].wl_buffer) {
+            wl_buffer_destroy(state->buffers[i].wl_buffer);
+            state->buffers[i].wl_buffer = NULL;
+        }
     }
+    if (state->wl_shm_pool) {
+        wl_shm_pool_destroy(state->wl_shm_pool);
+        state->wl_shm_pool = NULL;
+    }
+    if (state->pool_file.data) {
+        shm_file_destroy(&state->pool_file);
+    }
+}
 
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->wl_shm, fd, size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0,
-            width, height, stride, WL_SHM_FORMAT_XRGB8888);
-    wl_shm_pool_destroy(pool);
-    close(fd);
+static struct pool_buffer *
+acquire_buffer(struct client_state *state)
+{
+    for (int i = 0; i < POOL_SLOTS; ++i) {
+        if (!state->buffers[i].busy) {
+            state->buffers[i].busy = true;
+            return &state->buffers[i];
+        }
+    }
+    /* Every slot is still held by the compositor */
+    return NULL;
+}
 
-    /* Draw checkerboxed background */
-    int offset = (int)state->offset % 8;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            if (((x + offset) + (y + offset) / 8 * 8) % 16 < 8)
-                data[y * width + x] = 0xFF666666;
+static int
+create_tile(struct client_state *state)
+{
+    state->tile = malloc(2 * TILE_WIDTH * sizeof(uint32_t));
+    if (state->tile == NULL) {
+        return -1;
+    }
+    for (int parity = 0; parity < 2; ++parity) {
+        uint32_t *row = state->tile + parity * TILE_WIDTH;
+        for (int x = 0; x < TILE_WIDTH; ++x) {
+            if ((x / CHECKER_CELL + parity) % 2 == 0)
+                row[x] = 0xFF666666;
             else
-                data[y * width + x] = 0xFFEEEEEE;
+                row[x] = 0xFFEEEEEE;
         }
     }
+    return 0;
+}
+
+struct scroll_job {
+    const uint32_t *tile;
+    int offset;
+};
+
+static void
+scroll_tile(void *data, uint32_t *pixels, int stride,
+        int x, int y0, int width, int height)
+{
+    /* Every row is one of the two tile rows, shifted left by the scroll
+     * offset */
+    const struct scroll_job *job = data;
+    for (int y = y0; y < y0 + height; ++y) {
+        int parity = (y + job->offset) / CHECKER_CELL % 2;
+        memcpy(&pixels[y * (stride / 4) + x],
+                job->tile + parity * TILE_WIDTH + job->offset + x,
+                width * sizeof(uint32_t));
+    }
+}
+
+static struct pool_buffer *
+draw_frame(struct client_state *state, int offset)
+{
+    struct pool_buffer *buffer = acquire_buffer(state);
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    /* Only repaint what changed since this buffer was last on screen */
+    struct damage_region repaint;
+    damage_tracker_repaint(&state->damage, buffer->frame, &repaint);
+
+    /* Draw checkerboxed background, split into tiles across the raster
+     * threads */
+    struct scroll_job job = { state->tile, offset };
+    for (int i = 0; i < repaint.count; ++i) {
+        const struct damage_rect *r = &repaint.rects[i];
+        raster_pool_run(state->raster, buffer->data, POOL_WIDTH * 4,
+                r->x, r->y, r->width, r->height, scroll_tile, &job);
+    }
 
-    munmap(data, size);
-    wl_buffer_add_listener(buffer, &wl_buffer_listener, NULL);
     return buffer;
 }
 
+static bool
+parity_changed(int i, int from, int to)
+{
+    return (i + from) / CHECKER_CELL % 2 != (i + to) / CHECKER_CELL % 2;
+}
+
+static void
+damage_scroll(struct damage_tracker *damage, int from, int to)
+{
+    if (from < 0) {
+        damage_tracker_add_all(damage);
+        return;
+    }
+
+    /* A pixel changes colour only if its column or its row changes cell
+     * parity, so damaging those columns and rows covers every change */
+    int start = -1;
+    for (int x = 0; x <= POOL_WIDTH; ++x) {
+        bool changed = x < POOL_WIDTH && parity_changed(x, from, to);
+        if (changed && start < 0) {
+            start = x;
+        } else if (!changed && start >= 0) {
+            damage_tracker_add(damage, start, 0, x - start, POOL_HEIGHT);
+            start = -1;
+        }
+    }
+    for (int y = 0; y <= POOL_HEIGHT; ++y) {
+        bool changed = y < POOL_HEIGHT && parity_changed(y, from, to);
+        if (changed && start < 0) {
+            start = y;
+        } else if (!changed && start >= 0) {
+            damage_tracker_add(damage, 0, start, POOL_WIDTH, y - start);
+            start = -1;
+        }
+    }
+}
+
+static void
+submit_frame(struct client_state *state, int offset)
+{
+    damage_scroll(&state->damage, state->drawn_offset, offset);
+
+    struct pool_buffer *buffer = draw_frame(state, offset);
+    if (buffer) {
+        wl_surface_attach(state->wl_surface, buffer->wl_buffer, 0, 0);
+        buffer->frame = damage_tracker_commit(&state->damage,
+                state->wl_surface);
+        state->drawn_offset = offset;
+    }
+}
+
 static void
 xdg_surface_configure(void *data,
         struct xdg_surface *xdg_surface, uint32_t serial)
@@ -133,9 +256,11 @@ xdg_surface_configure(void *data,
     struct client_state *state = data;
     xdg_surface_ack_configure(xdg_surface, serial);
 
-    struct wl_buffer *buffer = draw_frame(state);
-    wl_surface_attach(state->wl_surface, buffer, 0, 0);
-    wl_surface_commit(state->wl_surface);
+    /* The compositor may have dropped our contents, resend everything
+     * on the next frame */
+    damage_tracker_add_all(&state->damage);
+    state->drawn_offset = -1;
+    frame_scheduler_schedule(&state->frames);
 }
 
 static const struct xdg_surface_listener xdg_surface_listener = {
@@ -152,79 +277,67 @@ static const struct xdg_wm_base_listener xdg_wm_base_listener = {
     .ping = xdg_wm_base_ping,
 };
 
-static const struct wl_callback_listener wl_surface_frame_listener;
-
 static void
-wl_surface_frame_done(void *data, struct wl_callback *cb, uint32_t time)
+render_frame(void *data, uint32_t time)
 {
-    /* Destroy this callback */
-    wl_callback_destroy(cb);
-
-    /* Request another frame */
     struct client_state *state = data;
-    cb = wl_surface_frame(state->wl_surface);
-    wl_callback_add_listener(cb, &wl_surface_frame_listener, state);
 
-    /* Update scroll amount at 24 pixels per second */
-    if (state->last_frame != 0) {
+    /* Update scroll amount at 24 pixels per second. time is 0 when the
+     * scheduler was idle, which restarts the clock. */
+    if (state->last_frame != 0 && time != 0) {
         int elapsed = time - state->last_frame;
         state->offset += elapsed / 1000.0 * 24;
     }
-
-    /* Submit a frame for this event */
-    struct wl_buffer *buffer = draw_frame(state);
-    wl_surface_attach(state->wl_surface, buffer, 0, 0);
-    wl_surface_damage_buffer(state->wl_surface, 0, 0, INT32_MAX, INT32_MAX);
-    wl_surface_commit(state->wl_surface);
-
     state->last_frame = time;
-}
 
-static const struct wl_callback_listener wl_surface_frame_listener = {
-    .done = wl_surface_frame_done,
-};
+    /* The scroll never stops, so always ask for the next frame */
+    frame_scheduler_schedule(&state->frames);
 
-static void
-registry_global(void *data, struct wl_registry *wl_registry,
-        uint32_t name, const char *interface, uint32_t version)
-{
-    struct client_state *state = data;
-    if (strcmp(interface, wl_shm_interface.name) == 0) {
-        state->wl_shm = wl_registry_bind(
-                wl_registry, name, &wl_shm_interface, 1);
-    } else if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        state->wl_compositor = wl_registry_bind(
-                wl_registry, name, &wl_compositor_interface, 4);
-    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        state->xdg_wm_base = wl_registry_bind(
-                wl_registry, name, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(state->xdg_wm_base,
-                &xdg_wm_base_listener, state);
+    /* Submit a frame for this event, but only if the content actually
+     * moved. If every buffer is still busy we skip this frame. Either
+     * way we still commit so the next callback fires. */
+    int offset = (int)state->offset % CHECKER_CELL;
+    if (offset != state->drawn_offset) {
+        submit_frame(state, offset);
     }
-}
+    frame_scheduler_commit(&state->frames);
 
-static void
-registry_global_remove(void *data,
-        struct wl_registry *wl_registry, uint32_t name)
-{
-    /* This space deliberately left blank */
+    if (state->frames.stats.frames % STATS_INTERVAL == 0) {
+        frame_stats_print(&state->frames.stats, stderr);
+    }
 }
 
-static const struct wl_registry_listener wl_registry_listener = {
-    .global = registry_global,
-    .global_remove = registry_global_remove,
+/* Globals to bind: interface, min version, max version, slot, listener, required */
+static const struct registry_binding registry_bindings[] = {
+    { &wl_shm_interface, 1, 1, offsetof(struct client_state, wl_shm), NULL, true },
+    { &wl_compositor_interface, 1, 4, offsetof(struct client_state, wl_compositor), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct client_state, xdg_wm_base),
+      &xdg_wm_base_listener, true },
 };
 
 int
 main(int argc, char *argv[])
 {
     struct client_state state = { 0 };
+    state.drawn_offset = -1;
+    damage_tracker_init(&state.damage, POOL_WIDTH, POOL_HEIGHT);
     state.wl_display = wl_display_connect(NULL);
-    state.wl_registry = wl_display_get_registry(state.wl_display);
-    wl_registry_add_listener(state.wl_registry, &wl_registry_listener, &state);
+    state.registry = registry_create(state.wl_display, registry_bindings,
+            sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
     wl_display_roundtrip(state.wl_display);
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "Can't find %s\n", missing);
+        return 1;
+    }
+
+    if (create_buffer_pool(&state) == -1 || create_tile(&state) == -1) {
+        return 1;
+    }
+    state.raster = raster_pool_create(0);
 
     state.wl_surface = wl_compositor_create_surface(state.wl_compositor);
+    frame_scheduler_init(&state.frames, state.wl_surface, render_frame, &state);
     state.xdg_surface = xdg_wm_base_get_xdg_surface(
             state.xdg_wm_base, state.wl_surface);
     xdg_surface_add_listener(state.xdg_surface, &xdg_surface_listener, &state);
@@ -232,12 +345,14 @@ main(int argc, char *argv[])
     xdg_toplevel_set_title(state.xdg_toplevel, "Example client");
     wl_surface_commit(state.wl_surface);
 
-    struct wl_callback *cb = wl_surface_frame(state.wl_surface);
-    wl_callback_add_listener(cb, &wl_surface_frame_listener, &state);
-
     while (wl_display_dispatch(state.wl_display)) {
         /* This space deliberately left blank */
     }
 
+    frame_scheduler_finish(&state.frames);
+    destroy_buffer_pool(&state);
+    raster_pool_destroy(state.raster);
+    free(state.tile);
+    registry_destroy(state.registry);
     return 0;
 }
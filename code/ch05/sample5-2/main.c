@@ -3,35 +3,42 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <wayland-client.h>
 #include "xdg-shell-client-protocol.h"
+#include "pattern.h"
+#include "registry.h"
+#include "startup.h"
+#include "surface_region.h"
 #include <linux/input-event-codes.h>
 
 // 全局客户端状态
 struct client_state {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
     struct wl_shm *shm;
     struct xdg_wm_base *xdg_wm_base;
     struct wl_seat *seat;
     struct wl_pointer *pointer;
+    struct pattern_cache *patterns;
+    struct startup_timer startup;
 
     // 主窗口
     struct wl_surface *main_surface;
+    struct surface_region main_region;
     struct xdg_surface *main_xdg_surface;
     struct xdg_toplevel *main_toplevel;
-    struct wl_buffer *main_buffer;
 
     // 弹出菜单窗口
     struct wl_surface *popup_surface;
+    struct surface_region popup_region;
     struct xdg_surface *popup_xdg_surface;
     struct xdg_popup *popup;
-    struct wl_buffer *popup_buffer;
     struct wl_surface *pointer_surface;  // 记录当前鼠标指针所在的 surface
 
     // 鼠标坐标状态
@@ -39,29 +46,9 @@ struct client_state {
     bool running;
 };
 
-// --- 辅助函数：通过 Shared Memory (shm) 创建渲染 Buffer ---
-static struct wl_buffer *create_buffer(struct client_state *state, int width, int height, uint32_t color) {
-    int stride = width * 4;
-    int size = stride * height;
-    
-    int fd = memfd_create("shm_buffer", MFD_CLOEXEC);
-    ftruncate(fd, size);
-    
-    // 映射内存并填充颜色
-    uint32_t *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    for (int i = 0; i < width * height; i++) {
-        data[i] = color;
-    }
-    munmap(data, size);
-
-    // 将内存提交给 Wayland 合成器
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm, fd, size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
-    wl_shm_pool_destroy(pool);
-    close(fd);
-    
-    return buffer;
-}
+// --- 窗口内容：纯色图案，渲染结果由 pattern_cache 缓存，弹窗再次出现时直接复用 ---
+static const struct pattern main_pattern = { .kind = PATTERN_SOLID, .colors = { 0xFF336699 } };  // 蓝灰色
+static const struct pattern popup_pattern = { .kind = PATTERN_SOLID, .colors = { 0xFFDD5555 } }; // 红色
 
 static void destroy_popup(struct client_state *state) {
     if (state->popup) {
@@ -95,20 +82,26 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
 
     // 为主窗口贴图
     if (xdg_surface == state->main_xdg_surface) {
-        if (!state->main_buffer) {
-            state->main_buffer = create_buffer(state, 640, 480, 0xFF336699); // 蓝灰色
-        }
-        wl_surface_attach(state->main_surface, state->main_buffer, 0, 0);
+        uint32_t format = pattern_format(&main_pattern);
+        struct wl_buffer *buffer = pattern_cache_get(state->patterns, &main_pattern,
+                                                     640, 480, format);
+        wl_surface_attach(state->main_surface, buffer, 0, 0);
         wl_surface_damage(state->main_surface, 0, 0, 640, 480);
+        // 不透明的图案用没有 alpha 的格式，整个窗口不透明，合成器不必混合它下面的内容
+        surface_region_set_opaque(&state->main_region, 640, 480,
+                                  !shm_format_has_alpha(format), NULL);
+        startup_first_commit(&state->startup, state->main_surface);
         wl_surface_commit(state->main_surface);
     } 
     // 为弹出菜单贴图
     else if (xdg_surface == state->popup_xdg_surface) {
-        if (!state->popup_buffer) {
-            state->popup_buffer = create_buffer(state, 150, 200, 0xFFDD5555); // 红色
-        }
-        wl_surface_attach(state->popup_surface, state->popup_buffer, 0, 0);
+        uint32_t format = pattern_format(&popup_pattern);
+        struct wl_buffer *buffer = pattern_cache_get(state->patterns, &popup_pattern,
+                                                     150, 200, format);
+        wl_surface_attach(state->popup_surface, buffer, 0, 0);
         wl_surface_damage(state->popup_surface, 0, 0, 150, 200);
+        surface_region_set_opaque(&state->popup_region, 150, 200,
+                                  !shm_format_has_alpha(format), NULL);
         wl_surface_commit(state->popup_surface);
     }
 }
@@ -176,6 +169,7 @@ static void pointer_button(void *data, struct wl_pointer *pointer, uint32_t seri
 
             // 1. 创建 popup 表面
             state->popup_surface = wl_compositor_create_surface(state->compositor);
+            surface_region_init(&state->popup_region, state->compositor, state->popup_surface);
             state->popup_xdg_surface = xdg_wm_base_get_xdg_surface(state->xdg_wm_base, state->popup_surface);
             xdg_surface_add_listener(state->popup_xdg_surface, &xdg_surface_listener, state);
 
@@ -230,28 +224,30 @@ static void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32
 }
 static const struct xdg_wm_base_listener xdg_wm_base_listener = { .ping = xdg_wm_base_ping };
 
-static void registry_global(void *data, struct wl_registry *registry, uint32_t name, const char *interface, uint32_t version) {
+// 座位被拔掉（global_remove）时连同它的 pointer 一起销毁，之后出现的新座位会重新绑定
+static void seat_removed(void *data, void *proxy) {
     struct client_state *state = data;
-    // 强制使用 version 1 即可满足大部分基本需求
-    if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        state->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 1);
-    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
-        state->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
-    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        state->xdg_wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(state->xdg_wm_base, &xdg_wm_base_listener, state);
-    } else if (strcmp(interface, wl_seat_interface.name) == 0) {
-        state->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
-        wl_seat_add_listener(state->seat, &seat_listener, state);
+    if (state->pointer) {
+        wl_pointer_destroy(state->pointer);
+        state->pointer = NULL;
     }
+    wl_seat_destroy(proxy);
 }
-static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name) {}
-static const struct wl_registry_listener registry_listener = { .global = registry_global, .global_remove = registry_global_remove };
+
+// 全局对象绑定表：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct client_state, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct client_state, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct client_state, xdg_wm_base), &xdg_wm_base_listener, true },
+    { &wl_seat_interface, 1, 4, offsetof(struct client_state, seat), &seat_listener, true,
+      NULL, seat_removed },
+};
 
 
 int main() {
     struct client_state state = {0};
     state.running = true;
+    startup_begin(&state.startup);
 
     // 连接显示服务器
     state.display = wl_display_connect(NULL);
@@ -261,18 +257,22 @@ int main() {
     }
 
     // 注册并获取基础全局对象
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry, &registry_listener, &state);
-    wl_display_roundtrip(state.display); // 等待 globals
-    wl_display_roundtrip(state.display); // 等待 seat capabilities
-
-    if (!state.compositor || !state.shm || !state.xdg_wm_base || !state.seat) {
-        fprintf(stderr, "Missing required Wayland interfaces\n");
+    state.registry = registry_create(state.display, registry_bindings,
+                                     sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
+    // 启动阶段只同步这一次。seat 的 capabilities 不影响首帧，随后在事件循环里到达时再创建 pointer
+    startup_roundtrip(&state.startup, state.display); // 等待 globals
+
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "Missing required Wayland interface %s\n", missing);
         return 1;
     }
 
+    state.patterns = pattern_cache_create(state.shm);
+
     // 创建主窗口 (Toplevel)
     state.main_surface = wl_compositor_create_surface(state.compositor);
+    surface_region_init(&state.main_region, state.compositor, state.main_surface);
     state.main_xdg_surface = xdg_wm_base_get_xdg_surface(state.xdg_wm_base, state.main_surface);
     xdg_surface_add_listener(state.main_xdg_surface, &xdg_surface_listener, &state);
 
@@ -281,6 +281,10 @@ int main() {
     xdg_toplevel_set_title(state.main_toplevel, "Wayland Popup Demo");
 
     wl_surface_commit(state.main_surface); // 触发初次 configure
+    wl_display_flush(state.display);
+
+    // configure 在路上时先把主窗口的内容画进缓存，configure 到达后直接取用
+    pattern_cache_get(state.patterns, &main_pattern, 640, 480, pattern_format(&main_pattern));
 
     printf("Window created! Right-click anywhere inside the window to show the popup.\n");
 
@@ -294,19 +298,19 @@ int main() {
     if (state.popup_xdg_surface) xdg_surface_destroy(state.popup_xdg_surface);
     if (state.popup_surface) wl_surface_destroy(state.popup_surface);
 
-    if (state.main_buffer) wl_buffer_destroy(state.main_buffer);
-    if (state.popup_buffer) wl_buffer_destroy(state.popup_buffer);
+    startup_finish(&state.startup);
+    pattern_cache_destroy(state.patterns);
 
     xdg_toplevel_destroy(state.main_toplevel);
     xdg_surface_destroy(state.main_xdg_surface);
     wl_surface_destroy(state.main_surface);
 
     if (state.pointer) wl_pointer_destroy(state.pointer);
-    wl_seat_destroy(state.seat);
+    if (state.seat) wl_seat_destroy(state.seat);
     xdg_wm_base_destroy(state.xdg_wm_base);
     wl_shm_destroy(state.shm);
     wl_compositor_destroy(state.compositor);
-    wl_registry_destroy(state.registry);
+    registry_destroy(state.registry);
     wl_display_disconnect(state.display);
 
     return 0;
@@ -3,47 +3,45 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <wayland-client.h>
 #include "xdg-shell-client-protocol.h"
 #include "xdg-foreign-unstable-v2-client-protocol.h"
+#include "pattern.h"
+#include "registry.h"
+#include "surface_region.h"
 
 struct app_state {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
     struct wl_shm *shm;
+    struct pattern_cache *patterns;
     struct xdg_wm_base *wm_base;
     struct zxdg_importer_v2 *importer;
     
     struct wl_surface *surface;
+    struct surface_region region;
     struct xdg_surface *xdg_surface;
     struct xdg_toplevel *xdg_toplevel;
     bool wait_for_configure;
 };
 
-/* --- 极简的 SHM 颜色填充缓冲创建 (同 Parent) --- */
-static struct wl_buffer* create_shm_buffer(struct app_state *state, int width, int height, uint32_t color) {
-    int stride = width * 4;
-    int size = stride * height;
-    int fd = memfd_create("wayland-shm", 0);
-    ftruncate(fd, size);
-    uint32_t *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    for (int i = 0; i < width * height; i++) data[i] = color;
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm, fd, size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
-    wl_shm_pool_destroy(pool); munmap(data, size); close(fd);
-    return buffer;
-}
+/* --- 窗口内容：纯色图案，由 pattern_cache 渲染并缓存 --- */
+static const struct pattern window_pattern = { .kind = PATTERN_SOLID, .colors = { 0xFF888888 } }; // 灰色
 
 static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
     struct app_state *state = data;
     xdg_surface_ack_configure(xdg_surface, serial);
     if (state->wait_for_configure) {
-        struct wl_buffer *buffer = create_shm_buffer(state, 300, 200, 0xFF888888); // 灰色
+        uint32_t format = pattern_format(&window_pattern);
+        struct wl_buffer *buffer = pattern_cache_get(state->patterns, &window_pattern,
+                                                     300, 200, format);
         wl_surface_attach(state->surface, buffer, 0, 0);
+        surface_region_set_opaque(&state->region, 300, 200, !shm_format_has_alpha(format), NULL);
         wl_surface_commit(state->surface);
         state->wait_for_configure = false;
     }
@@ -68,18 +66,13 @@ static const struct zxdg_imported_v2_listener imported_listener = {
     .destroyed = handle_imported_destroyed
 };
 
-static void registry_global(void *data, struct wl_registry *registry, uint32_t name, const char *interface, uint32_t version) {
-    struct app_state *state = data;
-    if (strcmp(interface, wl_compositor_interface.name) == 0)
-        state->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 1);
-    else if (strcmp(interface, wl_shm_interface.name) == 0)
-        state->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
-    else if (strcmp(interface, xdg_wm_base_interface.name) == 0)
-        state->wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
-    else if (strcmp(interface, zxdg_importer_v2_interface.name) == 0)
-        state->importer = wl_registry_bind(registry, name, &zxdg_importer_v2_interface, 1);
-}
-static const struct wl_registry_listener registry_listener = { .global = registry_global };
+/* --- 全局对象绑定表：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需 --- */
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct app_state, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct app_state, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct app_state, wm_base), &wm_base_listener, true },
+    { &zxdg_importer_v2_interface, 1, 1, offsetof(struct app_state, importer), NULL, true },
+};
 
 int main(int argc, char **argv) {
     if (argc < 2) {
@@ -92,14 +85,20 @@ int main(int argc, char **argv) {
     state.wait_for_configure = true;
 
     state.display = wl_display_connect(NULL);
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry, &registry_listener, &state);
+    state.registry = registry_create(state.display, registry_bindings,
+                                     sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
     wl_display_roundtrip(state.display);
 
-    xdg_wm_base_add_listener(state.wm_base, &wm_base_listener, &state);
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "缺少必要的全局对象 %s\n", missing);
+        return -1;
+    }
+    state.patterns = pattern_cache_create(state.shm);
 
     // 1. 创建子窗口
     state.surface = wl_compositor_create_surface(state.compositor);
+    surface_region_init(&state.region, state.compositor, state.surface);
     state.xdg_surface = xdg_wm_base_get_xdg_surface(state.wm_base, state.surface);
     xdg_surface_add_listener(state.xdg_surface, &xdg_surface_listener, &state);
     state.xdg_toplevel = xdg_surface_get_toplevel(state.xdg_surface);
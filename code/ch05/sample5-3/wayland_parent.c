@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -10,17 +11,22 @@
 #include "xdg-shell-client-protocol.h"
 #include "xdg-foreign-unstable-v2-client-protocol.h"
 #include "xdg-decoration-unstable-v1-client-protocol.h"
+#include "pattern.h"
+#include "registry.h"
+#include "surface_region.h"
 
 struct app_state {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
     struct wl_shm *shm;
+    struct pattern_cache *patterns;
     struct xdg_wm_base *wm_base;
     struct zxdg_exporter_v2 *exporter;
     struct zxdg_decoration_manager_v1 *deco_manager;
     
     struct wl_surface *surface;
+    struct surface_region region;
     struct xdg_surface *xdg_surface;
     struct xdg_toplevel *xdg_toplevel;
     
@@ -29,24 +35,8 @@ struct app_state {
     bool running;
 };
 
-/* --- 极简的 SHM 颜色填充缓冲创建 --- */
-static struct wl_buffer* create_shm_buffer(struct app_state *state, int width, int height, uint32_t color) {
-    int stride = width * 4;
-    int size = stride * height;
-    int fd = memfd_create("wayland-shm", 0);
-    ftruncate(fd, size);
-    
-    uint32_t *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    for (int i = 0; i < width * height; i++) data[i] = color; // 填充纯色
-    
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm, fd, size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
-    
-    wl_shm_pool_destroy(pool);
-    munmap(data, size);
-    close(fd);
-    return buffer;
-}
+/* --- 窗口内容：纯色图案，由 pattern_cache 渲染并缓存 --- */
+static const struct pattern window_pattern = { .kind = PATTERN_SOLID, .colors = { 0xFFFFFFFF } }; // 白色
 
 static void toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height, struct wl_array *states) {
     // 即使我们不需要处理调整大小，Wayland 也要求提供 configure 回调函数，保持为空即可
@@ -71,8 +61,11 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
     
     // 收到混成器的配置请求后，附加缓冲区并提交以显示窗口
     if (state->wait_for_configure) {
-        struct wl_buffer *buffer = create_shm_buffer(state, 600, 400, 0xFFFFFFFF); // 白色
+        uint32_t format = pattern_format(&window_pattern);
+        struct wl_buffer *buffer = pattern_cache_get(state->patterns, &window_pattern,
+                                                     600, 400, format);
         wl_surface_attach(state->surface, buffer, 0, 0);
+        surface_region_set_opaque(&state->region, 600, 400, !shm_format_has_alpha(format), NULL);
         wl_surface_commit(state->surface);
         state->wait_for_configure = false;
     }
@@ -95,20 +88,14 @@ static void handle_exported_handle(void *data, struct zxdg_exported_v2 *exported
 static const struct zxdg_exported_v2_listener exported_listener = { .handle = handle_exported_handle };
 
 /* --- 全局注册表监听器 --- */
-static void registry_global(void *data, struct wl_registry *registry, uint32_t name, const char *interface, uint32_t version) {
-    struct app_state *state = data;
-    if (strcmp(interface, wl_compositor_interface.name) == 0)
-        state->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 1);
-    else if (strcmp(interface, wl_shm_interface.name) == 0)
-        state->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
-    else if (strcmp(interface, xdg_wm_base_interface.name) == 0)
-        state->wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
-    else if (strcmp(interface, zxdg_exporter_v2_interface.name) == 0)
-        state->exporter = wl_registry_bind(registry, name, &zxdg_exporter_v2_interface, 1);
-    else if (strcmp(interface, zxdg_decoration_manager_v1_interface.name) == 0)
-        state->deco_manager = wl_registry_bind(registry, name, &zxdg_decoration_manager_v1_interface, 1);
-}
-static const struct wl_registry_listener registry_listener = { .global = registry_global };
+/* --- 全局对象绑定表：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需 --- */
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct app_state, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct app_state, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct app_state, wm_base), &wm_base_listener, true },
+    { &zxdg_exporter_v2_interface, 1, 1, offsetof(struct app_state, exporter), NULL, true },
+    { &zxdg_decoration_manager_v1_interface, 1, 1, offsetof(struct app_state, deco_manager), NULL, false },
+};
 
 int main() {
     struct app_state state = {0};
@@ -116,14 +103,20 @@ int main() {
     state.running = true;
 
     state.display = wl_display_connect(NULL);
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry, &registry_listener, &state);
+    state.registry = registry_create(state.display, registry_bindings,
+                                     sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
     wl_display_roundtrip(state.display);
 
-    xdg_wm_base_add_listener(state.wm_base, &wm_base_listener, &state);
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "缺少必要的全局对象 %s\n", missing);
+        return -1;
+    }
+    state.patterns = pattern_cache_create(state.shm);
 
     // 1. 创建并映射父窗口
     state.surface = wl_compositor_create_surface(state.compositor);
+    surface_region_init(&state.region, state.compositor, state.surface);
     state.xdg_surface = xdg_wm_base_get_xdg_surface(state.wm_base, state.surface);
     xdg_surface_add_listener(state.xdg_surface, &xdg_surface_listener, &state);
     state.xdg_toplevel = xdg_surface_get_toplevel(state.xdg_surface);
@@ -158,6 +151,8 @@ int main() {
     xdg_toplevel_destroy(state.xdg_toplevel);
     xdg_surface_destroy(state.xdg_surface);
     wl_surface_destroy(state.surface);
+    pattern_cache_destroy(state.patterns);
+    registry_destroy(state.registry);
     wl_display_disconnect(state.display);
 
     return 0;
@@ -3,31 +3,44 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <wayland-client.h>
 #include <wayland-cursor.h>
 #include "xdg-shell-client-protocol.h"
+#include "cursor-shape-v1-client-protocol.h"
+#include "cursor.h"
+#include "pattern.h"
+#include "pointer_input.h"
+#include "registry.h"
+#include "surface_region.h"
+#include "startup.h"
 
 // ---------------------------------------------------------
 // 1. 全局状态与数据结构
 // ---------------------------------------------------------
 struct ClientState {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
     struct wl_shm *shm;
     struct xdg_wm_base *xdg_wm_base;
     struct wl_seat *seat;
     struct wl_pointer *pointer;
-    struct wl_surface *cursor_surface;
-    struct wl_cursor_image *cursor_image;
+    struct pointer_input pointer_input;
+    struct wp_cursor_shape_manager_v1 *cursor_shape_manager;
+    struct cursor_manager *cursors;
+    struct cursor_pointer *cursor;
+    struct pattern_cache *patterns;
+    struct startup_timer startup;
 };
 
 struct Window {
     struct ClientState *state;
     struct wl_surface *surface;
+    struct surface_region region;
     struct xdg_surface *xdg_surface;
     struct xdg_toplevel *xdg_toplevel;
     int width, height;
@@ -38,28 +51,13 @@ struct Window {
 // ---------------------------------------------------------
 // 2. 共享内存 (SHM) 绘图辅助函数
 // ---------------------------------------------------------
-static struct wl_buffer *create_shm_buffer(struct wl_shm *shm, int width, int height, uint32_t color) {
-    int stride = width * 4; // ARGB8888, 4 bytes per pixel
-    int size = stride * height;
-
-    // 创建一个匿名内存文件 (Linux 特有)
-    int fd = memfd_create("wayland-shm-buffer", MFD_CLOEXEC);
-    ftruncate(fd, size);
-
-    // 映射内存并填充颜色
-    uint32_t *pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    for (int i = 0; i < width * height; ++i) {
-        pixels[i] = color;
-    }
-    munmap(pixels, size);
-
-    // 将内存文件交给 Wayland Compositor
-    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
-    
-    wl_shm_pool_destroy(pool);
-    close(fd);
-    return buffer;
+// 纯色缓冲区交给 pattern_cache：同样颜色、同样尺寸的窗口共享同一个 wl_buffer，
+// 窗口重新映射时也不会重绘。format 返回 buffer 实际使用的格式
+static struct wl_buffer *get_color_buffer(struct ClientState *state, int width, int height,
+                                          uint32_t color, uint32_t *format) {
+    struct pattern solid = { .kind = PATTERN_SOLID, .colors = { color } };
+    *format = pattern_format(&solid);
+    return pattern_cache_get(state->patterns, &solid, width, height, *format);
 }
 
 // ---------------------------------------------------------
@@ -73,8 +71,14 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
 
     // 如果是第一次配置，分配内存、附加并提交（渲染画面）
     if (!win->is_configured) {
-        struct wl_buffer *buffer = create_shm_buffer(win->state->shm, win->width, win->height, win->color);
+        uint32_t format;
+        struct wl_buffer *buffer = get_color_buffer(win->state, win->width, win->height,
+                                                    win->color, &format);
         wl_surface_attach(win->surface, buffer, 0, 0);
+        // 不透明的颜色用 XRGB8888，没有 alpha，纯色窗口整块不透明
+        surface_region_set_opaque(&win->region, win->width, win->height,
+                                  !shm_format_has_alpha(format), NULL);
+        startup_first_commit(&win->state->startup, win->surface);
         wl_surface_commit(win->surface);
         win->is_configured = true;
         printf("Window is now displayed.\n");
@@ -95,33 +99,14 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 // ---------------------------------------------------------
 // 4. 鼠标指针处理
 // ---------------------------------------------------------
-static void pointer_enter(void *data, struct wl_pointer *pointer, uint32_t serial,
-                          struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y) {
+// 座位版本 5 起指针事件按 wl_pointer.frame 成组到达，由 pointer_input 聚合后每帧回调一次
+static void pointer_frame(void *data, const struct pointer_event *event) {
     struct ClientState *state = data;
-    wl_pointer_set_cursor(pointer, serial, state->cursor_surface,
-                          state->cursor_image->hotspot_x, state->cursor_image->hotspot_y);
+    if (event->mask & POINTER_EVENT_ENTER) {
+        cursor_pointer_set(state->cursor, event->enter_serial, "default");
+    }
 }
 
-static void pointer_leave(void *data, struct wl_pointer *pointer, uint32_t serial,
-                          struct wl_surface *surface) {}
-
-static void pointer_motion(void *data, struct wl_pointer *pointer, uint32_t time,
-                           wl_fixed_t x, wl_fixed_t y) {}
-
-static void pointer_button(void *data, struct wl_pointer *pointer, uint32_t serial,
-                           uint32_t time, uint32_t button, uint32_t state) {}
-
-static void pointer_axis(void *data, struct wl_pointer *pointer, uint32_t time,
-                         uint32_t axis, wl_fixed_t value) {}
-
-static const struct wl_pointer_listener pointer_listener = {
-    .enter = pointer_enter,
-    .leave = pointer_leave,
-    .motion = pointer_motion,
-    .button = pointer_button,
-    .axis = pointer_axis,
-};
-
 // ---------------------------------------------------------
 // 5. Seat 处理
 // ---------------------------------------------------------
@@ -129,7 +114,8 @@ static void seat_capabilities(void *data, struct wl_seat *seat, uint32_t caps) {
     struct ClientState *state = data;
     if ((caps & WL_SEAT_CAPABILITY_POINTER) && !state->pointer) {
         state->pointer = wl_seat_get_pointer(seat);
-        wl_pointer_add_listener(state->pointer, &pointer_listener, state);
+        state->cursor = cursor_pointer_create(state->cursors, state->pointer);
+        pointer_input_init(&state->pointer_input, state->pointer, pointer_frame, state);
     }
 }
 
@@ -148,21 +134,36 @@ static void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32
 }
 static const struct xdg_wm_base_listener xdg_wm_base_listener = { .ping = xdg_wm_base_ping };
 
-static void registry_handler(void *data, struct wl_registry *registry, uint32_t id, const char *interface, uint32_t version) {
+// 座位被移除时连同它的 pointer 一起销毁，之后出现的新座位会重新绑定
+static void seat_removed(void *data, void *proxy) {
     struct ClientState *state = data;
-    if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        state->compositor = wl_registry_bind(registry, id, &wl_compositor_interface, 4);
-    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
-        state->shm = wl_registry_bind(registry, id, &wl_shm_interface, 1);
-    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        state->xdg_wm_base = wl_registry_bind(registry, id, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(state->xdg_wm_base, &xdg_wm_base_listener, state);
-    } else if (strcmp(interface, wl_seat_interface.name) == 0) {
-        state->seat = wl_registry_bind(registry, id, &wl_seat_interface, 1);
-        wl_seat_add_listener(state->seat, &seat_listener, state);
+    if (state->pointer) {
+        cursor_pointer_destroy(state->cursor);
+        state->cursor = NULL;
+        wl_pointer_destroy(state->pointer);
+        state->pointer = NULL;
     }
+    wl_seat_destroy(proxy);
 }
-static const struct wl_registry_listener registry_listener = { .global = registry_handler };
+
+// 形状协议消失后，之后创建的光标退回到主题光标
+static void cursor_shape_manager_removed(void *data, void *proxy) {
+    struct ClientState *state = data;
+    if (state->cursors) cursor_manager_set_shape_manager(state->cursors, NULL);
+    wp_cursor_shape_manager_v1_destroy(proxy);
+}
+
+// 全局对象绑定表：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct ClientState, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct ClientState, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct ClientState, xdg_wm_base), &xdg_wm_base_listener, true },
+    { &wp_cursor_shape_manager_v1_interface, 1, 1, offsetof(struct ClientState, cursor_shape_manager), NULL, false,
+      NULL, cursor_shape_manager_removed },
+    // 版本 5 起有 wl_pointer.frame，版本 8 起滚轮使用 axis_value120，都由 pointer_input 处理
+    { &wl_seat_interface, 1, 8, offsetof(struct ClientState, seat), &seat_listener, true,
+      NULL, seat_removed },
+};
 
 // ---------------------------------------------------------
 // 7. 辅助函数：创建窗口
@@ -177,6 +178,7 @@ struct Window* create_window(struct ClientState *state, int width, int height, u
 
     // 1. 创建基础 wl_surface
     win->surface = wl_compositor_create_surface(state->compositor);
+    surface_region_init(&win->region, state->compositor, win->surface);
     
     // 2. 赋予 xdg_surface 角色
     win->xdg_surface = xdg_wm_base_get_xdg_surface(state->xdg_wm_base, win->surface);
@@ -197,6 +199,7 @@ struct Window* create_window(struct ClientState *state, int width, int height, u
 // ---------------------------------------------------------
 int main() {
     struct ClientState state = {0};
+    startup_begin(&state.startup);
 
     // 1. 连接 Wayland 显示服务器
     state.display = wl_display_connect(NULL);
@@ -206,28 +209,25 @@ int main() {
     }
 
     // 2. 获取全局对象
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry, &registry_listener, &state);
-    wl_display_roundtrip(state.display); // 等待所有全局对象绑定完毕
-    wl_display_roundtrip(state.display); // 等待 seat capabilities
-
-    if (!state.compositor || !state.shm || !state.xdg_wm_base || !state.seat) {
-        fprintf(stderr, "Missing required Wayland interfaces.\n");
+    state.registry = registry_create(state.display, registry_bindings,
+                                     sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
+    // 启动阶段只同步这一次。seat 的 capabilities 不影响首帧，随后在事件循环里到达时再创建 pointer
+    startup_roundtrip(&state.startup, state.display); // 等待所有全局对象绑定完毕
+
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "Missing required Wayland interface %s.\n", missing);
         return -1;
     }
+    state.patterns = pattern_cache_create(state.shm);
 
-    // 3. 初始化光标
-    struct wl_cursor_theme *cursor_theme = wl_cursor_theme_load(NULL, 24, state.shm);
-    struct wl_cursor *cursor = wl_cursor_theme_get_cursor(cursor_theme, "left_ptr");
-    state.cursor_image = cursor->images[0];
-    struct wl_buffer *cursor_buffer = wl_cursor_image_get_buffer(state.cursor_image);
-
-    state.cursor_surface = wl_compositor_create_surface(state.compositor);
-    wl_surface_attach(state.cursor_surface, cursor_buffer, 0, 0);
-    wl_surface_commit(state.cursor_surface);
-
-    // 4. 创建主窗口 (蓝色背景, 800x600)
+    // 3. 创建主窗口 (蓝色背景, 800x600)，先把初始 commit 发出去
     struct Window *main_window = create_window(&state, 800, 600, 0xFF0000FF, "Main Window");
+    wl_display_flush(state.display);
+
+    // 4. 光标：主题在指针第一次进入窗口时才加载，合成器支持形状协议时完全不加载
+    state.cursors = cursor_manager_create(state.compositor, state.shm, NULL, 0);
+    cursor_manager_set_shape_manager(state.cursors, state.cursor_shape_manager);
 
     // 5. 等待主窗口配置完成（显示出来）
     printf("Waiting for main window to be configured...\n");
@@ -252,10 +252,14 @@ int main() {
     }
 
     // 清理
-    wl_cursor_theme_destroy(cursor_theme);
-    wl_surface_destroy(state.cursor_surface);
+    startup_finish(&state.startup);
+    pattern_cache_destroy(state.patterns);
+    cursor_pointer_destroy(state.cursor);
+    cursor_manager_destroy(state.cursors);
     if (state.pointer) wl_pointer_destroy(state.pointer);
-    wl_seat_destroy(state.seat);
+    if (state.cursor_shape_manager) wp_cursor_shape_manager_v1_destroy(state.cursor_shape_manager);
+    if (state.seat) wl_seat_destroy(state.seat);
+    registry_destroy(state.registry);
     wl_display_disconnect(state.display);
     return 0;
 }
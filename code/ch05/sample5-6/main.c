@@ -3,49 +3,51 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <wayland-client.h>
 #include "xdg-shell-client-protocol.h"
 #include "xdg-activation-v1-client-protocol.h"
+#include "fill.h"
+#include "pattern.h"
+#include "registry.h"
+#include "surface_tree.h"
 
-// 简单的共享内存创建函数
-static int create_shm_file(off_t size) {
-    int fd = memfd_create("wl_shm_buffer", MFD_CLOEXEC);
-    if (fd < 0) return -1;
-    if (ftruncate(fd, size) < 0) {
-        close(fd);
-        return -1;
-    }
-    return fd;
-}
+#define BUTTON_SIZE 50
 
 struct Window {
-    struct wl_surface *surface;
+    // 根层的内容是 pattern_cache 里的静态背景，按钮等控件作为子层挂在上面
+    struct surface_layer *root;
+    struct surface_layer *button;   // 只有 Tool Window 有
+    struct wl_surface *surface;     // root->surface
     struct xdg_surface *xdg_surface;
     struct xdg_toplevel *xdg_toplevel;
     int width, height;
     uint32_t color;
     struct wl_buffer *buffer;
+    uint32_t format;                // buffer 的格式
 };
 
 struct AppState {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
+    struct wl_subcompositor *subcompositor;
     struct xdg_wm_base *xdg_wm_base;
     struct wl_shm *shm;
     struct wl_seat *seat;
     struct wl_pointer *pointer;
     struct xdg_activation_v1 *activation;
+    struct pattern_cache *patterns;
 
     struct Window *main_window;
     struct Window *tool_window;
 
     // 鼠标状态追踪
     struct wl_surface *pointer_surface;
-    int pointer_x, pointer_y;
+    bool button_hovered;
 };
 
 // --- XDG 激活回调 ---
@@ -63,54 +65,56 @@ static const struct xdg_activation_token_v1_listener activation_token_listener =
 };
 
 // --- 输入事件处理 (鼠标) ---
+// 按钮是单独的子表面，鼠标进出它就是悬停状态的变化；
+// 按钮层是非同步模式，悬停效果只重画、提交这 50x50 的一层，窗口背景完全不动
+static void update_button_hover(struct AppState *app) {
+    struct surface_layer *button = app->tool_window->button;
+    bool hovered = app->pointer_surface == button->surface;
+    if (hovered != app->button_hovered) {
+        app->button_hovered = hovered;
+        surface_layer_damage(button);
+        surface_layer_commit(button);
+    }
+}
+
 static void pointer_enter(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y) {
     struct AppState *app = data;
     app->pointer_surface = surface;
+    update_button_hover(app);
 }
 
 static void pointer_leave(void *data, struct wl_pointer *pointer, uint32_t serial, struct wl_surface *surface) {
     struct AppState *app = data;
     app->pointer_surface = NULL;
+    update_button_hover(app);
 }
 
-static void pointer_motion(void *data, struct wl_pointer *pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
-    struct AppState *app = data;
-    app->pointer_x = wl_fixed_to_int(surface_x);
-    app->pointer_y = wl_fixed_to_int(surface_y);
-}
+static void pointer_motion(void *data, struct wl_pointer *pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {}
 
 static void pointer_button(void *data, struct wl_pointer *pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
     struct AppState *app = data;
 
     // 当鼠标左键按下时 (BTN_LEFT = 272, WL_POINTER_BUTTON_STATE_PRESSED = 1)
     if (button == 272 && state == WL_POINTER_BUTTON_STATE_PRESSED) {
-        // 如果当前在 Tool Window 上
-        if (app->pointer_surface == app->tool_window->surface) {
-            // 检查是否点在了 "红色按钮" 区域内 (假设在坐标中心 50x50 的区域)
-            int bx = (app->tool_window->width - 50) / 2;
-            int by = (app->tool_window->height - 50) / 2;
-            
-            if (app->pointer_x >= bx && app->pointer_x <= bx + 50 &&
-                app->pointer_y >= by && app->pointer_y <= by + 50) {
-                
-                printf("点击了 Tool Window 的按钮！申请激活主窗口...\n");
-
-                if (!app->activation) {
-                    printf("混成器不支持 xdg_activation_v1 协议！\n");
-                    return;
-                }
-
-                // 1. 获取 token 对象
-                struct xdg_activation_token_v1 *token = xdg_activation_v1_get_activation_token(app->activation);
-                
-                // 2. 设置必要的触发信息 (关键所在：必须附带本次点击事件的 serial 和所在 seat)
-                xdg_activation_token_v1_set_serial(token, serial, app->seat);
-                xdg_activation_token_v1_set_surface(token, app->tool_window->surface);
-                
-                // 3. 监听 token 的回调并提交请求
-                xdg_activation_token_v1_add_listener(token, &activation_token_listener, app);
-                xdg_activation_token_v1_commit(token);
+        // 如果当前在 Tool Window 的红色按钮上（按钮有自己的表面，不用再算坐标）
+        if (app->pointer_surface == app->tool_window->button->surface) {
+            printf("点击了 Tool Window 的按钮！申请激活主窗口...\n");
+
+            if (!app->activation) {
+                printf("混成器不支持 xdg_activation_v1 协议！\n");
+                return;
             }
+
+            // 1. 获取 token 对象
+            struct xdg_activation_token_v1 *token = xdg_activation_v1_get_activation_token(app->activation);
+            
+            // 2. 设置必要的触发信息 (关键所在：必须附带本次点击事件的 serial 和所在 seat)
+            xdg_activation_token_v1_set_serial(token, serial, app->seat);
+            xdg_activation_token_v1_set_surface(token, app->tool_window->surface);
+            
+            // 3. 监听 token 的回调并提交请求
+            xdg_activation_token_v1_add_listener(token, &activation_token_listener, app);
+            xdg_activation_token_v1_commit(token);
         }
     }
 }
@@ -127,7 +131,7 @@ static const struct wl_pointer_listener pointer_listener = {
 
 static void seat_capabilities(void *data, struct wl_seat *seat, uint32_t capabilities) {
     struct AppState *app = data;
-    if (capabilities & WL_SEAT_CAPABILITY_POINTER) {
+    if ((capabilities & WL_SEAT_CAPABILITY_POINTER) && !app->pointer) {
         app->pointer = wl_seat_get_pointer(seat);
         wl_pointer_add_listener(app->pointer, &pointer_listener, app);
     }
@@ -142,40 +146,32 @@ static void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32
 static const struct xdg_wm_base_listener xdg_wm_base_listener = { .ping = xdg_wm_base_ping };
 
 // --- 窗口渲染与创建 ---
-static struct wl_buffer *create_buffer(struct wl_shm *shm, int width, int height, uint32_t bg_color, bool is_tool) {
-    int stride = width * 4;
-    int size = stride * height;
-    int fd = create_shm_file(size);
-    uint32_t *pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    
-    // 填充背景色
-    for (int i = 0; i < width * height; ++i) pixels[i] = bg_color;
-
-    // 如果是 Tool Window，我们在中间画一个 50x50 的红框作为“按钮”
-    if (is_tool) {
-        int bx = (width - 50) / 2;
-        int by = (height - 50) / 2;
-        for (int y = by; y < by + 50; y++) {
-            for (int x = bx; x < bx + 50; x++) {
-                pixels[y * width + x] = 0xFFFF0000; // 红色 AARRGGBB
-            }
-        }
-    }
+// 纯色背景，渲染结果由 pattern_cache 按 (图案, 尺寸) 缓存
+static struct wl_buffer *get_window_buffer(struct AppState *app, int width, int height,
+                                           uint32_t bg_color, uint32_t *format) {
+    struct pattern pattern = {
+        .kind = PATTERN_SOLID,
+        .colors = { bg_color },
+    };
+    *format = pattern_format(&pattern);
+    return pattern_cache_get(app->patterns, &pattern, width, height, *format);
+}
 
-    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
-    
-    wl_shm_pool_destroy(pool);
-    close(fd);
-    munmap(pixels, size);
-    return buffer;
+// Tool Window 中间的“按钮”，悬停时变亮
+static void draw_button(void *data, struct surface_layer *layer, uint32_t *pixels, int stride) {
+    struct AppState *app = data;
+    uint32_t color = app->button_hovered ? 0xFFFF6060 : 0xFFFF0000; // 红色 AARRGGBB
+    fill_solid(pixels, layer->width, layer->height, stride, color);
 }
 
 static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
     struct Window *win = data;
     xdg_surface_ack_configure(xdg_surface, serial);
+    // 子层（按钮）先画好，和背景在同一次根表面提交中出现
     wl_surface_attach(win->surface, win->buffer, 0, 0);
-    wl_surface_commit(win->surface);
+    surface_region_set_opaque(&win->root->region, win->width, win->height,
+                              !shm_format_has_alpha(win->format), NULL);
+    surface_layer_commit(win->root);
 }
 static const struct xdg_surface_listener xdg_surface_listener = { .configure = xdg_surface_configure };
 
@@ -186,8 +182,16 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = { .configure =
 static struct Window* create_window(struct AppState *app, int width, int height, uint32_t color, const char *title, bool is_tool) {
     struct Window *win = calloc(1, sizeof(struct Window));
     win->width = width; win->height = height; win->color = color;
-    win->buffer = create_buffer(app->shm, width, height, color, is_tool);
-    win->surface = wl_compositor_create_surface(app->compositor);
+    win->buffer = get_window_buffer(app, width, height, color, &win->format);
+    win->root = surface_layer_create(app->compositor, app->subcompositor, app->shm, NULL, NULL, NULL);
+    win->surface = win->root->surface;
+    if (is_tool) {
+        win->button = surface_layer_create(app->compositor, app->subcompositor, app->shm,
+                                           win->root, draw_button, app);
+        surface_layer_set_size(win->button, BUTTON_SIZE, BUTTON_SIZE);
+        surface_layer_set_position(win->button, (width - BUTTON_SIZE) / 2, (height - BUTTON_SIZE) / 2);
+        surface_layer_set_sync(win->button, false);
+    }
     win->xdg_surface = xdg_wm_base_get_xdg_surface(app->xdg_wm_base, win->surface);
     win->xdg_toplevel = xdg_surface_get_toplevel(win->xdg_surface);
 
@@ -199,40 +203,44 @@ static struct Window* create_window(struct AppState *app, int width, int height,
     return win;
 }
 
-// --- Registry 处理 ---
-static void registry_global(void *data, struct wl_registry *registry, uint32_t name, const char *interface, uint32_t version) {
+// --- 全局对象绑定 ---
+// 座位被移除时连同它的 pointer 一起销毁，之后出现的新座位会重新绑定
+static void seat_removed(void *data, void *proxy) {
     struct AppState *app = data;
-    if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        app->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 1);
-    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
-        app->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
-    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        app->xdg_wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(app->xdg_wm_base, &xdg_wm_base_listener, app);
-    } else if (strcmp(interface, wl_seat_interface.name) == 0) {
-        app->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
-        wl_seat_add_listener(app->seat, &seat_listener, app);
-    } else if (strcmp(interface, xdg_activation_v1_interface.name) == 0) {
-        // 绑定 xdg_activation_v1 协议
-        app->activation = wl_registry_bind(registry, name, &xdg_activation_v1_interface, 1);
+    if (app->pointer) {
+        wl_pointer_destroy(app->pointer);
+        app->pointer = NULL;
+        app->pointer_surface = NULL;
     }
+    wl_seat_destroy(proxy);
 }
-static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name) {}
-static const struct wl_registry_listener registry_listener = { .global = registry_global, .global_remove = registry_global_remove };
+
+// 接口、最低版本、支持的最高版本、保存位置、监听器、是否必需、热插拔回调
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct AppState, compositor), NULL, true },
+    { &wl_subcompositor_interface, 1, 1, offsetof(struct AppState, subcompositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct AppState, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct AppState, xdg_wm_base), &xdg_wm_base_listener, true },
+    { &wl_seat_interface, 1, 4, offsetof(struct AppState, seat), &seat_listener, false,
+      NULL, seat_removed },
+    { &xdg_activation_v1_interface, 1, 1, offsetof(struct AppState, activation), NULL, false },
+};
 
 int main(int argc, char **argv) {
     struct AppState app = {0};
     app.display = wl_display_connect(NULL);
     if (!app.display) return -1;
 
-    app.registry = wl_display_get_registry(app.display);
-    wl_registry_add_listener(app.registry, &registry_listener, &app);
+    app.registry = registry_create(app.display, registry_bindings,
+                                   sizeof(registry_bindings) / sizeof(registry_bindings[0]), &app);
     wl_display_roundtrip(app.display); // 等待 globals 绑定完成
 
-    if (!app.compositor || !app.shm || !app.xdg_wm_base) {
-        fprintf(stderr, "缺少必要的 Wayland 接口\n");
+    const char *missing = registry_missing(app.registry);
+    if (missing) {
+        fprintf(stderr, "缺少必要的 Wayland 接口 %s\n", missing);
         return -1;
     }
+    app.patterns = pattern_cache_create(app.shm);
 
     // 1. 创建 Main Window (绿色背景，主窗口)
     app.main_window = create_window(&app, 400, 300, 0xFF00FF00, "Main Window", false);
@@ -249,6 +257,8 @@ int main(int argc, char **argv) {
         // Wait for events
     }
 
+    pattern_cache_destroy(app.patterns);
+    registry_destroy(app.registry);
     wl_display_disconnect(app.display);
     return 0;
 }
@@ -19,23 +19,27 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <wayland-client.h>
 #include "xdg-shell-client-protocol.h"
 #include "viewporter-client-protocol.h"
+#include "pattern.h"
+#include "registry.h"
 
 // ---------------------------------------------------------
 // 全局状态
 // ---------------------------------------------------------
 struct ClientState {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
     struct wl_shm *shm;
     struct xdg_wm_base *xdg_wm_base;
     struct wp_viewporter *viewporter;
+    struct pattern_cache *patterns;
     bool running;
 };
 
@@ -50,53 +54,15 @@ struct Window {
 };
 
 // ---------------------------------------------------------
-// 共享内存绘图辅助函数
+// 图案：棋盘格方便观察裁剪效果，中心的红色方块作为参考点
 // ---------------------------------------------------------
-static struct wl_buffer *create_checkerboard_buffer(struct wl_shm *shm, int width, int height) {
-    int stride = width * 4;
-    int size = stride * height;
-
-    int fd = memfd_create("wayland-shm-buffer", MFD_CLOEXEC);
-    ftruncate(fd, size);
-
-    uint32_t *pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-
-    // 创建棋盘格图案，方便观察裁剪效果
-    int cell_size = 50;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int cell_x = x / cell_size;
-            int cell_y = y / cell_size;
-            // 棋盘格颜色：蓝色和黄色交替
-            if ((cell_x + cell_y) % 2 == 0) {
-                pixels[y * width + x] = 0xFF3366CC; // 蓝色
-            } else {
-                pixels[y * width + x] = 0xFFCCCC33; // 黄色
-            }
-        }
-    }
-
-    // 在中心画一个红色方块作为参考点
-    int center_x = width / 2;
-    int center_y = height / 2;
-    int rect_size = 80;
-    for (int y = center_y - rect_size/2; y < center_y + rect_size/2; ++y) {
-        for (int x = center_x - rect_size/2; x < center_x + rect_size/2; ++x) {
-            if (x >= 0 && x < width && y >= 0 && y < height) {
-                pixels[y * width + x] = 0xFFFF3333; // 红色
-            }
-        }
-    }
-
-    munmap(pixels, size);
-
-    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
-
-    wl_shm_pool_destroy(pool);
-    close(fd);
-    return buffer;
-}
+static const struct pattern checkerboard = {
+    .kind = PATTERN_CHECKERBOARD,
+    .cell = 50,
+    .colors = { 0xFF3366CC, 0xFFCCCC33 }, // 蓝色和黄色交替
+    .mark_size = 80,
+    .mark_color = 0xFFFF3333,             // 红色
+};
 
 // ---------------------------------------------------------
 // XDG 事件监听器
@@ -107,7 +73,8 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
 
     if (!win->is_configured) {
         // buffer 尺寸: 400x400 (棋盘格)
-        struct wl_buffer *buffer = create_checkerboard_buffer(win->state->shm, 400, 400);
+        struct wl_buffer *buffer = pattern_cache_get(win->state->patterns, &checkerboard,
+                                                     400, 400, WL_SHM_FORMAT_XRGB8888);
         wl_surface_attach(win->surface, buffer, 0, 0);
 
         // 使用 viewporter 进行裁剪和缩放
@@ -155,27 +122,13 @@ static void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32
 }
 static const struct xdg_wm_base_listener xdg_wm_base_listener = { .ping = xdg_wm_base_ping };
 
-static void registry_handler(void *data, struct wl_registry *registry, uint32_t id, const char *interface, uint32_t version) {
-    struct ClientState *state = data;
-
-    if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        state->compositor = wl_registry_bind(registry, id, &wl_compositor_interface, 4);
-    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
-        state->shm = wl_registry_bind(registry, id, &wl_shm_interface, 1);
-    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        state->xdg_wm_base = wl_registry_bind(registry, id, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(state->xdg_wm_base, &xdg_wm_base_listener, state);
-    } else if (strcmp(interface, wp_viewporter_interface.name) == 0) {
-        // 绑定 viewporter 全局对象
-        state->viewporter = wl_registry_bind(registry, id, &wp_viewporter_interface, 1);
-        printf("Found wp_viewporter\n");
-    }
-}
-
-static void registry_remover(void *data, struct wl_registry *registry, uint32_t id) {}
-static const struct wl_registry_listener registry_listener = {
-    .global = registry_handler,
-    .global_remove = registry_remover
+// 接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct ClientState, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct ClientState, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct ClientState, xdg_wm_base), &xdg_wm_base_listener, true },
+    // 这个样例就是演示 viewporter，没有它无法运行
+    { &wp_viewporter_interface, 1, 1, offsetof(struct ClientState, viewporter), NULL, true },
 };
 
 // ---------------------------------------------------------
@@ -193,16 +146,20 @@ int main() {
     }
 
     // 2. 获取全局对象
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry, &registry_listener, &state);
+    state.registry = registry_create(state.display, registry_bindings,
+                                     sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
     wl_display_roundtrip(state.display);
 
     // 3. 检查必要的协议支持
-    if (!state.viewporter) {
-        fprintf(stderr, "Compositor does not support wp_viewporter protocol.\n");
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "Compositor does not support %s.\n", missing);
         fprintf(stderr, "This demo requires a compositor with viewporter support.\n");
         return -1;
     }
+    printf("Found wp_viewporter\n");
+
+    state.patterns = pattern_cache_create(state.shm);
 
     // 4. 创建窗口
     struct Window *win = calloc(1, sizeof(struct Window));
@@ -244,11 +201,12 @@ int main() {
     wl_surface_destroy(win->surface);
     free(win);
 
+    pattern_cache_destroy(state.patterns);
     wp_viewporter_destroy(state.viewporter);
     xdg_wm_base_destroy(state.xdg_wm_base);
     wl_shm_destroy(state.shm);
     wl_compositor_destroy(state.compositor);
-    wl_registry_destroy(state.registry);
+    registry_destroy(state.registry);
     wl_display_disconnect(state.display);
 
     return 0;
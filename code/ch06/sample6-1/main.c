@@ -8,13 +8,17 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include "canvas.h"
+#include "registry.h"
+#include "shm_file.h"
+#include "startup.h"
 #include "xdg-shell-client-protocol.h"
 #include "treeland-dde-shell-client-protocol.h"
  
 // 用于管理我们所有Wayland对象和状态的结构体
 struct state {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
     struct wl_surface *surface;
     struct wl_shm *shm;
@@ -27,7 +31,11 @@ struct state {
     struct treeland_dde_shell_surface_v1 *dde_shell_surface;
  
     struct wl_buffer *buffer;
+    struct shm_file shm_file;
     void *shm_data;
+    struct canvas canvas;
+    struct canvas_label label;
+    struct startup_timer startup;
 
     int width, height;
     _Bool running;
@@ -36,39 +44,29 @@ struct state {
 // 绘制函数
 static void draw_frame(struct state *state) {
     int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, state->width);
-    int size = stride * state->height;
- 
-    // 清空缓冲区内存
-    memset(state->shm_data, 0, size);
- 
-    // 使用Cairo在共享内存上创建表面
-    cairo_surface_t *cairo_surface = cairo_image_surface_create_for_data(
-        state->shm_data, CAIRO_FORMAT_ARGB32, state->width, state->height, stride);
-    cairo_t *cr = cairo_create(cairo_surface);
- 
-    // 绘制背景 (淡蓝色)
+
+    // 画布跟随 shm 缓冲区复用，只在尺寸或映射地址变化时重建
+    cairo_t *cr = canvas_begin(&state->canvas, state->shm_data, state->width, state->height, stride);
+
+    // 绘制背景 (淡蓝色)：不透明的 SOURCE 绘制覆盖每个像素，无需先清空缓冲区
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
     cairo_set_source_rgba(cr, 0.8, 0.9, 1.0, 1.0);
     cairo_paint(cr);
- 
-    // 绘制文字
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+    // 绘制文字：字体、字形和文字尺寸在启动时已经算好
+    const struct canvas_label *label = &state->label;
     cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
-    cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-    cairo_set_font_size(cr, 40);
- 
-    cairo_text_extents_t extents;
-    cairo_text_extents(cr, "Hello World!", &extents);
-    cairo_move_to(cr, state->width/2.0 - extents.width/2.0, state->height/2.0);
-    cairo_show_text(cr, "Hello World!");
- 
-    // 清理Cairo资源
-    cairo_destroy(cr);
-    cairo_surface_destroy(cairo_surface);
+    canvas_label_draw(cr, label, state->width/2.0 - label->extents.width/2.0, state->height/2.0);
+
+    canvas_end(&state->canvas);
  
     // 将绘制好的缓冲区附加到表面
     wl_surface_attach(state->surface, state->buffer, 0, 0);
     // 告诉合成器表面的哪个区域被更新了 (这里是整个表面)
     wl_surface_damage_buffer(state->surface, 0, 0, state->width, state->height);
     // 提交更改，让合成器显示
+    startup_first_commit(&state->startup, state->surface);
     wl_surface_commit(state->surface);
 }
 
@@ -117,76 +115,44 @@ static const struct xdg_wm_base_listener xdg_wm_base_listener = {
     .ping = xdg_wm_base_handle_ping,
 };
 
-// --- wl_registry 事件监听器 ---
-static void registry_handle_global(void *data, struct wl_registry *registry, uint32_t name,
-                                   const char *interface, uint32_t version) {
-    struct state *state = data;
-    printf("Found global: %s (version %u)\n", interface, version);
- 
-    if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        state->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
-    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
-        state->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
-    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        state->xdg_wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(state->xdg_wm_base, &xdg_wm_base_listener, state);
-    } else if (strcmp(interface, treeland_dde_shell_manager_v1_interface.name) == 0) {
-        state->dde_shell_manager = wl_registry_bind(registry, name, &treeland_dde_shell_manager_v1_interface, 1);
-    }
-}
-
-static void registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name) {
-    // This space is for rent
-}
-
-static const struct wl_registry_listener registry_listener = {
-    .global = registry_handle_global,
-    .global_remove = registry_handle_global_remove,
+// --- 全局对象绑定表 ---
+// 列依次为：接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 4, 4, offsetof(struct state, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct state, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct state, xdg_wm_base), &xdg_wm_base_listener, true },
+    { &treeland_dde_shell_manager_v1_interface, 1, 1, offsetof(struct state, dde_shell_manager), NULL, true },
 };
 
 // 创建共享内存缓冲区
 static int create_shm_buffer(struct state *state) {
-    // 使用 memfd_create 创建一个匿名的、基于内存的文件
-    char tmp_name[] = "/tmp/wayland-shm-XXXXXX";
-    int fd = mkstemp(tmp_name);
-    if (fd < 0) {
-        fprintf(stderr, "mkstemp failed\n");
-        return -1;
-    }
-    // 立即删除文件名，文件描述符依然有效
-    unlink(tmp_name);
- 
     int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, state->width);
     int size = stride * state->height;
- 
-    if (ftruncate(fd, size) < 0) {
-        close(fd);
-        fprintf(stderr, "ftruncate failed\n");
-        return -1;
-    }
- 
-    // 将文件映射到内存
-    state->shm_data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (state->shm_data == MAP_FAILED) {
-        close(fd);
-        fprintf(stderr, "mmap failed\n");
+
+    // 使用封印的 memfd 作为后备内存，像素数据不会经过磁盘文件系统
+    if (shm_file_create(&state->shm_file, size, SHM_FILE_THP) < 0) {
         return -1;
     }
+    state->shm_data = state->shm_file.data;
  
     // 从文件描述符创建Wayland共享内存池
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm, fd, size);
+    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm, state->shm_file.fd, size);
     state->buffer = wl_shm_pool_create_buffer(pool, 0, state->width, state->height, stride, WL_SHM_FORMAT_ARGB8888);
     
     wl_shm_pool_destroy(pool);
-    close(fd);
     return 0;
 }
 
 int main(int argc, char **argv) {
     struct state state = {0};
+    startup_begin(&state.startup);
     state.width = 600;
     state.height = 400;
     state.running = 1;
+
+    // 静态文字只排版一次，之后每帧直接绘制缓存的字形
+    canvas_label_init(&state.label, "sans-serif", CAIRO_FONT_SLANT_NORMAL,
+                      CAIRO_FONT_WEIGHT_BOLD, 40, "Hello World!");
  
     // 1. 连接到Wayland display
     state.display = wl_display_connect(NULL);
@@ -196,16 +162,18 @@ int main(int argc, char **argv) {
     }
  
     // 2. 获取registry，用于发现全局对象
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry, &registry_listener, &state);
+    state.registry = registry_create(state.display, registry_bindings,
+                                     sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
  
-    // 3. 同步，等待服务器处理我们的请求并发送全局对象事件
-    wl_display_dispatch(state.display);
-    wl_display_roundtrip(state.display);
+    // 3. 同步，等待服务器处理我们的请求并发送全局对象事件。
+    // 启动阶段只需要这一次 roundtrip：表面和窗口角色在下面一次性设置好，
+    // configure 到达后由监听器直接画出第一帧
+    startup_roundtrip(&state.startup, state.display);
  
     // 检查是否成功绑定了必要的全局对象
-    if (state.compositor == NULL || state.shm == NULL || state.xdg_wm_base == NULL || state.dde_shell_manager == NULL) {
-        fprintf(stderr, "Can't find compositor, shm, xdg_wm_base or dde_shell_manager\n");
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "Can't find %s\n", missing);
         return 1;
     }
  
@@ -246,14 +214,18 @@ int main(int argc, char **argv) {
     printf("Cleaning up...\n");
     if (state.dde_shell_manager) treeland_dde_shell_manager_v1_destroy(state.dde_shell_manager);
     if (state.dde_shell_surface) treeland_dde_shell_surface_v1_destroy(state.dde_shell_surface);
+    startup_finish(&state.startup);
+    canvas_finish(&state.canvas);
+    canvas_label_finish(&state.label);
     if (state.buffer) wl_buffer_destroy(state.buffer);
+    shm_file_destroy(&state.shm_file);
     if (state.xdg_toplevel) xdg_toplevel_destroy(state.xdg_toplevel);
     if (state.xdg_surface) xdg_surface_destroy(state.xdg_surface);
     if (state.surface) wl_surface_destroy(state.surface);
     if (state.xdg_wm_base) xdg_wm_base_destroy(state.xdg_wm_base);
     if (state.shm) wl_shm_destroy(state.shm);
     if (state.compositor) wl_compositor_destroy(state.compositor);
-    if (state.registry) wl_registry_destroy(state.registry);
+    registry_destroy(state.registry);
     if (state.display) wl_display_disconnect(state.display);
  
     return 0;
@@ -1,17 +1,27 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <wayland-client.h>
 #include <cairo/cairo.h>
-#include <poll.h>
+#include <signal.h>
 
+#include "event_loop.h"
+#include "registry.h"
+#include "shm_file.h"
+#include "startup.h"
 #include "xdg-shell-client-protocol.h"
 #include "xdg-decoration-client-protocol.h"
 #include "sni.h"
 
+// 托盘菜单项的 id
+#define MENU_ID_EXIT      1
+#define MENU_ID_QUIET     2
+#define MENU_ID_SEPARATOR 3
+
 // 状态结构体
 struct app_state {
     struct wl_display *display;
@@ -29,8 +39,13 @@ struct app_state {
     int width, height;
     int running;
     int visible;
+    int configured; // 当前这次显示是否已经收到 configure 并贴上了 buffer
+
+    struct startup_timer startup;
 
     cairo_surface_t *my_icon_surface;
+    sni_manager_t *sni;
+    bool quiet;     // 勿扰模式：托盘图标转为 Passive
 };
 
 // 前置声明
@@ -39,20 +54,17 @@ void window_show(struct app_state *app);
 
 // --- Cairo 绘图辅助 ---
 static struct wl_buffer* create_shm_buffer(struct app_state *app) {
-    char name[] = "/tmp/wayland-shm-XXXXXX";
-    int fd = mkstemp(name);
-    if (fd < 0) {
-        fprintf(stderr, "mkstemp failed\n");
-        return NULL;
-    }
-
-    unlink(name);
     int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, app->width);
     int size = stride * app->height;
-    ftruncate(fd, size);
 
-    unsigned char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    struct wl_shm_pool *pool = wl_shm_create_pool(app->shm, fd, size);
+    // 使用封印的 memfd 作为后备内存，像素数据不会经过磁盘文件系统
+    struct shm_file file;
+    if (shm_file_create(&file, size, SHM_FILE_DEFAULT) < 0) {
+        return NULL;
+    }
+
+    unsigned char *data = file.data;
+    struct wl_shm_pool *pool = wl_shm_create_pool(app->shm, file.fd, size);
     struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, app->width, app->height, stride, WL_SHM_FORMAT_ARGB8888);
     
     // 使用 Cairo 绘制纯色背景 (例如：天蓝色)
@@ -63,9 +75,8 @@ static struct wl_buffer* create_shm_buffer(struct app_state *app) {
     
     cairo_destroy(cr);
     cairo_surface_destroy(surface);
-    munmap(data, size);
     wl_shm_pool_destroy(pool);
-    close(fd);
+    shm_file_destroy(&file);
     return buffer;
 }
 
@@ -91,6 +102,14 @@ static void xdg_surface_handle_configure(void *data, struct xdg_surface *xdg_sur
     struct app_state *app = data;
     // 必须确认配置事件
     xdg_surface_ack_configure(xdg_surface, serial);
+
+    // 第一次 configure 到达时直接贴上 buffer，不必在提交后阻塞等待一次 roundtrip
+    if (!app->configured && app->buffer) {
+        wl_surface_attach(app->surface, app->buffer, 0, 0);
+        startup_first_commit(&app->startup, app->surface);
+        wl_surface_commit(app->surface);
+        app->configured = 1;
+    }
 }
 
 static const struct xdg_surface_listener xdg_surface_listener = {
@@ -98,26 +117,33 @@ static const struct xdg_surface_listener xdg_surface_listener = {
 };
 
 // --- 全局注册 ---
-static void registry_handle_global(void *data, struct wl_registry *reg, uint32_t id, const char *interface, uint32_t version) {
-    struct app_state *app = data;
-    if (strcmp(interface, wl_compositor_interface.name) == 0)
-        app->compositor = wl_registry_bind(reg, id, &wl_compositor_interface, 4);
-    else if (strcmp(interface, wl_shm_interface.name) == 0)
-        app->shm = wl_registry_bind(reg, id, &wl_shm_interface, 1);
-    else if (strcmp(interface, xdg_wm_base_interface.name) == 0)
-        app->wm_base = wl_registry_bind(reg, id, &xdg_wm_base_interface, 1);
-    else if (strcmp(interface, zxdg_decoration_manager_v1_interface.name) == 0)
-        app->deco_manager = wl_registry_bind(reg, id, &zxdg_decoration_manager_v1_interface, 1);
-}
+// 接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct app_state, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct app_state, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct app_state, wm_base), NULL, true },
+    { &zxdg_decoration_manager_v1_interface, 1, 1, offsetof(struct app_state, deco_manager), NULL, false },
+};
 
 void sni_menu_click(int id, void *user_data) {
     struct app_state *app = (struct app_state *)user_data;
     if (id == MENU_ID_EXIT) {
         printf("收到菜单指令：正在退出...\n");
         app->running = 0;
+    } else if (id == MENU_ID_QUIET) {
+        // 只改勾选状态，托盘收到的是这一项的属性增量，不会重新取整个菜单
+        app->quiet = !app->quiet;
+        sni_menu_set_toggle(app->sni, MENU_ID_QUIET, SNI_MENU_TOGGLE_CHECKMARK, app->quiet);
+        sni_manager_set_status(app->sni, app->quiet ? "Passive" : "Active");
     }
 }
 
+static void handle_signal(void *data, int signo) {
+    struct app_state *app = data;
+    printf("收到信号 %d，正在退出...\n", signo);
+    app->running = 0;
+}
+
 void sni_activate(void *user_data) {
     struct app_state *app = (struct app_state *)user_data;
     printf("托盘被点击，尝试恢复窗口...\n");
@@ -144,13 +170,10 @@ void window_show(struct app_state *app) {
             ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
     }
 
+    // 4. 提交初始状态，buffer 在 configure 回调里贴上
+    app->configured = 0;
     wl_surface_commit(app->surface);
-    wl_display_roundtrip(app->display);
 
-    // 4. 提交
-    wl_surface_attach(app->surface, app->buffer, 0, 0);
-    wl_surface_commit(app->surface);
-    
     app->visible = 1;
     printf("窗口已恢复显示\n");
 }
@@ -176,17 +199,25 @@ void window_hide(struct app_state *app) {
     wl_surface_commit(app->surface);
 
     app->visible = 0;
+    app->configured = 0;
     printf("窗口已隐藏到托盘\n");
 }
 
 int main() {
     struct app_state app = { .width = 400, .height = 300, .running = 1, .visible = 1 };
-    
+    startup_begin(&app.startup);
+
     app.display = wl_display_connect(NULL);
-    struct wl_registry *registry = wl_display_get_registry(app.display);
-    static const struct wl_registry_listener reg_listener = { .global = registry_handle_global };
-    wl_registry_add_listener(registry, &reg_listener, &app);
-    wl_display_roundtrip(app.display);
+    struct registry *registry = registry_create(app.display, registry_bindings,
+                                                sizeof(registry_bindings) / sizeof(registry_bindings[0]), &app);
+    // 启动阶段唯一的一次同步：之后的窗口设置一次性发出，configure 异步处理
+    startup_roundtrip(&app.startup, app.display);
+
+    const char *missing = registry_missing(registry);
+    if (missing) {
+        fprintf(stderr, "缺少必要的 Wayland 接口 %s\n", missing);
+        return 1;
+    }
 
     // 创建 Surface
     app.surface = wl_compositor_create_surface(app.compositor);
@@ -202,17 +233,23 @@ int main() {
     }
 
     wl_surface_commit(app.surface);
-    wl_display_roundtrip(app.display);
+    wl_display_flush(app.display);
 
-    // 渲染第一帧
+    // 在 configure 返回之前渲染第一帧，configure 回调里直接贴上；
+    // 下面的托盘初始化同样和这次往返重叠进行
     app.buffer = create_shm_buffer(&app);
-    wl_surface_attach(app.surface, app.buffer, 0, 0);
-    wl_surface_commit(app.surface);
 
     // 初始化 SNI 托盘
     sni_manager_t *sni = sni_manager_create("org.deepin.waylanddemo.tray", ""/*"utilities-terminal"*/);
     sni_manager_set_on_activate(sni, sni_activate, &app);
     sni_manager_set_on_menu_click(sni, sni_menu_click, &app);
+    app.sni = sni;
+
+    sni_menu_add_item(sni, 0, MENU_ID_QUIET, "勿扰模式");
+    sni_menu_set_toggle(sni, MENU_ID_QUIET, SNI_MENU_TOGGLE_CHECKMARK, false);
+    sni_menu_add_separator(sni, 0, MENU_ID_SEPARATOR);
+    sni_menu_add_item(sni, 0, MENU_ID_EXIT, "退出程序");
+    sni_menu_set_icon_name(sni, MENU_ID_EXIT, "application-exit");
 
     app.my_icon_surface = cairo_image_surface_create_from_png("demo_icon.png");
     if (cairo_surface_status(app.my_icon_surface) != CAIRO_STATUS_SUCCESS) {
@@ -225,38 +262,21 @@ int main() {
     }
     sni_manager_set_icon_pixmap(sni, app.my_icon_surface);
 
-    struct pollfd fds[1];
-    fds[0].fd = wl_display_get_fd(app.display);
-    fds[0].events = POLLIN;
+    // 事件循环：Wayland、D-Bus 和信号共用一个 epoll，没有事件时完全阻塞
+    struct event_loop *loop = event_loop_create();
+    if (!loop || !event_loop_add_wayland(loop, app.display)) {
+        fprintf(stderr, "Failed to create event loop\n");
+        return 1;
+    }
+    if (sni_manager_attach(sni, loop) < 0) {
+        fprintf(stderr, "托盘未接入事件循环，D-Bus 不可用\n");
+    }
+    event_loop_add_signal(loop, SIGINT, handle_signal, &app);
+    event_loop_add_signal(loop, SIGTERM, handle_signal, &app);
 
     // 主循环
-    while (app.running/* && wl_display_dispatch(app.display) != -1*/) {
-        // --- STEP 1: 准备读取 Wayland 事件 ---
-        // 这步非常关键，它告诉 Wayland 库我们要开始处理事件了
-        while (wl_display_prepare_read(app.display) != 0) {
-            wl_display_dispatch_pending(app.display);
-        }
-
-        // --- STEP 2: 发送所有挂起的 Wayland 请求 ---
-        wl_display_flush(app.display);
-
-        // --- STEP 3: 使用 poll 同时监控事件 ---
-        // 设置超时时间（例如 10 毫秒），这样 D-Bus 才有机会被处理
-        int ret = poll(fds, 1, 10);
-
-        if (ret > 0 && (fds[0].revents & POLLIN)) {
-            // 有 Wayland 数据可读
-            wl_display_read_events(app.display);
-        } else {
-            // 没有数据或超时，取消读取准备
-            wl_display_cancel_read(app.display);
-        }
-
-        // 分发处理 Wayland 事件
-        wl_display_dispatch_pending(app.display);
-
-        // --- STEP 4: 处理 D-Bus 消息 ---
-        sni_manager_dispatch(sni);
+    while (app.running && event_loop_dispatch(loop, -1) >= 0) {
+        // 事件处理都在各事件源的回调中完成
     }
 
     return 0;
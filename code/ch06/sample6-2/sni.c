@@ -1,6 +1,8 @@
 #include "sni.h"
 #include <dbus/dbus.h>
 #include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -8,15 +10,58 @@
 #include <arpa/inet.h> // 用于 htonl (将主机字节序转为网络大端字节序)
 #include <cairo/cairo.h>
 
+#include "event_loop_dbus.h"
+
 #define SNI_SERVICE   "org.wayland.demo.tray"
 #define SNI_PATH      "/StatusNotifierItem"
 #define SNI_INTERFACE "org.kde.StatusNotifierItem"
 
 #define SNI_MENU_PATH "/MenuBar"
+#define MENU_INTERFACE "com.canonical.dbusmenu"
+
+// 菜单项的属性。按 dbusmenu 的约定，取默认值的属性不发送
+enum menu_prop {
+    MENU_PROP_TYPE,
+    MENU_PROP_LABEL,
+    MENU_PROP_ENABLED,
+    MENU_PROP_ICON_NAME,
+    MENU_PROP_TOGGLE_TYPE,
+    MENU_PROP_TOGGLE_STATE,
+    MENU_PROP_CHILDREN_DISPLAY,
+    MENU_PROP_COUNT
+};
+
+#define MENU_PROP_BIT(prop) (1u << (prop))
+#define MENU_PROP_ALL       (MENU_PROP_BIT(MENU_PROP_COUNT) - 1)
+
+static const char *const menu_prop_names[MENU_PROP_COUNT] = {
+    [MENU_PROP_TYPE]             = "type",
+    [MENU_PROP_LABEL]            = "label",
+    [MENU_PROP_ENABLED]          = "enabled",
+    [MENU_PROP_ICON_NAME]        = "icon-name",
+    [MENU_PROP_TOGGLE_TYPE]      = "toggle-type",
+    [MENU_PROP_TOGGLE_STATE]     = "toggle-state",
+    [MENU_PROP_CHILDREN_DISPLAY] = "children-display",
+};
+
 // 菜单项结构
 struct menu_item {
     int id;
-    const char *label;
+    bool separator;
+    bool enabled;
+    char *label;
+    char *icon_name;
+    enum sni_menu_toggle toggle_type;
+    bool checked;
+
+    struct menu_item *parent;
+    struct menu_item *children;     // 按显示顺序
+    struct menu_item *next;
+
+    uint32_t changed;               // 还没有通知托盘的属性变化
+    // 以这一项为根、展开 layout_depth 层的 GetLayout 应答模板
+    DBusMessage *layout_reply;
+    int layout_depth;
 };
 
 static const char introspection_xml[] =
@@ -36,6 +81,11 @@ static const char introspection_xml[] =
         "      <arg direction='in' type='s'/>"
         "      <arg direction='out' type='a{sv}'/>"
         "    </method>"
+        "    <signal name='PropertiesChanged'>"
+        "      <arg type='s'/>"
+        "      <arg type='a{sv}'/>"
+        "      <arg type='as'/>"
+        "    </signal>"
         "  </interface>"
         "  <interface name='org.kde.StatusNotifierItem'>"
         "    <method name='Activate'>"
@@ -46,16 +96,66 @@ static const char introspection_xml[] =
         "    <property name='Id' type='s' access='read'/>"
         "    <property name='Status' type='s' access='read'/>"
         "    <property name='IconName' type='s' access='read'/>"
+        "    <property name='IconPixmap' type='a(iiay)' access='read'/>"
+        "    <property name='ToolTip' type='(sa(iiay)ss)' access='read'/>"
+        "    <property name='Menu' type='o' access='read'/>"
+        "    <signal name='NewIcon'/>"
+        "    <signal name='NewStatus'>"
+        "      <arg type='s'/>"
+        "    </signal>"
         "  </interface>"
         "</node>";
 
+// 转换好的一种尺寸的图标，argb 已经是 SNI 要求的字节顺序
+struct sni_pixmap {
+    int width;
+    int height;
+    uint32_t *argb;
+};
+
+#define SNI_MAX_PIXMAPS 8
+
+// 对外公开的属性，GetAll 和 PropertiesChanged 都按这个顺序输出
+enum sni_property {
+    SNI_PROP_CATEGORY,
+    SNI_PROP_ID,
+    SNI_PROP_STATUS,
+    SNI_PROP_ICON_NAME,
+    SNI_PROP_ICON_PIXMAP,
+    SNI_PROP_TOOL_TIP,
+    SNI_PROP_MENU,
+    SNI_PROP_COUNT
+};
+
+#define SNI_PROP_BIT(prop) (1u << (prop))
+#define SNI_PROP_ALL       (SNI_PROP_BIT(SNI_PROP_COUNT) - 1)
+
 struct sni_manager {
     DBusConnection *dbus_conn;
     char *id;
     char *icon_name;
     cairo_surface_t *icon_surface;
+    struct sni_pixmap pixmaps[SNI_MAX_PIXMAPS];
+    int n_pixmaps;
     char *status;
+
+    // 预先序列化好的应答：属性不变时直接复制消息体发出去，
+    // 属性变化时只作废受影响的那几项，下次查询再重建
+    DBusMessage *get_replies[SNI_PROP_COUNT];
+    DBusMessage *getall_reply;
     
+    // 菜单树，根节点 id 为 0；items 用来按 id 查找。
+    // 结构变化时 revision 递增，变化在下一次空闲时合并成信号发出
+    struct menu_item *menu_root;
+    struct menu_item **menu_items;
+    int n_menu_items;
+    int menu_items_cap;
+    uint32_t menu_revision;
+    bool menu_layout_dirty;
+    int menu_layout_parent;
+    bool menu_flush_pending;
+    struct event_loop *loop;
+
     // 回调相关
     sni_activate_callback on_activate;
     sni_menu_click_callback on_menu_click;
@@ -69,57 +169,316 @@ struct sni_manager {
         dbus_error_free(&err); \
     }
 
-// 将 Cairo 像素数据转换为 SNI 要求的 Big-Endian ARGB
-static void append_pixmap(DBusMessageIter *iter, cairo_surface_t *surface) {
+// 预先缩放出的图标尺寸，托盘按自己的面板大小挑最接近的一张，不用再缩放
+static const int pixmap_sizes[] = { 16, 22, 24, 32, 48, 64 };
+
+// 把一张 Cairo 图片转换为 SNI 要求的非预乘 ARGB32（网络大端字节序）。
+// size 是缩放后长边的像素数，0 表示原始尺寸
+static int convert_pixmap(struct sni_pixmap *pixmap, cairo_surface_t *surface, int size) {
     int width = cairo_image_surface_get_width(surface);
     int height = cairo_image_surface_get_height(surface);
+    int longest = width > height ? width : height;
+
+    // 不是原始尺寸的先用 Cairo 等比缩放到一张新的 ARGB32 图片上；
+    // 托盘按每项给出的宽高使用像素，非正方形的图标保持原来的宽高比
+    cairo_surface_t *scaled = NULL;
+    if (size > 0 && size != longest) {
+        double scale = (double)size / longest;
+        int scaled_width = (int)(width * scale + 0.5);
+        int scaled_height = (int)(height * scale + 0.5);
+        width = scaled_width > 0 ? scaled_width : 1;
+        height = scaled_height > 0 ? scaled_height : 1;
+
+        scaled = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+        cairo_t *cr = cairo_create(scaled);
+        cairo_scale(cr, scale, scale);
+        cairo_set_source_surface(cr, surface, 0, 0);
+        cairo_paint(cr);
+        cairo_destroy(cr);
+        surface = scaled;
+    }
+
+    cairo_surface_flush(surface);
     unsigned char *data = cairo_image_surface_get_data(surface);
     int stride = cairo_image_surface_get_stride(surface);
+    bool has_alpha = cairo_image_surface_get_format(surface) == CAIRO_FORMAT_ARGB32;
 
-    DBusMessageIter array_iter, struct_iter, byte_iter;
-    printf("append_pixmap: %d x %d\n", width, height);
-
-    // 1. 最外层数组 a(iiay)
-    dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(iiay)", &array_iter);
-    
-    // 2. 结构体 (iiay)
-    dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT, NULL, &struct_iter);
-    
-    // 写入宽和高
-    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT32, &width);
-    dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT32, &height);
+    pixmap->argb = malloc((size_t)width * height * 4);
+    if (!pixmap->argb) {
+        if (scaled) {
+            cairo_surface_destroy(scaled);
+        }
+        return -1;
+    }
+    pixmap->width = width;
+    pixmap->height = height;
 
-    // 3. 像素字节数组 ay
-    dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY, "y", &byte_iter);
-    
-    // 转换像素：Cairo (Native Endian) -> SNI (Big Endian ARGB)
+    uint32_t *out = pixmap->argb;
     for (int y = 0; y < height; y++) {
         uint32_t *row = (uint32_t *)(data + y * stride);
         for (int x = 0; x < width; x++) {
             uint32_t pixel = row[x];
-            uint8_t a, r, g, b;
+            uint32_t a = has_alpha ? pixel >> 24 : 0xFF;
+
+            // Cairo 的 ARGB32 是预乘 alpha 的，SNI 要的是直通 alpha
+            if (a != 0xFF && a != 0) {
+                uint32_t r = ((pixel >> 16) & 0xFF) * 255 / a;
+                uint32_t g = ((pixel >> 8) & 0xFF) * 255 / a;
+                uint32_t b = (pixel & 0xFF) * 255 / a;
+                pixel = (r << 16) | (g << 8) | b;
+            }
+            // 内存中按 A, R, G, B 的顺序排列
+            *out++ = htonl((a << 24) | (pixel & 0x00FFFFFF));
+        }
+    }
 
-            // Cairo ARGB32 提取 (处理宿主字节序)
-            // 注意：这里假设输入是 CAIRO_FORMAT_ARGB32
-            a = (pixel >> 24) & 0xFF;
-            r = (pixel >> 16) & 0xFF;
-            g = (pixel >> 8) & 0xFF;
-            b = (pixel >> 0) & 0xFF;
+    if (scaled) {
+        cairo_surface_destroy(scaled);
+    }
+    return 0;
+}
 
-            // 按 A, R, G, B 顺序写入字节流
-            dbus_message_iter_append_basic(&byte_iter, DBUS_TYPE_BYTE, &a);
-            dbus_message_iter_append_basic(&byte_iter, DBUS_TYPE_BYTE, &r);
-            dbus_message_iter_append_basic(&byte_iter, DBUS_TYPE_BYTE, &g);
-            dbus_message_iter_append_basic(&byte_iter, DBUS_TYPE_BYTE, &b);
+static void clear_pixmaps(sni_manager_t *sni) {
+    for (int i = 0; i < sni->n_pixmaps; i++) {
+        free(sni->pixmaps[i].argb);
+    }
+    sni->n_pixmaps = 0;
+}
+
+// 图标只在第一次被查询时转换，之后直接复用，直到换了新图标
+static void build_pixmaps(sni_manager_t *sni) {
+    cairo_surface_t *surface = sni->icon_surface;
+    if (sni->n_pixmaps > 0 || !surface || cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        return;
+    }
+
+    // 只向下缩放，放大交给托盘自己处理；原始尺寸总是保留
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int original = width > height ? width : height;
+    for (size_t i = 0; i < sizeof(pixmap_sizes) / sizeof(pixmap_sizes[0]); i++) {
+        if (pixmap_sizes[i] < original &&
+            convert_pixmap(&sni->pixmaps[sni->n_pixmaps], surface, pixmap_sizes[i]) == 0) {
+            sni->n_pixmaps++;
         }
     }
-    
-    dbus_message_iter_close_container(&struct_iter, &byte_iter);
-    dbus_message_iter_close_container(&array_iter, &struct_iter);
+    if (convert_pixmap(&sni->pixmaps[sni->n_pixmaps], surface, 0) == 0) {
+        sni->n_pixmaps++;
+    }
+    printf("IconPixmap 已缓存 %d 种尺寸，最大 %d x %d\n", sni->n_pixmaps, width, height);
+}
+
+// 写入 a(iiay)：每种尺寸一项，像素整块追加，不再逐字节调用 libdbus
+static void append_pixmap(DBusMessageIter *iter, sni_manager_t *sni) {
+    DBusMessageIter array_iter, struct_iter, byte_iter;
+
+    build_pixmaps(sni);
+
+    dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(iiay)", &array_iter);
+    for (int i = 0; i < sni->n_pixmaps; i++) {
+        struct sni_pixmap *pixmap = &sni->pixmaps[i];
+        const unsigned char *bytes = (const unsigned char *)pixmap->argb;
+        int len = pixmap->width * pixmap->height * 4;
+
+        dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT, NULL, &struct_iter);
+        dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT32, &pixmap->width);
+        dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT32, &pixmap->height);
+        dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY, "y", &byte_iter);
+        dbus_message_iter_append_fixed_array(&byte_iter, DBUS_TYPE_BYTE, &bytes, len);
+        dbus_message_iter_close_container(&struct_iter, &byte_iter);
+        dbus_message_iter_close_container(&array_iter, &struct_iter);
+    }
     dbus_message_iter_close_container(iter, &array_iter);
 }
 
-// --- D-Bus 属性回调：这里定义图标和状态 ---
+static void append_string(DBusMessageIter *iter, const char *value) {
+    dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &value);
+}
+
+static void append_category(DBusMessageIter *iter, sni_manager_t *sni) {
+    append_string(iter, "ApplicationStatus");
+}
+
+static void append_id(DBusMessageIter *iter, sni_manager_t *sni) {
+    append_string(iter, sni->id);
+}
+
+// 状态可以是 Active, Passive, NeedsAttention
+static void append_status(DBusMessageIter *iter, sni_manager_t *sni) {
+    append_string(iter, sni->status);
+}
+
+static void append_icon_name(DBusMessageIter *iter, sni_manager_t *sni) {
+    append_string(iter, sni->icon_name);
+}
+
+static void append_tool_tip(DBusMessageIter *iter, sni_manager_t *sni) {
+    DBusMessageIter struct_iter, array_iter;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL, &struct_iter);
+
+    append_string(&struct_iter, "applications-system");
+    /* empty icon pixmap array */
+    dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY, "(iiay)", &array_iter);
+    dbus_message_iter_close_container(&struct_iter, &array_iter);
+    append_string(&struct_iter, "Wayland Tray Demo");
+    append_string(&struct_iter, "Hello from pure C SNI demo");
+
+    dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+static void append_menu(DBusMessageIter *iter, sni_manager_t *sni) {
+    const char *menu_path = SNI_MENU_PATH;
+    dbus_message_iter_append_basic(iter, DBUS_TYPE_OBJECT_PATH, &menu_path);
+}
+
+static const struct {
+    const char *name;
+    const char *signature;
+    void (*append)(DBusMessageIter *iter, sni_manager_t *sni);
+} sni_properties[SNI_PROP_COUNT] = {
+    [SNI_PROP_CATEGORY]    = { "Category",   "s",            append_category },
+    [SNI_PROP_ID]          = { "Id",         "s",            append_id },
+    [SNI_PROP_STATUS]      = { "Status",     "s",            append_status },
+    [SNI_PROP_ICON_NAME]   = { "IconName",   "s",            append_icon_name },
+    [SNI_PROP_ICON_PIXMAP] = { "IconPixmap", "a(iiay)",      append_pixmap },
+    [SNI_PROP_TOOL_TIP]    = { "ToolTip",    "(sa(iiay)ss)", append_tool_tip },
+    [SNI_PROP_MENU]        = { "Menu",       "o",            append_menu },
+};
+
+static int find_property(const char *name) {
+    for (int i = 0; i < SNI_PROP_COUNT; i++) {
+        if (strcmp(sni_properties[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 写入一个属性值 v
+static void append_property(DBusMessageIter *iter, sni_manager_t *sni, int prop) {
+    DBusMessageIter variant;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, sni_properties[prop].signature, &variant);
+    sni_properties[prop].append(&variant, sni);
+    dbus_message_iter_close_container(iter, &variant);
+}
+
+// 写入 mask 选中的属性 a{sv}
+static void append_property_dict(DBusMessageIter *iter, sni_manager_t *sni, uint32_t mask) {
+    DBusMessageIter dict, entry;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+    for (int i = 0; i < SNI_PROP_COUNT; i++) {
+        if (!(mask & SNI_PROP_BIT(i))) {
+            continue;
+        }
+        dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+        append_string(&entry, sni_properties[i].name);
+        append_property(&entry, sni, i);
+        dbus_message_iter_close_container(&dict, &entry);
+    }
+    dbus_message_iter_close_container(iter, &dict);
+}
+
+// prop 为 -1 时生成 GetAll 的应答，否则生成单个属性的 Get 应答。
+// 应答还没有收件人和 reply serial，发送前由 send_cached_reply 复制后补上
+static DBusMessage *cached_reply(sni_manager_t *sni, int prop) {
+    DBusMessage **slot = prop < 0 ? &sni->getall_reply : &sni->get_replies[prop];
+    if (*slot) {
+        return *slot;
+    }
+
+    DBusMessage *reply = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+    if (!reply) {
+        return NULL;
+    }
+    DBusMessageIter iter;
+    dbus_message_iter_init_append(reply, &iter);
+    if (prop < 0) {
+        append_property_dict(&iter, sni, SNI_PROP_ALL);
+    } else {
+        append_property(&iter, sni, prop);
+    }
+    *slot = reply;
+    return reply;
+}
+
+// 复制缓存的消息只是拷贝已经编码好的字节，不会重新序列化属性
+static DBusHandlerResult send_cached_reply(DBusConnection *conn, DBusMessage *msg, DBusMessage *cached) {
+    DBusMessage *reply = cached ? dbus_message_copy(cached) : NULL;
+    if (!reply) {
+        return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+    dbus_message_set_no_reply(reply, TRUE);
+    dbus_message_set_reply_serial(reply, dbus_message_get_serial(msg));
+    const char *sender = dbus_message_get_sender(msg);
+    if (sender) {
+        dbus_message_set_destination(reply, sender);
+    }
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static DBusHandlerResult send_error(DBusConnection *conn, DBusMessage *msg,
+                                    const char *name, const char *text) {
+    DBusMessage *reply = dbus_message_new_error(msg, name, text);
+    if (!reply) {
+        return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+    dbus_connection_send(conn, reply, NULL);
+    dbus_message_unref(reply);
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static void send_signal(sni_manager_t *sni, DBusMessage *signal) {
+    if (signal) {
+        dbus_connection_send(sni->dbus_conn, signal, NULL);
+        dbus_message_unref(signal);
+    }
+}
+
+// 属性变化：作废相关的缓存，再通知托盘。NewIcon / NewStatus 是 SNI 规范里
+// 的信号，PropertiesChanged 直接带上新值，托盘收到后不用再回来查询
+static void properties_changed(sni_manager_t *sni, uint32_t mask) {
+    for (int i = 0; i < SNI_PROP_COUNT; i++) {
+        if ((mask & SNI_PROP_BIT(i)) && sni->get_replies[i]) {
+            dbus_message_unref(sni->get_replies[i]);
+            sni->get_replies[i] = NULL;
+        }
+    }
+    if (sni->getall_reply) {
+        dbus_message_unref(sni->getall_reply);
+        sni->getall_reply = NULL;
+    }
+
+    if (!sni->dbus_conn) {
+        return;
+    }
+    if (mask & (SNI_PROP_BIT(SNI_PROP_ICON_NAME) | SNI_PROP_BIT(SNI_PROP_ICON_PIXMAP))) {
+        send_signal(sni, dbus_message_new_signal(SNI_PATH, SNI_INTERFACE, "NewIcon"));
+    }
+    if (mask & SNI_PROP_BIT(SNI_PROP_STATUS)) {
+        DBusMessage *signal = dbus_message_new_signal(SNI_PATH, SNI_INTERFACE, "NewStatus");
+        if (signal) {
+            dbus_message_append_args(signal, DBUS_TYPE_STRING, &sni->status, DBUS_TYPE_INVALID);
+        }
+        send_signal(sni, signal);
+    }
+
+    DBusMessage *signal = dbus_message_new_signal(SNI_PATH, "org.freedesktop.DBus.Properties",
+                                                  "PropertiesChanged");
+    if (signal) {
+        DBusMessageIter iter, invalidated;
+        const char *iface = SNI_INTERFACE;
+        dbus_message_iter_init_append(signal, &iter);
+        dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &iface);
+        append_property_dict(&iter, sni, mask);
+        dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "s", &invalidated);
+        dbus_message_iter_close_container(&iter, &invalidated);
+    }
+    send_signal(sni, signal);
+}
+
+// --- D-Bus 属性回调：属性值见上面的属性表 ---
 static DBusHandlerResult sni_message_handler(DBusConnection *conn, DBusMessage *msg, void *data) {
     printf("D-Bus 消息到达\n");
     sni_manager_t *sni = (sni_manager_t *)data;
@@ -142,99 +501,32 @@ static DBusHandlerResult sni_message_handler(DBusConnection *conn, DBusMessage *
     // 1. 处理属性获取请求 (这是托盘获取图标的关键)
     if (dbus_message_is_method_call(msg, "org.freedesktop.DBus.Properties", "Get")) {
         const char *iface, *prop;
-        dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &iface, DBUS_TYPE_STRING, &prop, DBUS_TYPE_INVALID);
-
-        DBusMessage *reply = dbus_message_new_method_return(msg);
-        DBusMessageIter iter, variant;
-        dbus_message_iter_init_append(reply, &iter);
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &iface, DBUS_TYPE_STRING, &prop,
+                                   DBUS_TYPE_INVALID)) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.InvalidArgs", "Expected (ss)");
+        }
+        if (iface[0] != '\0' && strcmp(iface, SNI_INTERFACE) != 0) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.UnknownInterface", iface);
+        }
 
         printf("获取属性: %s\n", prop);
-        if (strcmp(prop, "IconPixmap") == 0) {
-            printf("获取IconPixmap属性\n");
-            dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, "a(iiay)", &variant);
-            append_pixmap(&variant, sni->icon_surface); // 调用转换函数
-            dbus_message_iter_close_container(&iter, &variant);
-        } else if (strcmp(prop, "IconName") == 0) {
-            printf("获取图标属性\n");
-            const char *icon_name = sni->icon_name;
-            dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, "s", &variant);
-            dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &icon_name);
-            dbus_message_iter_close_container(&iter, &variant);
-        } else if (strcmp(prop, "Status") == 0) {
-            // 状态可以是 Active, Passive, NeedsAttention
-            const char *status = "Active";
-            dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, "s", &variant);
-            dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &status);
-            dbus_message_iter_close_container(&iter, &variant);
-        } else if (strcmp(prop, "Id") == 0) {
-            const char *id = "MyWaylandApp";
-            dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, "s", &variant);
-            dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &id);
-            dbus_message_iter_close_container(&iter, &variant);
-        } else if (strcmp(prop, "Category") == 0) {
-            const char *cat = "ApplicationStatus";
-            dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, "s", &variant);
-            dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &cat);
-            dbus_message_iter_close_container(&iter, &variant);
-        } else if (strcmp(prop, "Menu") == 0) {
-            const char *menu_path = SNI_MENU_PATH;
-            dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, "o", &variant);
-            dbus_message_iter_append_basic(&variant, DBUS_TYPE_OBJECT_PATH, &menu_path);
-            dbus_message_iter_close_container(&iter, &variant);
-        } if (strcmp(prop, "ToolTip") == 0) {
-            dbus_message_iter_open_container(
-                &iter,
-                DBUS_TYPE_VARIANT,
-                "(sa(iiay)ss)",
-                &variant);
-
-            DBusMessageIter struct_iter;
-            dbus_message_iter_open_container(
-                &variant,
-                DBUS_TYPE_STRUCT,
-                NULL,
-                &struct_iter);
-
-            const char *icon_name = "applications-system";
-            const char *title = "Wayland Tray Demo";
-            const char *text = "Hello from pure C SNI demo";
-
-            dbus_message_iter_append_basic(
-                &struct_iter,
-                DBUS_TYPE_STRING,
-                &icon_name);
-            
-            /* empty icon pixmap array */
-            DBusMessageIter array_iter;
-            dbus_message_iter_open_container(
-                &struct_iter,
-                DBUS_TYPE_ARRAY,
-                "(iiay)",
-                &array_iter);
-            dbus_message_iter_close_container(&struct_iter, &array_iter);
-
-            dbus_message_iter_append_basic(
-                &struct_iter,
-                DBUS_TYPE_STRING,
-                &title);
-
-            dbus_message_iter_append_basic(
-                &struct_iter,
-                DBUS_TYPE_STRING,
-                &text);
-
-            dbus_message_iter_close_container(
-                &variant,
-                &struct_iter);
-
-            dbus_message_iter_close_container(
-                &iter,
-                &variant);
+        int index = find_property(prop);
+        if (index < 0) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.UnknownProperty", prop);
         }
+        return send_cached_reply(conn, msg, cached_reply(sni, index));
+    }
 
-        dbus_connection_send(conn, reply, NULL);
-        dbus_message_unref(reply);
-        return DBUS_HANDLER_RESULT_HANDLED;
+    // 一次取回全部属性，托盘不必为每个属性单独往返一次
+    if (dbus_message_is_method_call(msg, "org.freedesktop.DBus.Properties", "GetAll")) {
+        const char *iface;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &iface, DBUS_TYPE_INVALID)) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.InvalidArgs", "Expected (s)");
+        }
+        if (iface[0] != '\0' && strcmp(iface, SNI_INTERFACE) != 0) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.UnknownInterface", iface);
+        }
+        return send_cached_reply(conn, msg, cached_reply(sni, -1));
     }
 
     // 2. 处理点击托盘动作 (Activate 方法)
@@ -249,72 +541,464 @@ static DBusHandlerResult sni_message_handler(DBusConnection *conn, DBusMessage *
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-static DBusHandlerResult menu_handler(DBusConnection *conn, DBusMessage *msg, void *data) {
-    struct sni_manager *sni = (struct sni_manager *)data;
+static struct menu_item *find_menu_item(sni_manager_t *sni, int id) {
+    for (int i = 0; i < sni->n_menu_items; i++) {
+        if (sni->menu_items[i]->id == id) {
+            return sni->menu_items[i];
+        }
+    }
+    return NULL;
+}
 
-    // 1. 获取菜单布局 (GetLayout)
-    if (dbus_message_is_method_call(msg, "com.canonical.dbusmenu", "GetLayout")) {
-        DBusMessage *reply = dbus_message_new_method_return(msg);
-        DBusMessageIter iter, root_struct, props_array, dict_entry, variant, children_array;
+static bool menu_prop_is_default(const struct menu_item *item, int prop) {
+    switch (prop) {
+    case MENU_PROP_TYPE:
+        return !item->separator;
+    case MENU_PROP_LABEL:
+        return !item->label || !item->label[0];
+    case MENU_PROP_ENABLED:
+        return item->enabled;
+    case MENU_PROP_ICON_NAME:
+        return !item->icon_name || !item->icon_name[0];
+    case MENU_PROP_TOGGLE_TYPE:
+    case MENU_PROP_TOGGLE_STATE:
+        return item->toggle_type == SNI_MENU_TOGGLE_NONE;
+    case MENU_PROP_CHILDREN_DISPLAY:
+        return !item->children;
+    }
+    return true;
+}
 
-        uint32_t revision = 1;
-        dbus_message_iter_init_append(reply, &iter);
-        dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &revision);
+// 写入一个属性值 v，默认值也照常写出（GetProperty 需要）
+static void append_menu_prop(DBusMessageIter *iter, const struct menu_item *item, int prop) {
+    const char *str = "";
+    dbus_bool_t flag;
+    dbus_int32_t state;
+    int type = DBUS_TYPE_STRING;
+    const void *value = &str;
+
+    switch (prop) {
+    case MENU_PROP_TYPE:
+        str = item->separator ? "separator" : "standard";
+        break;
+    case MENU_PROP_LABEL:
+        str = item->label ? item->label : "";
+        break;
+    case MENU_PROP_ENABLED:
+        flag = item->enabled;
+        type = DBUS_TYPE_BOOLEAN;
+        value = &flag;
+        break;
+    case MENU_PROP_ICON_NAME:
+        str = item->icon_name ? item->icon_name : "";
+        break;
+    case MENU_PROP_TOGGLE_TYPE:
+        if (item->toggle_type == SNI_MENU_TOGGLE_CHECKMARK) {
+            str = "checkmark";
+        } else if (item->toggle_type == SNI_MENU_TOGGLE_RADIO) {
+            str = "radio";
+        }
+        break;
+    case MENU_PROP_TOGGLE_STATE:
+        state = item->toggle_type == SNI_MENU_TOGGLE_NONE ? -1 : item->checked;
+        type = DBUS_TYPE_INT32;
+        value = &state;
+        break;
+    case MENU_PROP_CHILDREN_DISPLAY:
+        str = item->children ? "submenu" : "";
+        break;
+    }
 
-        // 返回一个嵌套结构：(ia{sv}av) -> (ID, 属性, 子项)
-        dbus_message_iter_open_container(&iter, DBUS_TYPE_STRUCT, NULL, &root_struct);
+    char signature[2] = { (char)type, '\0' };
+    DBusMessageIter variant;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, signature, &variant);
+    dbus_message_iter_append_basic(&variant, type, value);
+    dbus_message_iter_close_container(iter, &variant);
+}
 
-        int id = 0; // 根节点 ID
-        dbus_message_iter_append_basic(&root_struct, DBUS_TYPE_INT32, &id);
+// 写入 mask 选中、且不是默认值的属性 a{sv}
+static void append_menu_props(DBusMessageIter *iter, const struct menu_item *item, uint32_t mask) {
+    DBusMessageIter dict, entry;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+    for (int i = 0; i < MENU_PROP_COUNT; i++) {
+        if (!(mask & MENU_PROP_BIT(i)) || menu_prop_is_default(item, i)) {
+            continue;
+        }
+        dbus_message_iter_open_container(&dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+        append_string(&entry, menu_prop_names[i]);
+        append_menu_prop(&entry, item, i);
+        dbus_message_iter_close_container(&dict, &entry);
+    }
+    dbus_message_iter_close_container(iter, &dict);
+}
+
+// 写入 (ia{sv}av)，depth 为 0 时不带子项，负数表示展开全部
+static void append_menu_layout(DBusMessageIter *iter, const struct menu_item *item,
+                               int depth, uint32_t mask) {
+    DBusMessageIter layout, children, child;
+    dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL, &layout);
+    dbus_message_iter_append_basic(&layout, DBUS_TYPE_INT32, &item->id);
+    append_menu_props(&layout, item, mask);
+
+    dbus_message_iter_open_container(&layout, DBUS_TYPE_ARRAY, "v", &children);
+    if (depth != 0) {
+        for (const struct menu_item *c = item->children; c; c = c->next) {
+            dbus_message_iter_open_container(&children, DBUS_TYPE_VARIANT, "(ia{sv}av)", &child);
+            append_menu_layout(&child, c, depth > 0 ? depth - 1 : depth, mask);
+            dbus_message_iter_close_container(&children, &child);
+        }
+    }
+    dbus_message_iter_close_container(&layout, &children);
+    dbus_message_iter_close_container(iter, &layout);
+}
+
+// GetLayout 的返回值 (u revision, (ia{sv}av) layout)
+static void append_layout_reply(DBusMessage *reply, sni_manager_t *sni, const struct menu_item *item,
+                                int depth, uint32_t mask) {
+    DBusMessageIter iter;
+    dbus_message_iter_init_append(reply, &iter);
+    dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &sni->menu_revision);
+    append_menu_layout(&iter, item, depth, mask);
+}
+
+// 完整属性的布局按子树缓存：托盘每次打开菜单都会重新查询，
+// 只要子树没变就直接复制编码好的消息
+static DBusMessage *cached_layout(sni_manager_t *sni, struct menu_item *item, int depth) {
+    if (item->layout_reply && item->layout_depth == depth) {
+        return item->layout_reply;
+    }
+    if (item->layout_reply) {
+        dbus_message_unref(item->layout_reply);
+        item->layout_reply = NULL;
+    }
+
+    DBusMessage *reply = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+    if (!reply) {
+        return NULL;
+    }
+    append_layout_reply(reply, sni, item, depth, MENU_PROP_ALL);
+    item->layout_reply = reply;
+    item->layout_depth = depth;
+    return reply;
+}
+
+// 一项的内容变了，包含它的所有子树缓存都要作废
+static void invalidate_layouts(struct menu_item *item) {
+    for (; item; item = item->parent) {
+        if (item->layout_reply) {
+            dbus_message_unref(item->layout_reply);
+            item->layout_reply = NULL;
+        }
+    }
+}
+
+static int find_menu_prop(const char *name) {
+    for (int i = 0; i < MENU_PROP_COUNT; i++) {
+        if (strcmp(menu_prop_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 把属性名列表转换为 mask，空列表表示全部属性，不认识的属性名忽略
+static uint32_t menu_prop_mask(char **names, int n_names) {
+    if (n_names == 0) {
+        return MENU_PROP_ALL;
+    }
+    uint32_t mask = 0;
+    for (int i = 0; i < n_names; i++) {
+        int prop = find_menu_prop(names[i]);
+        if (prop >= 0) {
+            mask |= MENU_PROP_BIT(prop);
+        }
+    }
+    return mask;
+}
+
+// 发出积攒的变化：结构变化发 LayoutUpdated，托盘会重新取那棵子树；
+// 属性变化发 ItemsPropertiesUpdated，只带变化了的属性，变回默认值的放在删除列表里
+static void menu_flush(void *data) {
+    sni_manager_t *sni = data;
+    sni->menu_flush_pending = false;
+    if (!sni->dbus_conn) {
+        return;
+    }
+
+    if (sni->menu_layout_dirty) {
+        DBusMessage *signal = dbus_message_new_signal(SNI_MENU_PATH, MENU_INTERFACE, "LayoutUpdated");
+        if (signal) {
+            dbus_message_append_args(signal, DBUS_TYPE_UINT32, &sni->menu_revision,
+                                      DBUS_TYPE_INT32, &sni->menu_layout_parent, DBUS_TYPE_INVALID);
+        }
+        send_signal(sni, signal);
+        sni->menu_layout_dirty = false;
+    }
+
+    uint32_t any = 0;
+    for (int i = 0; i < sni->n_menu_items; i++) {
+        any |= sni->menu_items[i]->changed;
+    }
+    if (!any) {
+        return;
+    }
+
+    DBusMessage *signal = dbus_message_new_signal(SNI_MENU_PATH, MENU_INTERFACE, "ItemsPropertiesUpdated");
+    if (signal) {
+        DBusMessageIter iter, updated, removed, entry, names;
+        dbus_message_iter_init_append(signal, &iter);
+
+        dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ia{sv})", &updated);
+        for (int i = 0; i < sni->n_menu_items; i++) {
+            struct menu_item *item = sni->menu_items[i];
+            uint32_t set = 0;
+            for (int prop = 0; prop < MENU_PROP_COUNT; prop++) {
+                if ((item->changed & MENU_PROP_BIT(prop)) && !menu_prop_is_default(item, prop)) {
+                    set |= MENU_PROP_BIT(prop);
+                }
+            }
+            if (set) {
+                dbus_message_iter_open_container(&updated, DBUS_TYPE_STRUCT, NULL, &entry);
+                dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &item->id);
+                append_menu_props(&entry, item, set);
+                dbus_message_iter_close_container(&updated, &entry);
+            }
+        }
+        dbus_message_iter_close_container(&iter, &updated);
+
+        dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ias)", &removed);
+        for (int i = 0; i < sni->n_menu_items; i++) {
+            struct menu_item *item = sni->menu_items[i];
+            uint32_t reset = 0;
+            for (int prop = 0; prop < MENU_PROP_COUNT; prop++) {
+                if ((item->changed & MENU_PROP_BIT(prop)) && menu_prop_is_default(item, prop)) {
+                    reset |= MENU_PROP_BIT(prop);
+                }
+            }
+            if (!reset) {
+                continue;
+            }
+            dbus_message_iter_open_container(&removed, DBUS_TYPE_STRUCT, NULL, &entry);
+            dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &item->id);
+            dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY, "s", &names);
+            for (int prop = 0; prop < MENU_PROP_COUNT; prop++) {
+                if (reset & MENU_PROP_BIT(prop)) {
+                    append_string(&names, menu_prop_names[prop]);
+                }
+            }
+            dbus_message_iter_close_container(&entry, &names);
+            dbus_message_iter_close_container(&removed, &entry);
+        }
+        dbus_message_iter_close_container(&iter, &removed);
+    }
+    send_signal(sni, signal);
+
+    for (int i = 0; i < sni->n_menu_items; i++) {
+        sni->menu_items[i]->changed = 0;
+    }
+}
 
-        // 根节点属性 (留空)
-        dbus_message_iter_open_container(&root_struct, DBUS_TYPE_ARRAY, "{sv}", &props_array);
-        dbus_message_iter_close_container(&root_struct, &props_array);
+// 同一轮事件里的多次修改合并成一组信号；还没接入事件循环时托盘也还没来查询，
+// 变化先攒着
+static void schedule_menu_flush(sni_manager_t *sni) {
+    if (sni->menu_flush_pending || !sni->loop) {
+        return;
+    }
+    if (event_loop_add_idle(sni->loop, menu_flush, sni)) {
+        sni->menu_flush_pending = true;
+    }
+}
 
-        // 子节点数组 (放我们的退出项)
-        dbus_message_iter_open_container(&root_struct, DBUS_TYPE_ARRAY, "v", &children_array);
+static void menu_props_changed(sni_manager_t *sni, struct menu_item *item, uint32_t mask) {
+    item->changed |= mask;
+    invalidate_layouts(item);
+    schedule_menu_flush(sni);
+}
+
+// 增删菜单项：revision 递增，所有布局缓存都带着旧的 revision，一起作废。
+// 一轮里有多处结构变化时让托盘从根重新取
+static void menu_layout_changed(sni_manager_t *sni, struct menu_item *parent) {
+    sni->menu_revision++;
+    for (int i = 0; i < sni->n_menu_items; i++) {
+        invalidate_layouts(sni->menu_items[i]);
+    }
+    if (!sni->menu_layout_dirty) {
+        sni->menu_layout_dirty = true;
+        sni->menu_layout_parent = parent->id;
+    } else if (sni->menu_layout_parent != parent->id) {
+        sni->menu_layout_parent = 0;
+    }
+    schedule_menu_flush(sni);
+}
+
+static struct menu_item *new_menu_item(sni_manager_t *sni, struct menu_item *parent, int id) {
+    if (sni->n_menu_items == sni->menu_items_cap) {
+        int cap = sni->menu_items_cap ? sni->menu_items_cap * 2 : 8;
+        struct menu_item **items = realloc(sni->menu_items, cap * sizeof(*items));
+        if (!items) {
+            return NULL;
+        }
+        sni->menu_items = items;
+        sni->menu_items_cap = cap;
+    }
+
+    struct menu_item *item = calloc(1, sizeof(struct menu_item));
+    if (!item) {
+        return NULL;
+    }
+    item->id = id;
+    item->enabled = true;
+    item->parent = parent;
+    sni->menu_items[sni->n_menu_items++] = item;
+
+    if (parent) {
+        struct menu_item **link = &parent->children;
+        while (*link) {
+            link = &(*link)->next;
+        }
+        *link = item;
+    }
+    return item;
+}
+
+// 释放一项及其子树，调用者负责把它从父项的链表上摘下来
+static void free_menu_item(sni_manager_t *sni, struct menu_item *item) {
+    while (item->children) {
+        struct menu_item *child = item->children;
+        item->children = child->next;
+        free_menu_item(sni, child);
+    }
+    for (int i = 0; i < sni->n_menu_items; i++) {
+        if (sni->menu_items[i] == item) {
+            sni->menu_items[i] = sni->menu_items[--sni->n_menu_items];
+            break;
+        }
+    }
+    if (item->layout_reply) {
+        dbus_message_unref(item->layout_reply);
+    }
+    free(item->label);
+    free(item->icon_name);
+    free(item);
+}
 
-        // --- 退出项开始 ---
-        DBusMessageIter child_variant, child_struct, child_props;
-        dbus_message_iter_open_container(&children_array, DBUS_TYPE_VARIANT, "(ia{sv}av)", &child_variant);
-        dbus_message_iter_open_container(&child_variant, DBUS_TYPE_STRUCT, NULL, &child_struct);
+static DBusHandlerResult menu_handler(DBusConnection *conn, DBusMessage *msg, void *data) {
+    struct sni_manager *sni = (struct sni_manager *)data;
 
-        int exit_id = MENU_ID_EXIT;
-        dbus_message_iter_append_basic(&child_struct, DBUS_TYPE_INT32, &exit_id);
+    // 1. 获取菜单布局 (GetLayout)：只返回 parentId 下展开 recursionDepth 层的子树
+    if (dbus_message_is_method_call(msg, MENU_INTERFACE, "GetLayout")) {
+        dbus_int32_t parent_id, depth;
+        char **names;
+        int n_names;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_INT32, &parent_id, DBUS_TYPE_INT32, &depth,
+                                   DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &names, &n_names,
+                                   DBUS_TYPE_INVALID)) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.InvalidArgs", "Expected (iias)");
+        }
+        uint32_t mask = menu_prop_mask(names, n_names);
+        dbus_free_string_array(names);
 
-        // 退出项属性 (Label = "退出")
-        dbus_message_iter_open_container(&child_struct, DBUS_TYPE_ARRAY, "{sv}", &child_props);
+        struct menu_item *item = find_menu_item(sni, parent_id);
+        if (!item) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.InvalidArgs", "Unknown menu item");
+        }
+        if (depth < 0) {
+            depth = -1;
+        }
+        if (mask == MENU_PROP_ALL) {
+            return send_cached_reply(conn, msg, cached_layout(sni, item, depth));
+        }
 
-        dbus_message_iter_open_container(&child_props, DBUS_TYPE_DICT_ENTRY, NULL, &dict_entry);
-        const char *label_key = "label";
-        dbus_message_iter_append_basic(&dict_entry, DBUS_TYPE_STRING, &label_key);
-        const char *label_val = "退出程序";
-        dbus_message_iter_open_container(&dict_entry, DBUS_TYPE_VARIANT, "s", &variant);
-        dbus_message_iter_append_basic(&variant, DBUS_TYPE_STRING, &label_val);
-        dbus_message_iter_close_container(&dict_entry, &variant);
-        dbus_message_iter_close_container(&child_props, &dict_entry);
+        // 只要部分属性的请求很少见，不缓存
+        DBusMessage *reply = dbus_message_new_method_return(msg);
+        if (!reply) {
+            return DBUS_HANDLER_RESULT_NEED_MEMORY;
+        }
+        append_layout_reply(reply, sni, item, depth, mask);
+        dbus_connection_send(conn, reply, NULL);
+        dbus_message_unref(reply);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
 
-        dbus_message_iter_close_container(&child_struct, &child_props);
+    // 2. 批量获取属性 (GetGroupProperties)，ids 为空表示全部菜单项
+    if (dbus_message_is_method_call(msg, MENU_INTERFACE, "GetGroupProperties")) {
+        dbus_int32_t *ids;
+        int n_ids;
+        char **names;
+        int n_names;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_ARRAY, DBUS_TYPE_INT32, &ids, &n_ids,
+                                   DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &names, &n_names,
+                                   DBUS_TYPE_INVALID)) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.InvalidArgs", "Expected (aias)");
+        }
+        uint32_t mask = menu_prop_mask(names, n_names);
+        dbus_free_string_array(names);
 
-        // 退出项没有子项
-        DBusMessageIter grandchild_array;
-        dbus_message_iter_open_container(&child_struct, DBUS_TYPE_ARRAY, "v", &grandchild_array);
-        dbus_message_iter_close_container(&child_struct, &grandchild_array);
+        DBusMessage *reply = dbus_message_new_method_return(msg);
+        if (!reply) {
+            return DBUS_HANDLER_RESULT_NEED_MEMORY;
+        }
+        DBusMessageIter iter, array, entry;
+        dbus_message_iter_init_append(reply, &iter);
+        dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(ia{sv})", &array);
+        int count = n_ids > 0 ? n_ids : sni->n_menu_items;
+        for (int i = 0; i < count; i++) {
+            struct menu_item *item = n_ids > 0 ? find_menu_item(sni, ids[i]) : sni->menu_items[i];
+            if (!item) {
+                continue;
+            }
+            dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry);
+            dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &item->id);
+            append_menu_props(&entry, item, mask);
+            dbus_message_iter_close_container(&array, &entry);
+        }
+        dbus_message_iter_close_container(&iter, &array);
+        dbus_connection_send(conn, reply, NULL);
+        dbus_message_unref(reply);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
 
-        dbus_message_iter_close_container(&child_variant, &child_struct);
-        dbus_message_iter_close_container(&children_array, &child_variant);
-        // --- 退出项结束 ---
+    // 3. 获取单个属性 (GetProperty)
+    if (dbus_message_is_method_call(msg, MENU_INTERFACE, "GetProperty")) {
+        dbus_int32_t id;
+        const char *name;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_INT32, &id, DBUS_TYPE_STRING, &name,
+                                   DBUS_TYPE_INVALID)) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.InvalidArgs", "Expected (is)");
+        }
+        struct menu_item *item = find_menu_item(sni, id);
+        int prop = find_menu_prop(name);
+        if (!item || prop < 0) {
+            return send_error(conn, msg, "org.freedesktop.DBus.Error.InvalidArgs", "Unknown menu item or property");
+        }
 
-        dbus_message_iter_close_container(&root_struct, &children_array);
-        dbus_message_iter_close_container(&iter, &root_struct);
+        DBusMessage *reply = dbus_message_new_method_return(msg);
+        if (!reply) {
+            return DBUS_HANDLER_RESULT_NEED_MEMORY;
+        }
+        DBusMessageIter iter;
+        dbus_message_iter_init_append(reply, &iter);
+        append_menu_prop(&iter, item, prop);
+        dbus_connection_send(conn, reply, NULL);
+        dbus_message_unref(reply);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
 
+    // 4. 菜单即将显示 (AboutToShow)：菜单树总是最新的，不需要托盘重新取布局
+    if (dbus_message_is_method_call(msg, MENU_INTERFACE, "AboutToShow")) {
+        DBusMessage *reply = dbus_message_new_method_return(msg);
+        if (!reply) {
+            return DBUS_HANDLER_RESULT_NEED_MEMORY;
+        }
+        dbus_bool_t need_update = FALSE;
+        dbus_message_append_args(reply, DBUS_TYPE_BOOLEAN, &need_update, DBUS_TYPE_INVALID);
         dbus_connection_send(conn, reply, NULL);
         dbus_message_unref(reply);
         return DBUS_HANDLER_RESULT_HANDLED;
     }
 
-    // 2. 处理点击事件 (Event)
-    if (dbus_message_is_method_call(msg, "com.canonical.dbusmenu", "Event")) {
+    // 5. 处理点击事件 (Event)
+    if (dbus_message_is_method_call(msg, MENU_INTERFACE, "Event")) {
         int id;
         const char *event_type;
         dbus_message_get_args(msg, NULL, DBUS_TYPE_INT32, &id, DBUS_TYPE_STRING, &event_type, DBUS_TYPE_INVALID);
@@ -341,6 +1025,8 @@ sni_manager_t* sni_manager_create(const char *appid, const char *icon_name)
     sni->id = strdup(appid);
     sni->icon_name = strdup(icon_name);
     sni->status = strdup("Active");
+    sni->menu_root = new_menu_item(sni, NULL, 0);
+    sni->menu_revision = 1;
 
     sni->dbus_conn = dbus_bus_get(DBUS_BUS_SESSION, &err);
     if (!sni->dbus_conn ||dbus_error_is_set(&err)) {
@@ -403,15 +1089,33 @@ sni_manager_t* sni_manager_create(const char *appid, const char *icon_name)
     return sni;
 }
 
-void sni_manager_dispatch(sni_manager_t *sni)
+int sni_manager_attach(sni_manager_t *sni, struct event_loop *loop)
 {
-    // 参数 0 表示非阻塞，立刻返回
-    dbus_connection_read_write_dispatch(sni->dbus_conn, 0);
+    if (!sni->dbus_conn)
+        return -1;
+    // 连接有数据时才会唤醒事件循环，空闲时不再需要定时轮询
+    if (event_loop_add_dbus(loop, sni->dbus_conn) < 0)
+        return -1;
+    sni->loop = loop;
+    schedule_menu_flush(sni);
+    return 0;
 }
 
 void sni_manager_set_icon_pixmap(sni_manager_t *sni, cairo_surface_t *surface)
 {
     sni->icon_surface = surface;
+    // 旧图标的缓存作废，下次被查询时重新转换
+    clear_pixmaps(sni);
+    properties_changed(sni, SNI_PROP_BIT(SNI_PROP_ICON_PIXMAP));
+}
+
+void sni_manager_set_status(sni_manager_t *sni, const char *status)
+{
+    if (strcmp(sni->status, status) == 0)
+        return;
+    free(sni->status);
+    sni->status = strdup(status);
+    properties_changed(sni, SNI_PROP_BIT(SNI_PROP_STATUS));
 }
 
 void sni_manager_set_on_activate(sni_manager_t *sni, sni_activate_callback cb, void *user_data)
@@ -425,3 +1129,90 @@ void sni_manager_set_on_menu_click(sni_manager_t *sni, sni_menu_click_callback c
     sni->on_menu_click = cb;
     sni->user_data = user_data;
 }
+
+int sni_menu_add_item(sni_manager_t *sni, int parent_id, int id, const char *label)
+{
+    struct menu_item *parent = find_menu_item(sni, parent_id);
+    if (!parent || find_menu_item(sni, id))
+        return -1;
+    struct menu_item *item = new_menu_item(sni, parent, id);
+    if (!item)
+        return -1;
+    item->label = label ? strdup(label) : NULL;
+    menu_layout_changed(sni, parent);
+    return 0;
+}
+
+int sni_menu_add_separator(sni_manager_t *sni, int parent_id, int id)
+{
+    if (sni_menu_add_item(sni, parent_id, id, NULL) < 0)
+        return -1;
+    find_menu_item(sni, id)->separator = true;
+    return 0;
+}
+
+void sni_menu_remove_item(sni_manager_t *sni, int id)
+{
+    struct menu_item *item = find_menu_item(sni, id);
+    if (!item || item == sni->menu_root)
+        return;
+    struct menu_item *parent = item->parent;
+    struct menu_item **link = &parent->children;
+    while (*link != item)
+        link = &(*link)->next;
+    *link = item->next;
+    free_menu_item(sni, item);
+    menu_layout_changed(sni, parent);
+}
+
+// 两个可能为 NULL 的字符串是否相同
+static bool same_string(const char *a, const char *b)
+{
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+void sni_menu_set_label(sni_manager_t *sni, int id, const char *label)
+{
+    struct menu_item *item = find_menu_item(sni, id);
+    if (!item || same_string(item->label, label))
+        return;
+    free(item->label);
+    item->label = label ? strdup(label) : NULL;
+    menu_props_changed(sni, item, MENU_PROP_BIT(MENU_PROP_LABEL));
+}
+
+void sni_menu_set_icon_name(sni_manager_t *sni, int id, const char *icon_name)
+{
+    struct menu_item *item = find_menu_item(sni, id);
+    if (!item || same_string(item->icon_name, icon_name))
+        return;
+    free(item->icon_name);
+    item->icon_name = icon_name ? strdup(icon_name) : NULL;
+    menu_props_changed(sni, item, MENU_PROP_BIT(MENU_PROP_ICON_NAME));
+}
+
+void sni_menu_set_enabled(sni_manager_t *sni, int id, bool enabled)
+{
+    struct menu_item *item = find_menu_item(sni, id);
+    if (!item || item->enabled == enabled)
+        return;
+    item->enabled = enabled;
+    menu_props_changed(sni, item, MENU_PROP_BIT(MENU_PROP_ENABLED));
+}
+
+void sni_menu_set_toggle(sni_manager_t *sni, int id, enum sni_menu_toggle type, bool checked)
+{
+    struct menu_item *item = find_menu_item(sni, id);
+    if (!item)
+        return;
+    uint32_t mask = 0;
+    if (item->toggle_type != type)
+        mask |= MENU_PROP_BIT(MENU_PROP_TOGGLE_TYPE) | MENU_PROP_BIT(MENU_PROP_TOGGLE_STATE);
+    if (item->checked != checked)
+        mask |= MENU_PROP_BIT(MENU_PROP_TOGGLE_STATE);
+    if (!mask)
+        return;
+    item->toggle_type = type;
+    item->checked = checked;
+    menu_props_changed(sni, item, mask);
+}
@@ -1,14 +1,14 @@
 #pragma once
 
+#include <stdbool.h>
 #include <cairo/cairo.h>
 
-#define MENU_ID_EXIT 1
-
 // 1. 定义回调函数指针：当用户在托盘点击“激活”时触发
 typedef void (*sni_activate_callback)(void *user_data);
 typedef void (*sni_menu_click_callback)(int id, void *user_data);
 
 typedef struct sni_manager sni_manager_t;
+struct event_loop;
 
 // 2. 初始化与销毁
 sni_manager_t* sni_manager_create(const char *appid, const char *icon_name);
@@ -21,9 +21,25 @@ void sni_manager_set_on_menu_click(sni_manager_t *sni, sni_menu_click_callback c
 // 4. 图片处理
 void sni_manager_set_icon_pixmap(sni_manager_t *sni, cairo_surface_t *surface);
 
-// 5. 事件循环集成
-int sni_manager_get_fd(sni_manager_t *sni);
-void sni_manager_dispatch(sni_manager_t *sni);
+// 5. 事件循环集成：D-Bus 连接的读写、超时与消息分发都交给事件循环，成功返回 0
+int sni_manager_attach(sni_manager_t *sni, struct event_loop *loop);
 
 // 6. 状态同步
 void sni_manager_set_status(sni_manager_t *sni, const char *status); // "Active", "Passive"
+
+// 7. 菜单：菜单项的 id 由调用者分配且不能重复，0 是根节点（parent_id 为 0 即顶层菜单项），
+//    有子项的菜单项自动显示为子菜单。修改在下一次空闲时合并成
+//    LayoutUpdated / ItemsPropertiesUpdated 信号，成功返回 0
+enum sni_menu_toggle {
+    SNI_MENU_TOGGLE_NONE,
+    SNI_MENU_TOGGLE_CHECKMARK,
+    SNI_MENU_TOGGLE_RADIO,
+};
+
+int sni_menu_add_item(sni_manager_t *sni, int parent_id, int id, const char *label);
+int sni_menu_add_separator(sni_manager_t *sni, int parent_id, int id);
+void sni_menu_remove_item(sni_manager_t *sni, int id); // 连同子项一起删除
+void sni_menu_set_label(sni_manager_t *sni, int id, const char *label);
+void sni_menu_set_icon_name(sni_manager_t *sni, int id, const char *icon_name);
+void sni_menu_set_enabled(sni_manager_t *sni, int id, bool enabled);
+void sni_menu_set_toggle(sni_manager_t *sni, int id, enum sni_menu_toggle type, bool checked);
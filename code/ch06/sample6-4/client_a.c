@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <cairo/cairo.h>
 #include <errno.h>
@@ -8,6 +10,9 @@
 #include <fcntl.h>
 #include <wayland-client.h>
 
+#include "canvas.h"
+#include "registry.h"
+#include "shm_file.h"
 #include "xx-zones-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
 #include "xdg-decoration-client-protocol.h"
@@ -15,7 +20,7 @@
 // 用于管理我们所有Wayland对象和状态的结构体
 struct state {
     struct wl_display *display;
-    struct wl_registry *registry;
+    struct registry *registry;
     struct wl_compositor *compositor;
     struct wl_surface *surface;
     struct wl_shm *shm;
@@ -33,8 +38,11 @@ struct state {
     struct xx_zone_item_v1 *xx_zone_item;
  
     struct wl_buffer *buffer;
+    struct shm_file shm_file;
     void *shm_data;
-    int pool_size;
+    struct canvas canvas;
+    struct canvas_label label;
+    int buffer_width, buffer_height;
 
     int width, height;
     _Bool running;
@@ -45,50 +53,35 @@ static void destroy_shm_buffer(struct state *state) {
         wl_buffer_destroy(state->buffer);
         state->buffer = NULL;
     }
-    if (state->shm_data) {
-        munmap(state->shm_data, state->pool_size);
-        state->shm_data = NULL;
-    }
+    shm_file_destroy(&state->shm_file);
+    state->shm_data = NULL;
 }
 
 // 创建共享内存缓冲区
 static int create_shm_buffer(struct state *state) {
+    // 尺寸没有变化时直接复用现有的缓冲区（以及绑定在上面的 cairo 画布）
+    if (state->buffer && state->buffer_width == state->width &&
+        state->buffer_height == state->height) {
+        return 0;
+    }
     destroy_shm_buffer(state);
 
-    // 使用 memfd_create 创建一个匿名的、基于内存的文件
-    char tmp_name[] = "/tmp/wayland-shm-XXXXXX";
-    int fd = mkstemp(tmp_name);
-    if (fd < 0) {
-        fprintf(stderr, "mkstemp failed\n");
-        return -1;
-    }
-    // 立即删除文件名，文件描述符依然有效
-    unlink(tmp_name);
- 
     int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, state->width);
     int size = stride * state->height;
-    state->pool_size = size;
- 
-    if (ftruncate(fd, size) < 0) {
-        close(fd);
-        fprintf(stderr, "ftruncate failed\n");
-        return -1;
-    }
- 
-    // 将文件映射到内存
-    state->shm_data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (state->shm_data == MAP_FAILED) {
-        close(fd);
-        fprintf(stderr, "mmap failed\n");
+
+    // 使用封印的 memfd 作为后备内存，像素数据不会经过磁盘文件系统
+    if (shm_file_create(&state->shm_file, size, SHM_FILE_THP) < 0) {
         return -1;
     }
+    state->shm_data = state->shm_file.data;
  
     // 从文件描述符创建Wayland共享内存池
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm, fd, size);
+    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm, state->shm_file.fd, size);
     state->buffer = wl_shm_pool_create_buffer(pool, 0, state->width, state->height, stride, WL_SHM_FORMAT_ARGB8888);
     
     wl_shm_pool_destroy(pool);
-    close(fd);
+    state->buffer_width = state->width;
+    state->buffer_height = state->height;
     return 0;
 }
  
@@ -97,35 +90,23 @@ static void draw_frame(struct state *state) {
     if (create_shm_buffer(state) < 0) return;
 
     int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, state->width);
-    int size = stride * state->height;
     printf("Drawing frame with size %dx%d\n", state->width, state->height);
- 
-    // 清空缓冲区内存
-    memset(state->shm_data, 0, size);
-    printf("Clearing buffer memory\n");
- 
-    // 使用Cairo在共享内存上创建表面
-    cairo_surface_t *cairo_surface = cairo_image_surface_create_for_data(
-        state->shm_data, CAIRO_FORMAT_ARGB32, state->width, state->height, stride);
-    cairo_t *cr = cairo_create(cairo_surface);
- 
-    // 绘制背景 (淡蓝色)
+
+    // 画布跟随 shm 缓冲区复用，只在尺寸或映射地址变化时重建
+    cairo_t *cr = canvas_begin(&state->canvas, state->shm_data, state->width, state->height, stride);
+
+    // 绘制背景 (淡蓝色)：不透明的 SOURCE 绘制覆盖每个像素，无需先清空缓冲区
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
     cairo_set_source_rgba(cr, 0.8, 0.9, 1.0, 1.0);
     cairo_paint(cr);
- 
-    // 绘制文字
+    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+    // 绘制文字：字体、字形和文字尺寸在启动时已经算好
+    const struct canvas_label *label = &state->label;
     cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
-    cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-    cairo_set_font_size(cr, 40);
- 
-    cairo_text_extents_t extents;
-    cairo_text_extents(cr, "Hello Client A!", &extents);
-    cairo_move_to(cr, state->width/2.0 - extents.width/2.0, state->height/2.0);
-    cairo_show_text(cr, "Hello Client A!");
- 
-    // 清理Cairo资源
-    cairo_destroy(cr);
-    cairo_surface_destroy(cairo_surface);
+    canvas_label_draw(cr, label, state->width/2.0 - label->extents.width/2.0, state->height/2.0);
+
+    canvas_end(&state->canvas);
  
     // 将绘制好的缓冲区附加到表面
     wl_surface_attach(state->surface, state->buffer, 0, 0);
@@ -282,36 +263,15 @@ static const struct xx_zone_item_v1_listener zone_item_listener = {
     .closed = zone_item_closed,
 };
 
-// --- wl_registry 事件监听器 ---
-static void registry_handle_global(void *data, struct wl_registry *registry, uint32_t name,
-                                   const char *interface, uint32_t version) {
-    struct state *state = data;
-    printf("Found global: %s (version %u)\n", interface, version);
- 
-    if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        state->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
-    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
-        state->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
-    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        state->xdg_wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
-        xdg_wm_base_add_listener(state->xdg_wm_base, &xdg_wm_base_listener, state);
-    } else if (strcmp(interface, zxdg_decoration_manager_v1_interface.name) == 0) {
-        state->decoration_manager = wl_registry_bind(registry, name, &zxdg_decoration_manager_v1_interface, 1);
-    } else if (strcmp(interface, "xx_zone_manager_v1") == 0) {
-        state->xx_zone_manager = wl_registry_bind(registry, name, &xx_zone_manager_v1_interface, 1);
-    } else if (strcmp(interface, "wl_output") == 0)
-    {
-        state->output = wl_registry_bind(registry, name, &wl_output_interface, 1);
-    }
-}
-
-static void registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name) {
-    // This space is for rent
-}
-
-static const struct wl_registry_listener registry_listener = {
-    .global = registry_handle_global,
-    .global_remove = registry_handle_global_remove,
+// --- 全局对象绑定表 ---
+// 接口、最低版本、支持的最高版本、保存位置、监听器、是否必需
+static const struct registry_binding registry_bindings[] = {
+    { &wl_compositor_interface, 1, 4, offsetof(struct state, compositor), NULL, true },
+    { &wl_shm_interface, 1, 1, offsetof(struct state, shm), NULL, true },
+    { &xdg_wm_base_interface, 1, 1, offsetof(struct state, xdg_wm_base), &xdg_wm_base_listener, true },
+    { &zxdg_decoration_manager_v1_interface, 1, 1, offsetof(struct state, decoration_manager), NULL, false },
+    { &xx_zone_manager_v1_interface, 1, 1, offsetof(struct state, xx_zone_manager), NULL, false },
+    { &wl_output_interface, 1, 1, offsetof(struct state, output), NULL, false },
 };
 
 int main()
@@ -320,6 +280,10 @@ int main()
     state.width = 640;
     state.height = 480;
     state.running = 1;
+
+    // 静态文字只排版一次，之后每帧直接绘制缓存的字形
+    canvas_label_init(&state.label, "sans-serif", CAIRO_FONT_SLANT_NORMAL,
+                      CAIRO_FONT_WEIGHT_BOLD, 40, "Hello Client A!");
  
     // 1. 连接到Wayland display
     state.display = wl_display_connect(NULL);
@@ -329,16 +293,17 @@ int main()
     }
  
     // 2. 获取registry，用于发现全局对象
-    state.registry = wl_display_get_registry(state.display);
-    wl_registry_add_listener(state.registry, &registry_listener, &state);
+    state.registry = registry_create(state.display, registry_bindings,
+                                     sizeof(registry_bindings) / sizeof(registry_bindings[0]), &state);
  
     // 3. 同步，等待服务器处理我们的请求并发送全局对象事件
     wl_display_dispatch(state.display);
     wl_display_roundtrip(state.display);
  
     // 检查是否成功绑定了必要的全局对象
-    if (state.compositor == NULL || state.shm == NULL || state.xdg_wm_base == NULL) {
-        fprintf(stderr, "Can't find compositor, shm or xdg_wm_base\n");
+    const char *missing = registry_missing(state.registry);
+    if (missing) {
+        fprintf(stderr, "Can't find %s\n", missing);
         return 1;
     }
  
@@ -389,14 +354,17 @@ int main()
     if (state.toplevel_decoration) zxdg_toplevel_decoration_v1_destroy(state.toplevel_decoration);
     if (state.decoration_manager) zxdg_decoration_manager_v1_destroy(state.decoration_manager);
     if (state.xx_zone_manager) xx_zone_manager_v1_destroy(state.xx_zone_manager);
+    canvas_finish(&state.canvas);
+    canvas_label_finish(&state.label);
     if (state.buffer) wl_buffer_destroy(state.buffer);
+    shm_file_destroy(&state.shm_file);
     if (state.xdg_toplevel) xdg_toplevel_destroy(state.xdg_toplevel);
     if (state.xdg_surface) xdg_surface_destroy(state.xdg_surface);
     if (state.surface) wl_surface_destroy(state.surface);
     if (state.xdg_wm_base) xdg_wm_base_destroy(state.xdg_wm_base);
     if (state.shm) wl_shm_destroy(state.shm);
     if (state.compositor) wl_compositor_destroy(state.compositor);
-    if (state.registry) wl_registry_destroy(state.registry);
+    if (state.registry) registry_destroy(state.registry);
     if (state.display) wl_display_disconnect(state.display);
  
     return 0;
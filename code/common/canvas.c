@@ -0,0 +1,95 @@
+#include "canvas.h"
+#include <string.h>
+
+static void canvas_release(struct canvas *canvas) {
+    if (canvas->cr) {
+        cairo_destroy(canvas->cr);
+        canvas->cr = NULL;
+    }
+    if (canvas->surface) {
+        cairo_surface_destroy(canvas->surface);
+        canvas->surface = NULL;
+    }
+}
+
+cairo_t *canvas_begin(struct canvas *canvas, void *data, int width, int height, int stride) {
+    if (!canvas->cr || canvas->data != data || canvas->width != width ||
+        canvas->height != height || canvas->stride != stride) {
+        canvas_release(canvas);
+        canvas->surface = cairo_image_surface_create_for_data(
+            data, CAIRO_FORMAT_ARGB32, width, height, stride);
+        canvas->cr = cairo_create(canvas->surface);
+        canvas->data = data;
+        canvas->width = width;
+        canvas->height = height;
+        canvas->stride = stride;
+    }
+
+    // 每帧从同样的绘图状态开始，上一帧设置的 source、变换等不会遗留下来
+    cairo_save(canvas->cr);
+    return canvas->cr;
+}
+
+void canvas_end(struct canvas *canvas) {
+    cairo_restore(canvas->cr);
+    // 交给合成器之前确保 cairo 的写入全部落到共享内存
+    cairo_surface_flush(canvas->surface);
+}
+
+void canvas_finish(struct canvas *canvas) {
+    canvas_release(canvas);
+    memset(canvas, 0, sizeof(*canvas));
+}
+
+int canvas_label_init(struct canvas_label *label, const char *family,
+                      cairo_font_slant_t slant, cairo_font_weight_t weight,
+                      double size, const char *text) {
+    memset(label, 0, sizeof(*label));
+
+    // 字体只在这里经 fontconfig 解析一次，之后绘制直接使用 scaled font
+    cairo_font_face_t *face = cairo_toy_font_face_create(family, slant, weight);
+    cairo_matrix_t font_matrix, ctm;
+    cairo_matrix_init_scale(&font_matrix, size, size);
+    cairo_matrix_init_identity(&ctm);
+    cairo_font_options_t *options = cairo_font_options_create();
+    label->font = cairo_scaled_font_create(face, &font_matrix, &ctm, options);
+    cairo_font_options_destroy(options);
+    cairo_font_face_destroy(face);
+
+    if (cairo_scaled_font_status(label->font) != CAIRO_STATUS_SUCCESS) {
+        canvas_label_finish(label);
+        return -1;
+    }
+
+    // 字形位置相对于基线起点 (0, 0)，绘制时再平移
+    if (cairo_scaled_font_text_to_glyphs(label->font, 0, 0, text, -1,
+                                         &label->glyphs, &label->num_glyphs,
+                                         NULL, NULL, NULL) != CAIRO_STATUS_SUCCESS) {
+        canvas_label_finish(label);
+        return -1;
+    }
+    cairo_scaled_font_glyph_extents(label->font, label->glyphs, label->num_glyphs,
+                                    &label->extents);
+    return 0;
+}
+
+void canvas_label_finish(struct canvas_label *label) {
+    if (label->glyphs) {
+        cairo_glyph_free(label->glyphs);
+    }
+    if (label->font) {
+        cairo_scaled_font_destroy(label->font);
+    }
+    memset(label, 0, sizeof(*label));
+}
+
+void canvas_label_draw(cairo_t *cr, const struct canvas_label *label, double x, double y) {
+    if (!label->font) {
+        return;
+    }
+    cairo_save(cr);
+    cairo_translate(cr, x, y);
+    cairo_set_scaled_font(cr, label->font);
+    cairo_show_glyphs(cr, label->glyphs, label->num_glyphs);
+    cairo_restore(cr);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cairo/cairo.h>
+
+// 跨帧复用的 cairo 绘图状态。
+// 每帧都 cairo_image_surface_create_for_data + cairo_create、
+// 再用 cairo_select_font_face 经 fontconfig 重新解析字体是不必要的开销：
+// 这里让 surface/cairo_t 跟随 shm 缓冲区存在，只在尺寸或映射地址变化时重建；
+// 静态文字的字体、字形和尺寸只在创建时计算一次。
+
+// 1. 画布：包装一段 ARGB32 像素内存
+struct canvas {
+    cairo_surface_t *surface;
+    cairo_t *cr;
+    void *data;
+    int width, height, stride;
+};
+
+// 开始一帧：缓冲区与上一帧相同时直接复用 cairo_t，否则重建。
+// 返回的 cairo_t 已 cairo_save，绘制完成后调用 canvas_end
+cairo_t *canvas_begin(struct canvas *canvas, void *data, int width, int height, int stride);
+void canvas_end(struct canvas *canvas);
+void canvas_finish(struct canvas *canvas);
+
+// 2. 静态文字：缓存 scaled font、字形与文字尺寸
+struct canvas_label {
+    cairo_scaled_font_t *font;
+    cairo_glyph_t *glyphs;
+    int num_glyphs;
+    cairo_text_extents_t extents;
+};
+
+int canvas_label_init(struct canvas_label *label, const char *family,
+                      cairo_font_slant_t slant, cairo_font_weight_t weight,
+                      double size, const char *text);
+void canvas_label_finish(struct canvas_label *label);
+
+// 以 (x, y) 为基线起点绘制，使用 cr 当前的 source
+void canvas_label_draw(cairo_t *cr, const struct canvas_label *label, double x, double y);
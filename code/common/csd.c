@@ -0,0 +1,322 @@
+#include "csd.h"
+#include <stdlib.h>
+#include <string.h>
+#include "fill.h"
+
+#define TITLEBAR_COLOR 0xFF444444
+#define GLYPH_COLOR    0xFF202020
+#define GLYPH_SIZE     12
+
+// 标题栏只用不透明的颜色，buffer 不需要 alpha；不透明区域也由这个格式推导
+#define CSD_FORMAT WL_SHM_FORMAT_XRGB8888
+
+static const uint32_t button_colors[CSD_BUTTON_COUNT] = {
+    [CSD_BUTTON_MINIMIZE] = 0xFFFFFF00,
+    [CSD_BUTTON_MAXIMIZE] = 0xFF00FF00,
+    [CSD_BUTTON_CLOSE]    = 0xFFFF0000,
+};
+
+// amount > 0 向白色靠近，< 0 向黑色靠近，单位为 1/256
+static uint32_t shade(uint32_t color, int amount) {
+    uint32_t out = color & 0xFF000000;
+    for (int shift = 0; shift < 24; shift += 8) {
+        int c = (color >> shift) & 0xFF;
+        c = amount > 0 ? c + ((255 - c) * amount >> 8) : c + (c * amount >> 8);
+        out |= (uint32_t)c << shift;
+    }
+    return out;
+}
+
+static int button_x(int width, enum csd_button button) {
+    return width - (CSD_BUTTON_COUNT - button) * CSD_BUTTON_WIDTH;
+}
+
+// 按钮位图：底色随状态变化，中间是图标
+static uint32_t *render_bitmap(enum csd_button button, enum csd_button_state state) {
+    uint32_t *pixels = malloc(sizeof(uint32_t) * CSD_BUTTON_WIDTH * CSD_TITLEBAR_HEIGHT);
+    if (!pixels) {
+        return NULL;
+    }
+    uint32_t color = button_colors[button];
+    if (state == CSD_BUTTON_HOVER) {
+        color = shade(color, 96);
+    } else if (state == CSD_BUTTON_PRESSED) {
+        color = shade(color, -80);
+    }
+    fill_solid(pixels, CSD_BUTTON_WIDTH, CSD_TITLEBAR_HEIGHT, CSD_BUTTON_WIDTH * 4, color);
+
+    int x0 = (CSD_BUTTON_WIDTH - GLYPH_SIZE) / 2;
+    int y0 = (CSD_TITLEBAR_HEIGHT - GLYPH_SIZE) / 2;
+    for (int y = 0; y < GLYPH_SIZE; y++) {
+        uint32_t *row = pixels + (y0 + y) * CSD_BUTTON_WIDTH + x0;
+        for (int x = 0; x < GLYPH_SIZE; x++) {
+            bool on = false;
+            switch (button) {
+            case CSD_BUTTON_MINIMIZE:
+                on = y >= GLYPH_SIZE - 2;
+                break;
+            case CSD_BUTTON_MAXIMIZE:
+                on = x < 2 || x >= GLYPH_SIZE - 2 || y < 2 || y >= GLYPH_SIZE - 2;
+                break;
+            default:
+                on = abs(x - y) <= 1 || abs(x + y - (GLYPH_SIZE - 1)) <= 1;
+                break;
+            }
+            if (on) {
+                row[x] = GLYPH_COLOR;
+            }
+        }
+    }
+    return pixels;
+}
+
+static const uint32_t *get_bitmap(struct csd *csd, enum csd_button button, uint8_t state) {
+    if (!csd->bitmaps[button][state]) {
+        csd->bitmaps[button][state] = render_bitmap(button, state);
+    }
+    return csd->bitmaps[button][state];
+}
+
+// 把按钮位图拷进标题栏，窗口太窄时裁掉左边伸出去的部分
+static void blit_button(struct csd *csd, struct csd_buffer *buffer, enum csd_button button) {
+    const uint32_t *bitmap = get_bitmap(csd, button, csd->states[button]);
+    if (!bitmap) {
+        return;
+    }
+    int x = button_x(buffer->width, button);
+    int skip = x < 0 ? -x : 0;
+    if (skip >= CSD_BUTTON_WIDTH) {
+        return;
+    }
+    uint32_t *pixels = buffer->file.data;
+    for (int y = 0; y < CSD_TITLEBAR_HEIGHT; y++) {
+        memcpy(pixels + y * buffer->width + x + skip, bitmap + y * CSD_BUTTON_WIDTH + skip,
+               sizeof(uint32_t) * (CSD_BUTTON_WIDTH - skip));
+    }
+    buffer->states[button] = csd->states[button];
+}
+
+static void destroy_buffer(struct csd_buffer *buffer) {
+    if (buffer->wl_buffer) {
+        wl_buffer_destroy(buffer->wl_buffer);
+        shm_file_destroy(&buffer->file);
+    }
+    buffer->wl_buffer = NULL;
+    buffer->busy = false;
+}
+
+static void buffer_release(void *data, struct wl_buffer *wl_buffer) {
+    struct csd_buffer *buffer = data;
+    struct csd *csd = buffer->csd;
+    buffer->busy = false;
+    if (csd->pending) {
+        csd->pending = false;
+        csd->retry(csd->data);
+    }
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static int create_buffer(struct csd *csd, struct csd_buffer *buffer, int width) {
+    destroy_buffer(buffer);
+    int stride = width * 4;
+    if (shm_file_create(&buffer->file, (size_t)stride * CSD_TITLEBAR_HEIGHT, SHM_FILE_DEFAULT) < 0) {
+        return -1;
+    }
+    struct wl_shm_pool *pool = wl_shm_create_pool(csd->shm, buffer->file.fd, buffer->file.size);
+    buffer->wl_buffer = wl_shm_pool_create_buffer(pool, 0, width, CSD_TITLEBAR_HEIGHT, stride,
+                                                  CSD_FORMAT);
+    wl_shm_pool_destroy(pool);
+    wl_buffer_add_listener(buffer->wl_buffer, &buffer_listener, buffer);
+
+    buffer->csd = csd;
+    buffer->width = width;
+    buffer->busy = false;
+
+    // 新 buffer 整个画一遍：背景加上全部按钮
+    fill_solid(buffer->file.data, width, CSD_TITLEBAR_HEIGHT, stride, TITLEBAR_COLOR);
+    for (int i = 0; i < CSD_BUTTON_COUNT; i++) {
+        blit_button(csd, buffer, i);
+    }
+    return 0;
+}
+
+static int count_differences(const uint8_t *a, const uint8_t *b) {
+    int count = 0;
+    for (int i = 0; i < CSD_BUTTON_COUNT; i++) {
+        count += a[i] != b[i];
+    }
+    return count;
+}
+
+// 挑一个空闲 buffer：内容完全相同的最好，其次是同宽度且要重画的按钮最少的，
+// 最后才重新创建；同等条件下取最久没用的
+static struct csd_buffer *pick_buffer(struct csd *csd) {
+    struct csd_buffer *best = NULL;
+    int best_cost = 0;
+    for (int i = 0; i < CSD_BUFFERS; i++) {
+        struct csd_buffer *buffer = &csd->buffers[i];
+        if (buffer->busy) {
+            continue;
+        }
+        int cost = buffer->wl_buffer && buffer->width == csd->width
+                 ? count_differences(buffer->states, csd->states)
+                 : CSD_BUTTON_COUNT + 1;
+        if (!best || cost < best_cost ||
+            (cost == best_cost && buffer->last_used < best->last_used)) {
+            best = buffer;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+int csd_init(struct csd *csd, struct wl_compositor *compositor,
+             struct wl_subcompositor *subcompositor, struct wl_shm *shm,
+             struct wl_surface *parent, csd_retry_fn retry, void *data) {
+    memset(csd, 0, sizeof(*csd));
+    csd->shm = shm;
+    csd->retry = retry;
+    csd->data = data;
+
+    csd->surface = wl_compositor_create_surface(compositor);
+    if (!csd->surface) {
+        return -1;
+    }
+    surface_region_init(&csd->region, compositor, csd->surface);
+    csd->subsurface = wl_subcompositor_get_subsurface(subcompositor, csd->surface, parent);
+    wl_subsurface_set_position(csd->subsurface, 0, -CSD_TITLEBAR_HEIGHT);
+    wl_subsurface_set_sync(csd->subsurface);
+    return 0;
+}
+
+void csd_finish(struct csd *csd) {
+    for (int i = 0; i < CSD_BUFFERS; i++) {
+        destroy_buffer(&csd->buffers[i]);
+    }
+    for (int b = 0; b < CSD_BUTTON_COUNT; b++) {
+        for (int s = 0; s < CSD_BUTTON_STATES; s++) {
+            free(csd->bitmaps[b][s]);
+        }
+    }
+    if (csd->subsurface) {
+        wl_subsurface_destroy(csd->subsurface);
+    }
+    if (csd->surface) {
+        wl_surface_destroy(csd->surface);
+    }
+    memset(csd, 0, sizeof(*csd));
+}
+
+void csd_set_width(struct csd *csd, int width) {
+    csd->width = width;
+}
+
+void csd_set_button_state(struct csd *csd, enum csd_button button, enum csd_button_state state) {
+    csd->states[button] = state;
+}
+
+int csd_update(struct csd *csd) {
+    struct csd_buffer *current = csd->current;
+    if (csd->width <= 0) {
+        return 0;
+    }
+    // 合成器已经释放的 current 也可能被选中原地重画，先记下它原来的内容
+    bool same_width = current && current->width == csd->width;
+    uint8_t shown[CSD_BUTTON_COUNT];
+    if (same_width) {
+        memcpy(shown, current->states, sizeof(shown));
+        if (count_differences(shown, csd->states) == 0) {
+            return 0;
+        }
+    }
+
+    struct csd_buffer *buffer = pick_buffer(csd);
+    if (!buffer) {
+        csd->pending = true;
+        return -1;
+    }
+
+    if (!buffer->wl_buffer || buffer->width != csd->width) {
+        if (create_buffer(csd, buffer, csd->width) < 0) {
+            return -1;
+        }
+    } else {
+        for (int i = 0; i < CSD_BUTTON_COUNT; i++) {
+            if (buffer->states[i] != csd->states[i]) {
+                blit_button(csd, buffer, i);
+            }
+        }
+    }
+
+    // 损坏区域相对于合成器手里的上一份内容：同宽度时只有状态变化的按钮
+    wl_surface_attach(csd->surface, buffer->wl_buffer, 0, 0);
+    if (same_width) {
+        for (int i = 0; i < CSD_BUTTON_COUNT; i++) {
+            if (shown[i] != csd->states[i]) {
+                wl_surface_damage(csd->surface, button_x(csd->width, i), 0,
+                                  CSD_BUTTON_WIDTH, CSD_TITLEBAR_HEIGHT);
+            }
+        }
+    } else {
+        wl_surface_damage(csd->surface, 0, 0, csd->width, CSD_TITLEBAR_HEIGHT);
+        surface_region_set_opaque(&csd->region, csd->width, CSD_TITLEBAR_HEIGHT,
+                                  !shm_format_has_alpha(CSD_FORMAT), NULL);
+    }
+    wl_surface_commit(csd->surface);
+
+    buffer->busy = true;
+    buffer->last_used = ++csd->clock;
+    csd->current = buffer;
+    return 1;
+}
+
+struct csd_hit csd_hit_test(int width, int height, double x, double y) {
+    struct csd_hit hit = { .kind = CSD_HIT_CONTENT };
+
+    if (x < CSD_RESIZE_MARGIN) {
+        hit.edges |= CSD_EDGE_LEFT;
+    } else if (x >= width - CSD_RESIZE_MARGIN) {
+        hit.edges |= CSD_EDGE_RIGHT;
+    }
+    if (y < CSD_RESIZE_MARGIN) {
+        hit.edges |= CSD_EDGE_TOP;
+    } else if (y >= height - CSD_RESIZE_MARGIN) {
+        hit.edges |= CSD_EDGE_BOTTOM;
+    }
+    if (hit.edges) {
+        hit.kind = CSD_HIT_RESIZE;
+        return hit;
+    }
+
+    if (y < CSD_TITLEBAR_HEIGHT) {
+        hit.kind = CSD_HIT_TITLEBAR;
+        for (int i = 0; i < CSD_BUTTON_COUNT; i++) {
+            int bx = button_x(width, i);
+            if (x >= bx && x < bx + CSD_BUTTON_WIDTH) {
+                hit.kind = CSD_HIT_BUTTON;
+                hit.button = i;
+                break;
+            }
+        }
+    }
+    return hit;
+}
+
+const char *csd_hit_cursor(const struct csd_hit *hit) {
+    if (hit->kind != CSD_HIT_RESIZE) {
+        return "default";
+    }
+    switch (hit->edges) {
+    case CSD_EDGE_TOP:                     return "n-resize";
+    case CSD_EDGE_BOTTOM:                  return "s-resize";
+    case CSD_EDGE_LEFT:                    return "w-resize";
+    case CSD_EDGE_RIGHT:                   return "e-resize";
+    case CSD_EDGE_TOP | CSD_EDGE_LEFT:     return "nw-resize";
+    case CSD_EDGE_TOP | CSD_EDGE_RIGHT:    return "ne-resize";
+    case CSD_EDGE_BOTTOM | CSD_EDGE_LEFT:  return "sw-resize";
+    default:                               return "se-resize";
+    }
+}
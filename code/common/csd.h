@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+#include "shm_file.h"
+#include "surface_region.h"
+
+// 客户端装饰（CSD）：标题栏画在内容表面上方的一个同步子表面里。
+// - 内容重绘完全不碰标题栏，标题栏只在宽度或按钮状态变化时更新；
+// - 每个按钮在每种状态下的位图只画一次，之后直接拷贝；
+// - 标题栏 buffer 记住自己画的是哪个宽度、哪组按钮状态：完全相同就直接复用，
+//   宽度相同时只重画状态不同的按钮，并且只报告这些按钮的损坏区域；
+// - 命中测试给出按钮、标题栏和窗口边缘，边缘可直接交给 xdg_toplevel_resize。
+// 子表面处于同步模式，标题栏的提交在父表面下一次 commit 时才生效，
+// 因此改变宽度时标题栏和内容总是同一帧出现。
+// 坐标约定：窗口坐标以标题栏左上角为原点，内容表面位于 (0, CSD_TITLEBAR_HEIGHT)。
+
+#define CSD_TITLEBAR_HEIGHT 30
+#define CSD_BUTTON_WIDTH 40
+#define CSD_RESIZE_MARGIN 6
+#define CSD_BUFFERS 4
+
+// 从左到右排列在标题栏右端
+enum csd_button {
+    CSD_BUTTON_MINIMIZE,
+    CSD_BUTTON_MAXIMIZE,
+    CSD_BUTTON_CLOSE,
+    CSD_BUTTON_COUNT,
+};
+
+enum csd_button_state {
+    CSD_BUTTON_NORMAL,
+    CSD_BUTTON_HOVER,
+    CSD_BUTTON_PRESSED,
+    CSD_BUTTON_STATES,
+};
+
+// 取值与 xdg_toplevel.resize_edge 一致，可直接传给 xdg_toplevel_resize
+enum csd_edge {
+    CSD_EDGE_NONE = 0,
+    CSD_EDGE_TOP = 1,
+    CSD_EDGE_BOTTOM = 2,
+    CSD_EDGE_LEFT = 4,
+    CSD_EDGE_RIGHT = 8,
+};
+
+enum csd_hit_kind {
+    CSD_HIT_CONTENT,
+    CSD_HIT_TITLEBAR,   // 拖动移动窗口
+    CSD_HIT_BUTTON,
+    CSD_HIT_RESIZE,
+};
+
+struct csd_hit {
+    enum csd_hit_kind kind;
+    enum csd_button button;   // kind 为 CSD_HIT_BUTTON 时有效
+    uint32_t edges;           // kind 为 CSD_HIT_RESIZE 时有效，csd_edge 的组合
+};
+
+struct csd;
+
+struct csd_buffer {
+    struct csd *csd;
+    struct wl_buffer *wl_buffer;
+    struct shm_file file;
+    int width;
+    uint8_t states[CSD_BUTTON_COUNT];   // 这个 buffer 里画的按钮状态
+    bool busy;
+    uint64_t last_used;
+};
+
+// 所有 buffer 都被合成器占用而搁置的更新，在有 buffer 释放时通过它重试
+typedef void (*csd_retry_fn)(void *data);
+
+struct csd {
+    struct wl_shm *shm;
+    struct wl_surface *surface;
+    struct wl_subsurface *subsurface;
+    struct surface_region region;       // 标题栏是 XRGB，整条不透明
+    csd_retry_fn retry;
+    void *data;
+
+    int width;
+    uint8_t states[CSD_BUTTON_COUNT];   // 想要显示的状态
+    struct csd_buffer *current;         // 最近一次提交的 buffer
+    struct csd_buffer buffers[CSD_BUFFERS];
+    bool pending;
+    uint64_t clock;
+
+    uint32_t *bitmaps[CSD_BUTTON_COUNT][CSD_BUTTON_STATES];
+};
+
+// 1. 创建与销毁。shm 决定 buffer 释放事件派发到哪个队列
+int csd_init(struct csd *csd, struct wl_compositor *compositor,
+             struct wl_subcompositor *subcompositor, struct wl_shm *shm,
+             struct wl_surface *parent, csd_retry_fn retry, void *data);
+void csd_finish(struct csd *csd);
+
+// 2. 修改宽度和按钮状态，随后调用 csd_update 一次性画出
+void csd_set_width(struct csd *csd, int width);
+void csd_set_button_state(struct csd *csd, enum csd_button button, enum csd_button_state state);
+
+// 3. 把标题栏更新到当前宽度和状态并提交子表面。
+//    返回 1 表示提交了新内容，需要提交父表面才会显示；0 表示没有变化；
+//    -1 表示没有空闲 buffer，之后会调用 retry
+int csd_update(struct csd *csd);
+
+// 4. 命中测试（窗口坐标），以及命中位置对应的光标名
+struct csd_hit csd_hit_test(int width, int height, double x, double y);
+const char *csd_hit_cursor(const struct csd_hit *hit);
@@ -0,0 +1,265 @@
+#include "cursor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cursor-shape-v1-client-protocol.h"
+
+// CSS 光标名、对应的传统 X 光标名、形状协议中的枚举
+static const struct {
+    const char *name;
+    const char *legacy;
+    uint32_t shape;
+} cursor_names[] = {
+    { "default",       "left_ptr",            WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_DEFAULT },
+    { "context-menu",  NULL,                  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_CONTEXT_MENU },
+    { "help",          "question_arrow",      WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_HELP },
+    { "pointer",       "hand2",               WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_POINTER },
+    { "progress",      "left_ptr_watch",      WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_PROGRESS },
+    { "wait",          "watch",               WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_WAIT },
+    { "cell",          "plus",                WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_CELL },
+    { "crosshair",     "cross",               WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_CROSSHAIR },
+    { "text",          "xterm",               WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_TEXT },
+    { "vertical-text", NULL,                  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_VERTICAL_TEXT },
+    { "alias",         "dnd-link",            WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_ALIAS },
+    { "copy",          "dnd-copy",            WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_COPY },
+    { "move",          "fleur",               WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_MOVE },
+    { "no-drop",       "dnd-none",            WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NO_DROP },
+    { "not-allowed",   "crossed_circle",      WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NOT_ALLOWED },
+    { "grab",          "hand1",               WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_GRAB },
+    { "grabbing",      NULL,                  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_GRABBING },
+    { "e-resize",      "right_side",          WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_E_RESIZE },
+    { "n-resize",      "top_side",            WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_N_RESIZE },
+    { "ne-resize",     "top_right_corner",    WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NE_RESIZE },
+    { "nw-resize",     "top_left_corner",     WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NW_RESIZE },
+    { "s-resize",      "bottom_side",         WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_S_RESIZE },
+    { "se-resize",     "bottom_right_corner", WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_SE_RESIZE },
+    { "sw-resize",     "bottom_left_corner",  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_SW_RESIZE },
+    { "w-resize",      "left_side",           WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_W_RESIZE },
+    { "ew-resize",     "sb_h_double_arrow",   WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_EW_RESIZE },
+    { "ns-resize",     "sb_v_double_arrow",   WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NS_RESIZE },
+    { "nesw-resize",   "fd_double_arrow",     WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NESW_RESIZE },
+    { "nwse-resize",   "bd_double_arrow",     WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NWSE_RESIZE },
+    { "col-resize",    NULL,                  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_COL_RESIZE },
+    { "row-resize",    NULL,                  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_ROW_RESIZE },
+    { "all-scroll",    NULL,                  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_ALL_SCROLL },
+    { "zoom-in",       NULL,                  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_ZOOM_IN },
+    { "zoom-out",      NULL,                  WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_ZOOM_OUT },
+};
+
+#define CURSOR_NAME_COUNT (sizeof(cursor_names) / sizeof(cursor_names[0]))
+
+static int find_name(const char *name) {
+    for (size_t i = 0; i < CURSOR_NAME_COUNT; i++) {
+        if (strcmp(cursor_names[i].name, name) == 0 ||
+            (cursor_names[i].legacy && strcmp(cursor_names[i].legacy, name) == 0)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+struct cursor_manager *cursor_manager_create(struct wl_compositor *compositor, struct wl_shm *shm,
+                                             const char *theme, int size) {
+    struct cursor_manager *manager = calloc(1, sizeof(*manager));
+    if (!manager) {
+        return NULL;
+    }
+    manager->compositor = compositor;
+    manager->shm = shm;
+
+    if (!theme) {
+        theme = getenv("XCURSOR_THEME");
+    }
+    manager->theme_name = theme ? strdup(theme) : NULL;
+
+    if (size <= 0) {
+        const char *env = getenv("XCURSOR_SIZE");
+        size = env ? atoi(env) : 0;
+    }
+    manager->size = size > 0 ? size : 24;
+    return manager;
+}
+
+void cursor_manager_destroy(struct cursor_manager *manager) {
+    if (!manager) {
+        return;
+    }
+    for (int i = 0; i < manager->theme_count; i++) {
+        wl_cursor_theme_destroy(manager->themes[i].theme);
+    }
+    free(manager->theme_name);
+    free(manager);
+}
+
+void cursor_manager_set_shape_manager(struct cursor_manager *manager,
+                                      struct wp_cursor_shape_manager_v1 *shape_manager) {
+    manager->shape_manager = shape_manager;
+}
+
+// 按像素尺寸取主题，没加载过才真正读取主题文件
+static struct wl_cursor_theme *get_theme(struct cursor_manager *manager, int size) {
+    for (int i = 0; i < manager->theme_count; i++) {
+        if (manager->themes[i].size == size) {
+            return manager->themes[i].theme;
+        }
+    }
+
+    // 正在显示的光标引用着主题里的图像，已加载的主题不能淘汰。
+    // 缩放种类通常只有一两种，缓存满了就退回第一个尺寸
+    if (manager->theme_count == CURSOR_THEME_CACHE) {
+        return manager->themes[0].theme;
+    }
+    struct wl_cursor_theme *theme = wl_cursor_theme_load(manager->theme_name, size, manager->shm);
+    if (!theme) {
+        return NULL;
+    }
+    manager->themes[manager->theme_count].size = size;
+    manager->themes[manager->theme_count].theme = theme;
+    manager->theme_count++;
+    return theme;
+}
+
+struct cursor_pointer *cursor_pointer_create(struct cursor_manager *manager, struct wl_pointer *pointer) {
+    struct cursor_pointer *cursor = calloc(1, sizeof(*cursor));
+    if (!cursor) {
+        return NULL;
+    }
+    cursor->manager = manager;
+    cursor->pointer = pointer;
+    cursor->scale = 1;
+    if (manager->shape_manager) {
+        cursor->shape_device = wp_cursor_shape_manager_v1_get_pointer(manager->shape_manager, pointer);
+    }
+    return cursor;
+}
+
+static void stop_animation(struct cursor_pointer *cursor) {
+    if (cursor->frame) {
+        wl_callback_destroy(cursor->frame);
+        cursor->frame = NULL;
+    }
+    cursor->anim_started = 0;
+}
+
+void cursor_pointer_destroy(struct cursor_pointer *cursor) {
+    if (!cursor) {
+        return;
+    }
+    stop_animation(cursor);
+    if (cursor->shape_device) {
+        wp_cursor_shape_device_v1_destroy(cursor->shape_device);
+    }
+    if (cursor->surface) {
+        wl_surface_destroy(cursor->surface);
+    }
+    free(cursor);
+}
+
+static void attach_image(struct cursor_pointer *cursor, int index) {
+    struct wl_cursor_image *image = cursor->cursor->images[index];
+    // wl_cursor_image_get_buffer 会把 wl_buffer 缓存在图像上，只在第一次创建
+    wl_surface_attach(cursor->surface, wl_cursor_image_get_buffer(image), 0, 0);
+    // 表面坐标下的损坏；缩放大于 1 时会多报一些，对光标这么小的表面无所谓
+    wl_surface_damage(cursor->surface, 0, 0, image->width, image->height);
+}
+
+static const struct wl_callback_listener frame_listener;
+
+static void request_frame(struct cursor_pointer *cursor) {
+    cursor->frame = wl_surface_frame(cursor->surface);
+    wl_callback_add_listener(cursor->frame, &frame_listener, cursor);
+}
+
+static void frame_done(void *data, struct wl_callback *callback, uint32_t time) {
+    struct cursor_pointer *cursor = data;
+    wl_callback_destroy(callback);
+    cursor->frame = NULL;
+
+    if (!cursor->anim_started) {
+        cursor->anim_start = time;
+        cursor->anim_started = 1;
+    }
+    int index = wl_cursor_frame(cursor->cursor, time - cursor->anim_start);
+
+    // 图像没变时也重新提交并标记损坏：合成器空闲时不会重绘，
+    // 只挂帧回调不产生损坏的话，回调可能迟迟不来，动画就停住了
+    attach_image(cursor, index);
+    request_frame(cursor);
+    wl_surface_commit(cursor->surface);
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+static int show_theme_cursor(struct cursor_pointer *cursor, const char *name) {
+    struct cursor_manager *manager = cursor->manager;
+    struct wl_cursor_theme *theme = get_theme(manager, manager->size * cursor->scale);
+    if (!theme) {
+        return -1;
+    }
+
+    struct wl_cursor *wl_cursor = wl_cursor_theme_get_cursor(theme, name);
+    int entry = find_name(name);
+    if (!wl_cursor && entry >= 0) {
+        // 主题里可能只有 CSS 名或只有传统名，换另一个再找
+        const char *other = strcmp(cursor_names[entry].name, name) == 0
+                          ? cursor_names[entry].legacy : cursor_names[entry].name;
+        if (other) {
+            wl_cursor = wl_cursor_theme_get_cursor(theme, other);
+        }
+    }
+    if (!wl_cursor || wl_cursor->image_count == 0) {
+        return -1;
+    }
+
+    if (!cursor->surface) {
+        cursor->surface = wl_compositor_create_surface(manager->compositor);
+    }
+    stop_animation(cursor);
+    cursor->cursor = wl_cursor;
+
+    if (wl_surface_get_version(cursor->surface) >= WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION) {
+        wl_surface_set_buffer_scale(cursor->surface, cursor->scale);
+    }
+    attach_image(cursor, 0);
+    if (wl_cursor->image_count > 1) {
+        request_frame(cursor);
+    }
+    wl_surface_commit(cursor->surface);
+
+    struct wl_cursor_image *image = wl_cursor->images[0];
+    wl_pointer_set_cursor(cursor->pointer, cursor->serial, cursor->surface,
+                          image->hotspot_x / cursor->scale, image->hotspot_y / cursor->scale);
+    return 0;
+}
+
+int cursor_pointer_set(struct cursor_pointer *cursor, uint32_t serial, const char *name) {
+    cursor->serial = serial;
+
+    int entry = find_name(name);
+    if (cursor->shape_device && entry >= 0) {
+        // 形状由合成器自己绘制，客户端的光标表面不再需要
+        stop_animation(cursor);
+        cursor->cursor = NULL;
+        wp_cursor_shape_device_v1_set_shape(cursor->shape_device, serial, cursor_names[entry].shape);
+        return 0;
+    }
+
+    if (show_theme_cursor(cursor, name) < 0) {
+        return -1;
+    }
+    snprintf(cursor->name, sizeof(cursor->name), "%s", name);
+    return 0;
+}
+
+void cursor_pointer_set_scale(struct cursor_pointer *cursor, int scale) {
+    if (scale < 1 || scale == cursor->scale) {
+        return;
+    }
+    cursor->scale = scale;
+    // 形状协议下由合成器按输出缩放绘制，不用重新设置
+    if (cursor->cursor) {
+        show_theme_cursor(cursor, cursor->name);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <wayland-client.h>
+#include <wayland-cursor.h>
+
+// 光标管理：整个进程共用一个 cursor_manager，每个 wl_pointer 对应一个 cursor_pointer。
+// - 同一主题、同一像素尺寸只加载一次；每张光标图像的 wl_buffer 由 wayland-cursor
+//   在主题里缓存，重复设置同一光标不会再上传像素；
+// - 多帧光标（如 wait、progress）由光标表面的帧回调驱动动画，不使用定时器；
+// - 合成器支持 wp_cursor_shape_v1 时直接按名字请求形状，客户端完全不上传光标像素。
+// 光标名字用 CSS 名（"default"、"pointer"、"nwse-resize" 等），也接受传统的
+// X 光标名（"left_ptr"、"hand2"、"top_left_corner" 等），两者互为后备。
+
+struct wp_cursor_shape_manager_v1;
+struct wp_cursor_shape_device_v1;
+
+#define CURSOR_THEME_CACHE 4
+
+struct cursor_manager {
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct wp_cursor_shape_manager_v1 *shape_manager; // 可为 NULL
+    char *theme_name;
+    int size;
+
+    // 已加载的主题，按像素尺寸（size * scale）区分
+    struct {
+        int size;
+        struct wl_cursor_theme *theme;
+    } themes[CURSOR_THEME_CACHE];
+    int theme_count;
+};
+
+struct cursor_pointer {
+    struct cursor_manager *manager;
+    struct wl_pointer *pointer;
+    struct wp_cursor_shape_device_v1 *shape_device;
+    struct wl_surface *surface;
+    int scale;
+
+    uint32_t serial;             // 最近一次 enter 的 serial
+    char name[64];               // 当前主题光标的名字，缩放变化时按它重新加载
+    struct wl_cursor *cursor;    // 使用主题光标时有效
+    struct wl_callback *frame;   // 动画的帧回调
+    uint32_t anim_start;
+    int anim_started;
+};
+
+// 1. 创建与销毁。theme 为 NULL、size <= 0 时取 XCURSOR_THEME / XCURSOR_SIZE，默认 24
+struct cursor_manager *cursor_manager_create(struct wl_compositor *compositor, struct wl_shm *shm,
+                                             const char *theme, int size);
+void cursor_manager_destroy(struct cursor_manager *manager);
+
+// 2. 绑定到 wp_cursor_shape_manager_v1 后，之后创建的 cursor_pointer 优先使用形状协议
+void cursor_manager_set_shape_manager(struct cursor_manager *manager,
+                                      struct wp_cursor_shape_manager_v1 *shape_manager);
+
+// 3. 每个 wl_pointer 一个；pointer 仍由调用者销毁，要在 cursor_pointer_destroy 之后
+struct cursor_pointer *cursor_pointer_create(struct cursor_manager *manager, struct wl_pointer *pointer);
+void cursor_pointer_destroy(struct cursor_pointer *cursor);
+
+// 4. 在 wl_pointer.enter 或需要换形状时调用，serial 取最近一次 enter 的 serial。
+//    找不到这个光标时返回 -1，原来的光标保持不变
+int cursor_pointer_set(struct cursor_pointer *cursor, uint32_t serial, const char *name);
+
+// 5. 指针所在输出的缩放变化时调用，会按新的缩放重新设置当前光标
+void cursor_pointer_set_scale(struct cursor_pointer *cursor, int scale);
@@ -0,0 +1,151 @@
+#include "damage.h"
+#include <string.h>
+
+static int64_t rect_area(const struct damage_rect *r) {
+    return (int64_t)r->width * r->height;
+}
+
+static struct damage_rect rect_bounds(const struct damage_rect *a, const struct damage_rect *b) {
+    int32_t x0 = a->x < b->x ? a->x : b->x;
+    int32_t y0 = a->y < b->y ? a->y : b->y;
+    int32_t x1 = a->x + a->width > b->x + b->width ? a->x + a->width : b->x + b->width;
+    int32_t y1 = a->y + a->height > b->y + b->height ? a->y + a->height : b->y + b->height;
+    return (struct damage_rect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+static int64_t rect_overlap(const struct damage_rect *a, const struct damage_rect *b) {
+    int32_t x0 = a->x > b->x ? a->x : b->x;
+    int32_t y0 = a->y > b->y ? a->y : b->y;
+    int32_t x1 = a->x + a->width < b->x + b->width ? a->x + a->width : b->x + b->width;
+    int32_t y1 = a->y + a->height < b->y + b->height ? a->y + a->height : b->y + b->height;
+    if (x1 <= x0 || y1 <= y0) {
+        return 0;
+    }
+    return (int64_t)(x1 - x0) * (y1 - y0);
+}
+
+// 合并 a 与 b 时外接矩形多出来的面积；为 0 说明两者的并集恰好是一个矩形
+static int64_t merge_waste(const struct damage_rect *a, const struct damage_rect *b) {
+    struct damage_rect bounds = rect_bounds(a, b);
+    return rect_area(&bounds) - rect_area(a) - rect_area(b) + rect_overlap(a, b);
+}
+
+static void region_remove(struct damage_region *region, int index) {
+    region->rects[index] = region->rects[--region->count];
+}
+
+void damage_region_clear(struct damage_region *region) {
+    region->count = 0;
+}
+
+void damage_region_add(struct damage_region *region,
+                       int32_t x, int32_t y, int32_t width, int32_t height) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    struct damage_rect rect = { x, y, width, height };
+
+    // 不断吸收能无损合并的已有矩形，直到没有可合并的为止
+    for (int i = 0; i < region->count; ) {
+        if (merge_waste(&region->rects[i], &rect) == 0) {
+            rect = rect_bounds(&region->rects[i], &rect);
+            region_remove(region, i);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (region->count < DAMAGE_MAX_RECTS) {
+        region->rects[region->count++] = rect;
+        return;
+    }
+
+    // 列表已满：并入代价最小的一项。合并结果可能又与其他项重叠，但只会多报，不会漏报
+    int best = 0;
+    int64_t best_waste = INT64_MAX;
+    for (int i = 0; i < region->count; i++) {
+        int64_t waste = merge_waste(&region->rects[i], &rect);
+        if (waste < best_waste) {
+            best = i;
+            best_waste = waste;
+        }
+    }
+    rect = rect_bounds(&region->rects[best], &rect);
+    region_remove(region, best);
+    damage_region_add(region, rect.x, rect.y, rect.width, rect.height);
+}
+
+void damage_region_union(struct damage_region *dst, const struct damage_region *src) {
+    for (int i = 0; i < src->count; i++) {
+        const struct damage_rect *r = &src->rects[i];
+        damage_region_add(dst, r->x, r->y, r->width, r->height);
+    }
+}
+
+void damage_surface(struct wl_surface *surface,
+                    int32_t x, int32_t y, int32_t width, int32_t height) {
+    if (wl_proxy_get_version((struct wl_proxy *)surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+        wl_surface_damage_buffer(surface, x, y, width, height);
+    } else {
+        wl_surface_damage(surface, x, y, width, height);
+    }
+}
+
+void damage_tracker_init(struct damage_tracker *tracker, int32_t width, int32_t height) {
+    memset(tracker, 0, sizeof(*tracker));
+    damage_tracker_resize(tracker, width, height);
+}
+
+void damage_tracker_resize(struct damage_tracker *tracker, int32_t width, int32_t height) {
+    tracker->width = width;
+    tracker->height = height;
+    tracker->valid_since = tracker->frame + 1;
+    damage_region_clear(&tracker->pending);
+    damage_tracker_add_all(tracker);
+}
+
+void damage_tracker_add(struct damage_tracker *tracker,
+                        int32_t x, int32_t y, int32_t width, int32_t height) {
+    int32_t x1 = x + width, y1 = y + height;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x1 > tracker->width) x1 = tracker->width;
+    if (y1 > tracker->height) y1 = tracker->height;
+    damage_region_add(&tracker->pending, x, y, x1 - x, y1 - y);
+}
+
+void damage_tracker_add_all(struct damage_tracker *tracker) {
+    damage_tracker_add(tracker, 0, 0, tracker->width, tracker->height);
+}
+
+void damage_tracker_repaint(const struct damage_tracker *tracker, uint64_t buffer_frame,
+                            struct damage_region *out) {
+    damage_region_clear(out);
+
+    // 缓冲区里是 buffer_frame 帧的内容，缺的是之后每一帧的变化再加上本帧的变化
+    uint64_t age = tracker->frame - buffer_frame;
+    if (buffer_frame == 0 || buffer_frame < tracker->valid_since || age > DAMAGE_HISTORY) {
+        damage_region_add(out, 0, 0, tracker->width, tracker->height);
+        return;
+    }
+
+    damage_region_union(out, &tracker->pending);
+    for (uint64_t i = 0; i < age; i++) {
+        damage_region_union(out, &tracker->history[i]);
+    }
+}
+
+uint64_t damage_tracker_commit(struct damage_tracker *tracker, struct wl_surface *surface) {
+    const struct damage_region *pending = &tracker->pending;
+    for (int i = 0; surface && i < pending->count; i++) {
+        const struct damage_rect *r = &pending->rects[i];
+        damage_surface(surface, r->x, r->y, r->width, r->height);
+    }
+
+    memmove(&tracker->history[1], &tracker->history[0],
+            (DAMAGE_HISTORY - 1) * sizeof(struct damage_region));
+    tracker->history[0] = *pending;
+    damage_region_clear(&tracker->pending);
+    return ++tracker->frame;
+}
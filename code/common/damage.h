@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <wayland-client.h>
+
+// 损坏区域跟踪：只把真正变化的矩形报告给合成器，
+// 合成器只需重新上传、重新合成这些区域。
+// 所有坐标都是缓冲区坐标。
+
+// 1. 矩形列表：加入时合并被包含或能拼成一个矩形的项，
+//    超出容量时并入使外接矩形增长最小的一项
+#define DAMAGE_MAX_RECTS 32
+
+struct damage_rect {
+    int32_t x, y, width, height;
+};
+
+struct damage_region {
+    int count;
+    struct damage_rect rects[DAMAGE_MAX_RECTS];
+};
+
+void damage_region_clear(struct damage_region *region);
+void damage_region_add(struct damage_region *region,
+                       int32_t x, int32_t y, int32_t width, int32_t height);
+void damage_region_union(struct damage_region *dst, const struct damage_region *src);
+
+// 2. 向 surface 报告一个矩形。wl_surface 版本 >= 4 时使用 damage_buffer，
+//    否则退回到 wl_surface_damage（要求 buffer scale 为 1 且没有变换）
+void damage_surface(struct wl_surface *surface,
+                    int32_t x, int32_t y, int32_t width, int32_t height);
+
+// 3. 多缓冲下的损坏累积器。
+//    每个缓冲区记住自己上次提交时的帧号；重新绘制它时，
+//    只需重画从那以后所有帧的损坏之和（即 buffer age 的做法）
+#define DAMAGE_HISTORY 4
+
+struct damage_tracker {
+    int32_t width, height;
+    uint64_t frame;       // 已提交的帧数，第一帧为 1
+    uint64_t valid_since; // 尺寸变化后的第一帧，更早的缓冲区内容全部作废
+    struct damage_region pending;                 // 本帧新增的损坏
+    struct damage_region history[DAMAGE_HISTORY]; // history[i]：倒数第 i + 1 帧的损坏
+};
+
+void damage_tracker_init(struct damage_tracker *tracker, int32_t width, int32_t height);
+
+// 尺寸变化：整个表面失效
+void damage_tracker_resize(struct damage_tracker *tracker, int32_t width, int32_t height);
+
+// 标记本帧的变化，超出表面的部分会被裁掉
+void damage_tracker_add(struct damage_tracker *tracker,
+                        int32_t x, int32_t y, int32_t width, int32_t height);
+void damage_tracker_add_all(struct damage_tracker *tracker);
+
+// 计算上次在 buffer_frame 帧提交过的缓冲区需要重画的区域；
+// buffer_frame 为 0（新缓冲区）或历史不够长时返回整个表面
+void damage_tracker_repaint(const struct damage_tracker *tracker, uint64_t buffer_frame,
+                            struct damage_region *out);
+
+// 在 attach 之后、commit 之前调用：报告本帧的损坏并滚动历史。
+// surface 为 NULL 时只滚动历史，损坏由调用者自己报告（例如 eglSwapBuffersWithDamage）。
+// 返回本帧帧号，调用者把它记在刚提交的缓冲区上
+uint64_t damage_tracker_commit(struct damage_tracker *tracker, struct wl_surface *surface);
@@ -0,0 +1,275 @@
+#include "egl_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Mesa 在 Wayland 上把 EGL_NATIVE_VISUAL_ID 设为 DRM 格式码
+#define FOURCC_XRGB8888 0x34325258 // 'XR24'
+#define FOURCC_ARGB8888 0x34325241 // 'AR24'
+
+#define CACHE_LINE_MAX 512
+
+static EGLint get_attrib(EGLDisplay display, EGLConfig config, EGLint attrib) {
+    EGLint value = 0;
+    eglGetConfigAttrib(display, config, attrib, &value);
+    return value;
+}
+
+int egl_config_score(EGLDisplay display, EGLConfig config,
+                     const struct egl_config_request *request) {
+    if (!(get_attrib(display, config, EGL_SURFACE_TYPE) & EGL_WINDOW_BIT) ||
+        !(get_attrib(display, config, EGL_RENDERABLE_TYPE) & EGL_OPENGL_ES2_BIT) ||
+        get_attrib(display, config, EGL_COLOR_BUFFER_TYPE) != EGL_RGB_BUFFER) {
+        return -1;
+    }
+
+    EGLint red = get_attrib(display, config, EGL_RED_SIZE);
+    EGLint green = get_attrib(display, config, EGL_GREEN_SIZE);
+    EGLint blue = get_attrib(display, config, EGL_BLUE_SIZE);
+    EGLint alpha = get_attrib(display, config, EGL_ALPHA_SIZE);
+    EGLint depth = get_attrib(display, config, EGL_DEPTH_SIZE);
+    EGLint stencil = get_attrib(display, config, EGL_STENCIL_SIZE);
+    EGLint samples = get_attrib(display, config, EGL_SAMPLES);
+    if (red != 8 || green != 8 || blue != 8 ||
+        (request->alpha && alpha < 8) ||
+        depth < request->depth_size || stencil < request->stencil_size ||
+        samples < request->samples) {
+        return -1;
+    }
+
+    int score = 1000;
+    // 不需要的 alpha 让合成器多做一次混合判断，也多占带宽
+    if (!request->alpha && alpha > 0) {
+        score -= 100;
+    }
+    if (request->alpha && alpha > 8) {
+        score -= 100;
+    }
+    // 多余的深度/模板缓冲、多重采样都是白白分配和清除的内存
+    score -= (depth - request->depth_size) * 4;
+    score -= (stencil - request->stencil_size) * 4;
+    score -= (samples - request->samples) * 50;
+
+    // 与 wl_buffer 格式一致时合成器可以直接使用，不用转换
+    EGLint visual = get_attrib(display, config, EGL_NATIVE_VISUAL_ID);
+    if (visual == (request->alpha ? FOURCC_ARGB8888 : FOURCC_XRGB8888)) {
+        score += 10;
+    }
+
+    EGLint caveat = get_attrib(display, config, EGL_CONFIG_CAVEAT);
+    if (caveat == EGL_SLOW_CONFIG) {
+        score -= 500;
+    } else if (caveat == EGL_NON_CONFORMANT_CONFIG) {
+        score -= 200;
+    }
+    return score > 0 ? score : 0;
+}
+
+EGLConfig egl_config_choose(EGLDisplay display, const struct egl_config_request *request) {
+    // 先让驱动按硬性要求过滤，只给剩下的配置打分
+    const EGLint attribs[] = {
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, request->alpha ? 8 : 0,
+        EGL_DEPTH_SIZE, request->depth_size,
+        EGL_STENCIL_SIZE, request->stencil_size,
+        EGL_SAMPLES, request->samples,
+        EGL_NONE
+    };
+
+    EGLint count = 0;
+    if (!eglChooseConfig(display, attribs, NULL, 0, &count) || count <= 0) {
+        return NULL;
+    }
+    EGLConfig *configs = calloc(count, sizeof(EGLConfig));
+    if (!configs) {
+        return NULL;
+    }
+    eglChooseConfig(display, attribs, configs, count, &count);
+
+    EGLConfig best = NULL;
+    int best_score = -1;
+    for (int i = 0; i < count; i++) {
+        int score = egl_config_score(display, configs[i], request);
+        if (score > best_score) {
+            best = configs[i];
+            best_score = score;
+        }
+    }
+    free(configs);
+    return best;
+}
+
+// 缓存里和 ID 一起保存的配置属性，取回时逐项比对
+struct cache_entry {
+    EGLint id;
+    int score;
+    EGLint alpha, depth, stencil, samples, visual;
+};
+
+typedef const char *(*get_driver_name_fn)(EGLDisplay display);
+
+static bool has_extension(const char *extensions, const char *name) {
+    size_t len = strlen(name);
+    for (const char *p = extensions; p && (p = strstr(p, name)); p += len) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 实际使用的驱动。Mesa 的 EGL_VENDOR/EGL_VERSION 对 llvmpipe 和所有硬件驱动
+// 都一样，只能靠 EGL_MESA_query_driver 区分；没有这个扩展时返回空串
+static const char *driver_name(EGLDisplay display) {
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!has_extension(extensions, "EGL_MESA_query_driver")) {
+        return "";
+    }
+    get_driver_name_fn get_driver_name =
+        (get_driver_name_fn)eglGetProcAddress("eglGetDisplayDriverName");
+    const char *name = get_driver_name ? get_driver_name(display) : NULL;
+    return name ? name : "";
+}
+
+// 缓存的键：同一个驱动、同样的请求才能复用 config ID
+static void cache_key(EGLDisplay display, const struct egl_config_request *request,
+                      char *key, size_t size) {
+    const char *vendor = eglQueryString(display, EGL_VENDOR);
+    const char *version = eglQueryString(display, EGL_VERSION);
+    snprintf(key, size, "%s|%s|%s|a%d d%d s%d m%d", vendor ? vendor : "", version ? version : "",
+             driver_name(display),
+             request->alpha, request->depth_size, request->stencil_size, request->samples);
+    // 键和属性之间用制表符分隔，键里不能出现
+    for (char *p = key; *p; p++) {
+        if (*p == '\t' || *p == '\n') {
+            *p = ' ';
+        }
+    }
+}
+
+static void describe_config(EGLDisplay display, EGLConfig config,
+                            const struct egl_config_request *request, struct cache_entry *entry) {
+    entry->id = get_attrib(display, config, EGL_CONFIG_ID);
+    entry->score = egl_config_score(display, config, request);
+    entry->alpha = get_attrib(display, config, EGL_ALPHA_SIZE);
+    entry->depth = get_attrib(display, config, EGL_DEPTH_SIZE);
+    entry->stencil = get_attrib(display, config, EGL_STENCIL_SIZE);
+    entry->samples = get_attrib(display, config, EGL_SAMPLES);
+    entry->visual = get_attrib(display, config, EGL_NATIVE_VISUAL_ID);
+}
+
+// 缓存文件路径；目录不存在时 create 为 true 则创建
+static int cache_path(char *path, size_t size, bool create) {
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+    if (base && *base) {
+        n = snprintf(path, size, "%s/wayland-demo", base);
+    } else if (home && *home) {
+        n = snprintf(path, size, "%s/.cache/wayland-demo", home);
+    } else {
+        return -1;
+    }
+    if (n < 0 || (size_t)n >= size) {
+        return -1;
+    }
+    if (create) {
+        // 父目录 ~/.cache 一般已经存在，不存在时放弃缓存即可
+        mkdir(path, 0700);
+    }
+    n = snprintf(path + n, size - n, "/egl-config");
+    return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+// 找到键对应的一行并解析出属性，没有或格式不对时返回 -1
+static int cache_lookup(const char *key, struct cache_entry *entry) {
+    char path[CACHE_LINE_MAX], line[CACHE_LINE_MAX];
+    if (cache_path(path, sizeof(path), false) < 0) {
+        return -1;
+    }
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+
+    int found = -1;
+    size_t len = strlen(key);
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, key, len) == 0 && line[len] == '\t') {
+            if (sscanf(line + len + 1, "%d %d %d %d %d %d %d", &entry->id, &entry->score,
+                       &entry->alpha, &entry->depth, &entry->stencil, &entry->samples,
+                       &entry->visual) == 7) {
+                found = 0;
+            }
+            break;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+// 重写缓存文件：保留其它键的行，替换这个键的行。先写临时文件再改名，
+// 同时启动的两个进程不会读到写了一半的文件
+static void cache_store(const char *key, const struct cache_entry *entry) {
+    char path[CACHE_LINE_MAX], tmp[CACHE_LINE_MAX + 8], line[CACHE_LINE_MAX];
+    if (cache_path(path, sizeof(path), true) < 0) {
+        return;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        return;
+    }
+
+    size_t len = strlen(key);
+    FILE *in = fopen(path, "r");
+    if (in) {
+        while (fgets(line, sizeof(line), in)) {
+            if (!(strncmp(line, key, len) == 0 && line[len] == '\t')) {
+                fputs(line, out);
+            }
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s\t%d %d %d %d %d %d %d\n", key, entry->id, entry->score,
+            entry->alpha, entry->depth, entry->stencil, entry->samples, entry->visual);
+
+    if (fclose(out) != 0 || rename(tmp, path) < 0) {
+        remove(tmp);
+    }
+}
+
+EGLConfig egl_config_choose_cached(EGLDisplay display, const struct egl_config_request *request) {
+    char key[CACHE_LINE_MAX - 64];
+    cache_key(display, request, key, sizeof(key));
+
+    struct cache_entry cached;
+    if (cache_lookup(key, &cached) == 0 && cached.id > 0 && cached.score >= 0) {
+        const EGLint attribs[] = { EGL_CONFIG_ID, cached.id, EGL_NONE };
+        EGLConfig config;
+        EGLint count = 0;
+        // 驱动换了或升级后 ID 可能指向别的配置：得分和关键属性与保存时
+        // 完全一致才使用，否则重新枚举
+        if (eglChooseConfig(display, attribs, &config, 1, &count) && count == 1) {
+            struct cache_entry current;
+            describe_config(display, config, request, &current);
+            if (memcmp(&current, &cached, sizeof(current)) == 0) {
+                return config;
+            }
+        }
+    }
+
+    EGLConfig config = egl_config_choose(display, request);
+    if (config) {
+        struct cache_entry entry;
+        describe_config(display, config, request, &entry);
+        cache_store(key, &entry);
+    }
+    return config;
+}
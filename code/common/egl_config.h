@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <EGL/egl.h>
+
+// EGL 配置选择：给每个候选配置打分，挑出最合适的一个，而不是拿 eglChooseConfig
+// 排序后的第一个（它按颜色位数从多到少排，往往带着用不到的 alpha、深度或多重采样）。
+// - 硬性要求：窗口表面、GLES2、RGB 各 8 位，请求的 alpha/深度/模板位数要够；
+// - 与请求完全一致的格式最好：不要 alpha 时 XRGB8888 优于 ARGB8888，
+//   多出来的深度、模板和多重采样都扣分，慢速或不一致的配置排在最后。
+// 选出的配置按 config ID 缓存在 $XDG_CACHE_HOME/wayland-demo/egl-config，
+// 以驱动（EGL vendor + version，再加上 EGL_MESA_query_driver 给出的驱动名）
+// 和请求为键，同时记下它的得分和 alpha/深度/模板/采样/visual。下次启动只需
+// 按 ID 取回这一个配置，得分和属性都对得上才用，否则重新枚举。
+
+struct egl_config_request {
+    bool alpha;           // 需要 alpha 通道（ARGB8888），否则选 XRGB8888
+    int depth_size;       // 需要的深度位数，0 表示不要深度缓冲
+    int stencil_size;     // 需要的模板位数，0 表示不要
+    int samples;          // 多重采样数，0 表示不要
+};
+
+// 1. 给一个配置打分，越高越好；不满足硬性要求时返回 -1
+int egl_config_score(EGLDisplay display, EGLConfig config,
+                     const struct egl_config_request *request);
+
+// 2. 枚举满足要求的配置并挑出得分最高的，没有时返回 NULL
+EGLConfig egl_config_choose(EGLDisplay display, const struct egl_config_request *request);
+
+// 3. 先试缓存的 config ID，缓存缺失或失效时回到 egl_config_choose 并更新缓存
+EGLConfig egl_config_choose_cached(EGLDisplay display, const struct egl_config_request *request);
@@ -0,0 +1,331 @@
+#define _GNU_SOURCE
+#include "event_loop.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 32
+
+enum event_source_type {
+    EVENT_SOURCE_FD,
+    EVENT_SOURCE_TIMER,
+    EVENT_SOURCE_SIGNAL,
+    EVENT_SOURCE_IDLE,
+    EVENT_SOURCE_WAYLAND,
+};
+
+struct event_source {
+    struct event_loop *loop;
+    enum event_source_type type;
+    int fd;                      // 注册到 epoll 的描述符，空闲回调为 -1
+    union {
+        event_fd_fn fd;
+        event_timer_fn timer;
+        event_signal_fn signal;
+        event_idle_fn idle;
+    } fn;
+    void *data;
+    int signo;
+    struct wl_display *display;
+    bool removed;
+    struct event_source *next;   // 所有事件源串成一条链表
+};
+
+struct event_loop {
+    int epoll_fd;
+    struct event_source *sources;
+    struct event_source *wayland;
+    int idle_count;
+    int dispatching;
+};
+
+static struct event_source *add_source(struct event_loop *loop, enum event_source_type type,
+                                       int fd, uint32_t events, void *data) {
+    struct event_source *source = calloc(1, sizeof(*source));
+    if (source == NULL) {
+        return NULL;
+    }
+    source->loop = loop;
+    source->type = type;
+    source->fd = fd;
+    source->data = data;
+
+    if (fd >= 0) {
+        struct epoll_event ev = { .events = events, .data.ptr = source };
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            free(source);
+            return NULL;
+        }
+    }
+
+    source->next = loop->sources;
+    loop->sources = source;
+    return source;
+}
+
+static void free_source(struct event_source *source) {
+    if (source->type == EVENT_SOURCE_TIMER || source->type == EVENT_SOURCE_SIGNAL) {
+        close(source->fd);
+    }
+    if (source->type == EVENT_SOURCE_SIGNAL) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, source->signo);
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    }
+    free(source);
+}
+
+// 回调执行期间 epoll 返回的其它事件仍可能指向被移除的事件源，
+// 所以移除时只做标记，等这一轮分发结束后再统一释放
+static void collect_removed(struct event_loop *loop) {
+    struct event_source **link = &loop->sources;
+    while (*link) {
+        struct event_source *source = *link;
+        if (source->removed) {
+            *link = source->next;
+            free_source(source);
+        } else {
+            link = &source->next;
+        }
+    }
+}
+
+struct event_loop *event_loop_create(void) {
+    struct event_loop *loop = calloc(1, sizeof(*loop));
+    if (loop == NULL) {
+        return NULL;
+    }
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+void event_loop_destroy(struct event_loop *loop) {
+    if (loop == NULL) {
+        return;
+    }
+    while (loop->sources) {
+        struct event_source *source = loop->sources;
+        loop->sources = source->next;
+        free_source(source);
+    }
+    close(loop->epoll_fd);
+    free(loop);
+}
+
+struct event_source *event_loop_add_fd(struct event_loop *loop, int fd, uint32_t events,
+                                       event_fd_fn fn, void *data) {
+    struct event_source *source = add_source(loop, EVENT_SOURCE_FD, fd, events, data);
+    if (source) {
+        source->fn.fd = fn;
+    }
+    return source;
+}
+
+int event_source_fd_update(struct event_source *source, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.ptr = source };
+    return epoll_ctl(source->loop->epoll_fd, EPOLL_CTL_MOD, source->fd, &ev);
+}
+
+struct event_source *event_loop_add_timer(struct event_loop *loop, event_timer_fn fn, void *data) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct event_source *source = add_source(loop, EVENT_SOURCE_TIMER, fd, EPOLLIN, data);
+    if (source == NULL) {
+        close(fd);
+        return NULL;
+    }
+    source->fn.timer = fn;
+    return source;
+}
+
+int event_source_timer_update(struct event_source *source, int delay, int interval) {
+    struct itimerspec its = {
+        .it_value = { delay / 1000, (long)(delay % 1000) * 1000000 },
+        .it_interval = { interval / 1000, (long)(interval % 1000) * 1000000 },
+    };
+    return timerfd_settime(source->fd, 0, &its, NULL);
+}
+
+struct event_source *event_loop_add_signal(struct event_loop *loop, int signo,
+                                           event_signal_fn fn, void *data) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+
+    int fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct event_source *source = add_source(loop, EVENT_SOURCE_SIGNAL, fd, EPOLLIN, data);
+    if (source == NULL) {
+        close(fd);
+        return NULL;
+    }
+    source->fn.signal = fn;
+    source->signo = signo;
+    // 屏蔽后信号只会排队等 signalfd 读取，不再打断当前线程
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    return source;
+}
+
+struct event_source *event_loop_add_idle(struct event_loop *loop, event_idle_fn fn, void *data) {
+    struct event_source *source = add_source(loop, EVENT_SOURCE_IDLE, -1, 0, data);
+    if (source) {
+        source->fn.idle = fn;
+        loop->idle_count++;
+    }
+    return source;
+}
+
+struct event_source *event_loop_add_wayland(struct event_loop *loop, struct wl_display *display) {
+    struct event_source *source =
+        add_source(loop, EVENT_SOURCE_WAYLAND, wl_display_get_fd(display), EPOLLIN, NULL);
+    if (source) {
+        source->display = display;
+        loop->wayland = source;
+    }
+    return source;
+}
+
+void event_source_remove(struct event_source *source) {
+    if (source == NULL || source->removed) {
+        return;
+    }
+    struct event_loop *loop = source->loop;
+
+    source->removed = true;
+    if (source->fd >= 0) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    }
+    if (source->type == EVENT_SOURCE_IDLE) {
+        loop->idle_count--;
+    }
+    if (loop->wayland == source) {
+        loop->wayland = NULL;
+    }
+    if (!loop->dispatching) {
+        collect_removed(loop);
+    }
+}
+
+static void run_idles(struct event_loop *loop) {
+    // 只运行本轮开始前已有的空闲回调，回调里新加的留到下一轮
+    for (struct event_source *source = loop->sources; source; source = source->next) {
+        if (source->type == EVENT_SOURCE_IDLE && !source->removed) {
+            event_source_remove(source);
+            source->fn.idle(source->data);
+        }
+    }
+}
+
+// 声明读意图并把请求发出去；写缓冲区满时额外等待可写
+static int prepare_wayland(struct event_source *source) {
+    while (wl_display_prepare_read(source->display) != 0) {
+        if (wl_display_dispatch_pending(source->display) < 0) {
+            return -1;
+        }
+    }
+
+    uint32_t events = EPOLLIN;
+    if (wl_display_flush(source->display) < 0) {
+        if (errno != EAGAIN) {
+            wl_display_cancel_read(source->display);
+            return -1;
+        }
+        events |= EPOLLOUT;
+    }
+    event_source_fd_update(source, events);
+    return 0;
+}
+
+static void dispatch_source(struct event_source *source, uint32_t events) {
+    switch (source->type) {
+    case EVENT_SOURCE_FD:
+        source->fn.fd(source->data, source->fd, events);
+        break;
+    case EVENT_SOURCE_TIMER: {
+        uint64_t expirations;
+        if (read(source->fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            source->fn.timer(source->data);
+        }
+        break;
+    }
+    case EVENT_SOURCE_SIGNAL: {
+        struct signalfd_siginfo info;
+        while (read(source->fd, &info, sizeof(info)) == sizeof(info)) {
+            source->fn.signal(source->data, (int)info.ssi_signo);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+int event_loop_dispatch(struct event_loop *loop, int timeout) {
+    loop->dispatching++;
+    run_idles(loop);
+
+    struct event_source *wayland = loop->wayland;
+    if (wayland && prepare_wayland(wayland) < 0) {
+        loop->dispatching--;
+        collect_removed(loop);
+        return -1;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, loop->idle_count ? 0 : timeout);
+    if (count < 0 && errno != EINTR) {
+        if (wayland) {
+            wl_display_cancel_read(wayland->display);
+        }
+        loop->dispatching--;
+        collect_removed(loop);
+        return -1;
+    }
+
+    // Wayland 的读意图必须在其它回调之前了结：回调里可能会 roundtrip，
+    // 持有读意图时那会永远等不到事件
+    int ret = 0;
+    if (wayland) {
+        bool readable = false;
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == wayland && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                readable = true;
+            }
+        }
+        if (readable) {
+            if (wl_display_read_events(wayland->display) < 0) {
+                ret = -1;
+            }
+        } else {
+            wl_display_cancel_read(wayland->display);
+        }
+        if (ret == 0 && wl_display_dispatch_pending(wayland->display) < 0) {
+            ret = -1;
+        }
+    }
+
+    for (int i = 0; ret == 0 && i < count; i++) {
+        struct event_source *source = events[i].data.ptr;
+        if (source != wayland && !source->removed) {
+            dispatch_source(source, events[i].events);
+        }
+    }
+
+    loop->dispatching--;
+    collect_removed(loop);
+    return ret;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <wayland-client.h>
+
+// 基于 epoll 的事件循环：一个 epoll 实例统一等待 Wayland 连接、
+// 任意文件描述符、timerfd 定时器和 signalfd 信号，空闲时完全阻塞，不占 CPU。
+// 所有回调都在 event_loop_dispatch 所在的线程中执行。
+
+struct event_loop;
+struct event_source;
+
+typedef void (*event_fd_fn)(void *data, int fd, uint32_t events);
+typedef void (*event_timer_fn)(void *data);
+typedef void (*event_signal_fn)(void *data, int signo);
+typedef void (*event_idle_fn)(void *data);
+
+// 1. 创建与销毁（销毁时一并释放尚未移除的事件源）
+struct event_loop *event_loop_create(void);
+void event_loop_destroy(struct event_loop *loop);
+
+// 2. 文件描述符：events 为 EPOLLIN/EPOLLOUT 的组合，事件源不接管 fd
+struct event_source *event_loop_add_fd(struct event_loop *loop, int fd, uint32_t events,
+                                       event_fd_fn fn, void *data);
+int event_source_fd_update(struct event_source *source, uint32_t events);
+
+// 3. 定时器：创建后处于停止状态，delay 毫秒后首次触发，之后每 interval 毫秒触发一次；
+//    interval 为 0 表示只触发一次，delay 为 0 表示停止
+struct event_source *event_loop_add_timer(struct event_loop *loop, event_timer_fn fn, void *data);
+int event_source_timer_update(struct event_source *source, int delay, int interval);
+
+// 4. 信号：通过 signalfd 接收，添加时会在当前线程屏蔽该信号
+struct event_source *event_loop_add_signal(struct event_loop *loop, int signo,
+                                           event_signal_fn fn, void *data);
+
+// 5. 空闲回调：只执行一次，在下一次阻塞等待之前运行
+struct event_source *event_loop_add_idle(struct event_loop *loop, event_idle_fn fn, void *data);
+
+// 6. Wayland 连接：每次等待前按 prepare_read/flush 的顺序准备，
+//    等待后 read_events/cancel_read，再 dispatch_pending，先于其它回调处理
+struct event_source *event_loop_add_wayland(struct event_loop *loop, struct wl_display *display);
+
+// 7. 移除事件源，可以在任何回调中调用
+void event_source_remove(struct event_source *source);
+
+// 8. 等待并分发一轮事件，timeout 为毫秒，-1 表示一直等待。出错返回 -1
+int event_loop_dispatch(struct event_loop *loop, int timeout);
@@ -0,0 +1,167 @@
+#include "event_loop_dbus.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct dbus_context {
+    struct event_loop *loop;
+    DBusConnection *conn;
+    bool dispatch_scheduled;
+};
+
+// libdbus 会为同一个 socket 分别添加读、写两个 watch，
+// 而 epoll 不允许重复注册同一个 fd，所以每个 watch 使用 dup 出来的描述符
+struct watch_source {
+    struct event_source *source;
+    int fd;
+};
+
+static uint32_t watch_events(DBusWatch *watch) {
+    if (!dbus_watch_get_enabled(watch)) {
+        return 0;
+    }
+    unsigned int flags = dbus_watch_get_flags(watch);
+    uint32_t events = 0;
+    if (flags & DBUS_WATCH_READABLE) {
+        events |= EPOLLIN;
+    }
+    if (flags & DBUS_WATCH_WRITABLE) {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+
+static void watch_ready(void *data, int fd, uint32_t events) {
+    unsigned int flags = 0;
+    if (events & EPOLLIN) {
+        flags |= DBUS_WATCH_READABLE;
+    }
+    if (events & EPOLLOUT) {
+        flags |= DBUS_WATCH_WRITABLE;
+    }
+    if (events & EPOLLERR) {
+        flags |= DBUS_WATCH_ERROR;
+    }
+    if (events & EPOLLHUP) {
+        flags |= DBUS_WATCH_HANGUP;
+    }
+    dbus_watch_handle(data, flags);
+}
+
+static dbus_bool_t add_watch(DBusWatch *watch, void *data) {
+    struct dbus_context *ctx = data;
+    struct watch_source *ws = calloc(1, sizeof(*ws));
+    if (ws == NULL) {
+        return FALSE;
+    }
+    ws->fd = dup(dbus_watch_get_unix_fd(watch));
+    if (ws->fd < 0) {
+        free(ws);
+        return FALSE;
+    }
+    ws->source = event_loop_add_fd(ctx->loop, ws->fd, watch_events(watch), watch_ready, watch);
+    if (ws->source == NULL) {
+        close(ws->fd);
+        free(ws);
+        return FALSE;
+    }
+    dbus_watch_set_data(watch, ws, NULL);
+    return TRUE;
+}
+
+static void remove_watch(DBusWatch *watch, void *data) {
+    struct watch_source *ws = dbus_watch_get_data(watch);
+    if (ws == NULL) {
+        return;
+    }
+    dbus_watch_set_data(watch, NULL, NULL);
+    event_source_remove(ws->source);
+    close(ws->fd);
+    free(ws);
+}
+
+static void toggle_watch(DBusWatch *watch, void *data) {
+    struct watch_source *ws = dbus_watch_get_data(watch);
+    if (ws) {
+        event_source_fd_update(ws->source, watch_events(watch));
+    }
+}
+
+static void timeout_ready(void *data) {
+    dbus_timeout_handle(data);
+}
+
+static void arm_timeout(DBusTimeout *timeout, struct event_source *source) {
+    // libdbus 的 timeout 在启用期间按间隔反复触发
+    int interval = dbus_timeout_get_enabled(timeout) ? dbus_timeout_get_interval(timeout) : 0;
+    event_source_timer_update(source, interval, interval);
+}
+
+static dbus_bool_t add_timeout(DBusTimeout *timeout, void *data) {
+    struct dbus_context *ctx = data;
+    struct event_source *source = event_loop_add_timer(ctx->loop, timeout_ready, timeout);
+    if (source == NULL) {
+        return FALSE;
+    }
+    dbus_timeout_set_data(timeout, source, NULL);
+    arm_timeout(timeout, source);
+    return TRUE;
+}
+
+static void remove_timeout(DBusTimeout *timeout, void *data) {
+    struct event_source *source = dbus_timeout_get_data(timeout);
+    dbus_timeout_set_data(timeout, NULL, NULL);
+    event_source_remove(source);
+}
+
+static void toggle_timeout(DBusTimeout *timeout, void *data) {
+    struct event_source *source = dbus_timeout_get_data(timeout);
+    if (source) {
+        arm_timeout(timeout, source);
+    }
+}
+
+static void dispatch_idle(void *data) {
+    struct dbus_context *ctx = data;
+    ctx->dispatch_scheduled = false;
+    while (dbus_connection_dispatch(ctx->conn) == DBUS_DISPATCH_DATA_REMAINS) {
+    }
+}
+
+// 连接的接收队列里有完整消息时调用；消息可能在阻塞调用中被顺带读入，
+// socket 上不一定再有可读事件，所以放到空闲回调里分发
+static void schedule_dispatch(struct dbus_context *ctx) {
+    if (!ctx->dispatch_scheduled &&
+        event_loop_add_idle(ctx->loop, dispatch_idle, ctx) != NULL) {
+        ctx->dispatch_scheduled = true;
+    }
+}
+
+static void dispatch_status(DBusConnection *conn, DBusDispatchStatus status, void *data) {
+    if (status == DBUS_DISPATCH_DATA_REMAINS) {
+        schedule_dispatch(data);
+    }
+}
+
+int event_loop_add_dbus(struct event_loop *loop, DBusConnection *conn) {
+    struct dbus_context *ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        return -1;
+    }
+    ctx->loop = loop;
+    ctx->conn = conn;
+
+    // ctx 由分发状态回调的 free 函数负责释放，另外两组回调只借用它
+    dbus_connection_set_dispatch_status_function(conn, dispatch_status, ctx, free);
+    if (!dbus_connection_set_watch_functions(conn, add_watch, remove_watch, toggle_watch,
+                                             ctx, NULL) ||
+        !dbus_connection_set_timeout_functions(conn, add_timeout, remove_timeout, toggle_timeout,
+                                               ctx, NULL)) {
+        return -1;
+    }
+
+    if (dbus_connection_get_dispatch_status(conn) == DBUS_DISPATCH_DATA_REMAINS) {
+        schedule_dispatch(ctx);
+    }
+    return 0;
+}
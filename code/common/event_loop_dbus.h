@@ -0,0 +1,10 @@
+#pragma once
+
+#include <dbus/dbus.h>
+
+#include "event_loop.h"
+
+// 把 D-Bus 连接挂到 event_loop 上：连接的 watch 变成 fd 事件源，
+// timeout 变成定时器，收到的消息在空闲回调里分发，不再需要轮询。
+// 成功返回 0。连接存活期间事件循环必须一直有效。
+int event_loop_add_dbus(struct event_loop *loop, DBusConnection *conn);
@@ -0,0 +1,240 @@
+#include "fill.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILL_HAVE_X86 1
+#endif
+
+static inline uint32_t *row_at(void *data, int stride, int y) {
+    return (uint32_t *)((unsigned char *)data + (size_t)y * stride);
+}
+
+static void fill_span_scalar(uint32_t *dst, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+#ifdef FILL_HAVE_X86
+__attribute__((target("sse2")))
+static void fill_span_sse2(uint32_t *dst, size_t count, uint32_t color) {
+    // 先用标量写到 16 字节对齐，再整块写入
+    while (count > 0 && ((uintptr_t)dst & 15)) {
+        *dst++ = color;
+        count--;
+    }
+    __m128i v = _mm_set1_epi32((int)color);
+    for (; count >= 4; count -= 4, dst += 4) {
+        _mm_store_si128((__m128i *)dst, v);
+    }
+    fill_span_scalar(dst, count, color);
+}
+
+__attribute__((target("avx2")))
+static void fill_span_avx2(uint32_t *dst, size_t count, uint32_t color) {
+    while (count > 0 && ((uintptr_t)dst & 31)) {
+        *dst++ = color;
+        count--;
+    }
+    __m256i v = _mm256_set1_epi32((int)color);
+    for (; count >= 16; count -= 16, dst += 16) {
+        _mm256_store_si256((__m256i *)dst, v);
+        _mm256_store_si256((__m256i *)(dst + 8), v);
+    }
+    for (; count >= 8; count -= 8, dst += 8) {
+        _mm256_store_si256((__m256i *)dst, v);
+    }
+    fill_span_scalar(dst, count, color);
+}
+#endif
+
+// 超过这个大小的复制改用非临时存储，大致相当于常见的 L2 缓存容量
+#define FILL_STREAM_THRESHOLD (1 << 20)
+
+static void copy_span_scalar(uint32_t *dst, const uint32_t *src, size_t count) {
+    memcpy(dst, src, count * sizeof(uint32_t));
+}
+
+#ifdef FILL_HAVE_X86
+__attribute__((target("sse2")))
+static void copy_span_stream(uint32_t *dst, const uint32_t *src, size_t count) {
+    // 非临时存储要求 16 字节对齐的目标地址，源地址不要求
+    while (count > 0 && ((uintptr_t)dst & 15)) {
+        *dst++ = *src++;
+        count--;
+    }
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 4));
+        _mm_stream_si128((__m128i *)dst, a);
+        _mm_stream_si128((__m128i *)(dst + 4), b);
+    }
+    for (; count > 0; count--) {
+        *dst++ = *src++;
+    }
+}
+
+__attribute__((target("sse2")))
+static void copy_fence_sse2(void) {
+    _mm_sfence();
+}
+#endif
+
+static void copy_fence_none(void) {}
+
+static void (*fill_span_impl)(uint32_t *, size_t, uint32_t) = fill_span_scalar;
+static void (*copy_stream_impl)(uint32_t *, const uint32_t *, size_t) = copy_span_scalar;
+static void (*copy_fence_impl)(void) = copy_fence_none;
+
+// 程序启动时根据 CPU 特性选择一次实现，之后的调用没有分支开销
+__attribute__((constructor))
+static void fill_select_impl(void) {
+#ifdef FILL_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fill_span_impl = fill_span_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        fill_span_impl = fill_span_sse2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        copy_stream_impl = copy_span_stream;
+        copy_fence_impl = copy_fence_sse2;
+    }
+#endif
+}
+
+void fill_span(uint32_t *dst, size_t count, uint32_t color) {
+    fill_span_impl(dst, count, color);
+}
+
+void fill_solid(void *data, int width, int height, int stride, uint32_t color) {
+    // 四个字节相同（例如全黑、全白）时 memset 最快
+    uint8_t byte = color & 0xFF;
+    int uniform = color == byte * 0x01010101u;
+
+    // 行间没有填充时整个缓冲区就是一段连续像素
+    if (stride == width * 4) {
+        if (uniform) {
+            memset(data, byte, (size_t)stride * height);
+        } else {
+            fill_span(data, (size_t)width * height, color);
+        }
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+        if (uniform) {
+            memset(row_at(data, stride, y), byte, (size_t)width * 4);
+        } else {
+            fill_span(row_at(data, stride, y), width, color);
+        }
+    }
+}
+
+// 逐通道线性插值，结果与逐像素计算 from + (to - from) * y / height 相同
+static uint32_t gradient_color(uint32_t top, uint32_t bottom, int y, int height) {
+    uint32_t color = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int from = (top >> shift) & 0xFF;
+        int to = (bottom >> shift) & 0xFF;
+        color |= (uint32_t)(from + (to - from) * y / height) << shift;
+    }
+    return color;
+}
+
+void fill_gradient_rows(uint32_t *row_colors, int height, uint32_t top, uint32_t bottom) {
+    for (int y = 0; y < height; y++) {
+        row_colors[y] = gradient_color(top, bottom, y, height);
+    }
+}
+
+void fill_vertical_gradient(void *data, int width, int height, int stride,
+                            uint32_t top, uint32_t bottom) {
+    for (int y = 0; y < height; y++) {
+        fill_span(row_at(data, stride, y), width, gradient_color(top, bottom, y, height));
+    }
+}
+
+void fill_diagonal_stripes(void *data, int width, int height, int stride,
+                           int band, const uint32_t *colors, int count) {
+    int period = band * count;
+
+    // 第 y 行恰好是同一条图案从 y % period 处开始的一段，
+    // 因此只需生成一条 width + period 长的图案行，然后逐行 memcpy
+    uint32_t *pattern = malloc(((size_t)width + period) * sizeof(uint32_t));
+    if (!pattern) {
+        return;
+    }
+    for (int i = 0; i < width + period; i++) {
+        pattern[i] = colors[(i % period) / band];
+    }
+    for (int y = 0; y < height; y++) {
+        memcpy(row_at(data, stride, y), pattern + y % period, (size_t)width * 4);
+    }
+    free(pattern);
+}
+
+void fill_cross(void *data, int width, int height, int stride,
+                int x0, int x1, int y0, int y1,
+                const uint32_t *row_colors, uint32_t background) {
+    // 竖条的列范围（开区间 (x0, x1)）裁剪到缓冲区内，保证 0 <= left <= right <= width，
+    // 三段加起来恰好是一整行
+    int left = x0 + 1 < 0 ? 0 : (x0 + 1 > width ? width : x0 + 1);
+    int right = x1 < left ? left : (x1 > width ? width : x1);
+
+    for (int y = 0; y < height; y++) {
+        uint32_t *row = row_at(data, stride, y);
+        if (y0 < y && y < y1) {
+            fill_span(row, width, row_colors[y]);
+        } else {
+            fill_span(row, left, background);
+            fill_span(row + left, right - left, row_colors[y]);
+            fill_span(row + right, width - right, background);
+        }
+    }
+}
+
+void fill_checkerboard(void *data, int width, int height, int stride,
+                       int cell, uint32_t even, uint32_t odd) {
+    // 只有两种不同的行：先各生成一行，再按 y / cell 的奇偶复制
+    uint32_t *rows = malloc((size_t)width * 2 * sizeof(uint32_t));
+    if (!rows) {
+        return;
+    }
+    for (int parity = 0; parity < 2; parity++) {
+        uint32_t *row = rows + (size_t)parity * width;
+        for (int x = 0; x < width; x += cell) {
+            int n = width - x < cell ? width - x : cell;
+            int on = ((x / cell) + parity) % 2 == 0;
+            fill_span(row + x, n, on ? even : odd);
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        memcpy(row_at(data, stride, y), rows + (size_t)((y / cell) % 2) * width,
+               (size_t)width * 4);
+    }
+    free(rows);
+}
+
+void fill_repeat_rows(void *data, int width, int height, int stride, int period) {
+    if (period <= 0 || period >= height) {
+        return;
+    }
+
+    int stream = (size_t)stride * height >= FILL_STREAM_THRESHOLD;
+    for (int y = period; y < height; y++) {
+        uint32_t *dst = row_at(data, stride, y);
+        const uint32_t *src = row_at(data, stride, y % period);
+        if (stream) {
+            copy_stream_impl(dst, src, width);
+        } else {
+            memcpy(dst, src, (size_t)width * 4);
+        }
+    }
+    // 非临时存储是弱序的，交给合成器之前要保证全部写完
+    if (stream) {
+        copy_fence_impl();
+    }
+}
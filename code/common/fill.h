@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 32 位像素（ARGB8888 / XRGB8888，按 uint32_t 存放）的填充内核。
+// 所有内核都按行主序写入，每行交给向量化的 fill_span（AVX2 / SSE2，
+// 其余平台为标量实现），stride 以字节为单位。
+
+// 1. 基础：填充一段连续像素
+void fill_span(uint32_t *dst, size_t count, uint32_t color);
+
+// 2. 纯色
+void fill_solid(void *data, int width, int height, int stride, uint32_t color);
+
+// 3. 竖直渐变：从 top 线性过渡到 bottom，每行颜色只计算一次
+void fill_gradient_rows(uint32_t *row_colors, int height, uint32_t top, uint32_t bottom);
+void fill_vertical_gradient(void *data, int width, int height, int stride,
+                            uint32_t top, uint32_t bottom);
+
+// 4. 斜条纹：((x + y) % (band * count)) / band 选择 colors 中的颜色
+void fill_diagonal_stripes(void *data, int width, int height, int stride,
+                           int band, const uint32_t *colors, int count);
+
+// 5. 十字遮罩：x0 < x < x1 或 y0 < y < y1 的像素使用 row_colors[y]，其余为 background
+void fill_cross(void *data, int width, int height, int stride,
+                int x0, int x1, int y0, int y1,
+                const uint32_t *row_colors, uint32_t background);
+
+// 6. 棋盘格：边长为 cell 的方格，(x + y / cell * cell) % (2 * cell) < cell 时为 even
+void fill_checkerboard(void *data, int width, int height, int stride,
+                       int cell, uint32_t even, uint32_t odd);
+
+// 7. 行复制：第 y 行（y >= period）复制自第 y % period 行。
+// 缓冲区较大时使用非临时存储（绕过缓存），因为写入的像素交给合成器读取，
+// 客户端自己不会再读，留在缓存里只会挤掉有用的数据
+void fill_repeat_rows(void *data, int width, int height, int stride, int period);
@@ -0,0 +1,132 @@
+#include "frame_scheduler.h"
+#include <string.h>
+
+static const uint32_t bucket_limits[FRAME_STATS_BUCKETS - 1] = {
+    8, 12, 18, 25, 35, 50, 100,
+};
+
+static const struct wl_callback_listener frame_listener;
+
+static void render_now(struct frame_scheduler *scheduler, uint32_t time) {
+    scheduler->dirty = false;
+    scheduler->rendering = true;
+    scheduler->render(scheduler->data, time);
+    scheduler->rendering = false;
+}
+
+static void record_interval(struct frame_scheduler *scheduler, uint32_t interval) {
+    struct frame_stats *stats = &scheduler->stats;
+
+    int bucket = 0;
+    while (bucket < FRAME_STATS_BUCKETS - 1 && interval > bucket_limits[bucket]) {
+        bucket++;
+    }
+    stats->histogram[bucket]++;
+
+    if (interval > 0 && (stats->min_interval == 0 || interval < stats->min_interval)) {
+        stats->min_interval = interval;
+    }
+    if (interval > stats->max_interval) {
+        stats->max_interval = interval;
+    }
+
+    // 没有输出刷新率时，把观测到的最短间隔当作一个 vblank
+    stats->interval = scheduler->refresh ? scheduler->refresh : stats->min_interval;
+    if (stats->interval == 0) {
+        return;
+    }
+    // 间隔超过 1.5 个 vblank 记为掉帧，按跨过的 vblank 数累计
+    if (interval * 2 > stats->interval * 3) {
+        stats->missed += (interval + stats->interval / 2) / stats->interval - 1;
+    }
+}
+
+static void frame_done(void *data, struct wl_callback *callback, uint32_t time) {
+    struct frame_scheduler *scheduler = data;
+    wl_callback_destroy(callback);
+    scheduler->callback = NULL;
+
+    if (scheduler->chained) {
+        record_interval(scheduler, time - scheduler->last_time);
+    }
+    scheduler->last_time = time;
+
+    // 没有新的内容就停在这里，不再申请帧回调，直到下一次 schedule
+    scheduler->chained = scheduler->dirty;
+    if (scheduler->dirty) {
+        render_now(scheduler, time);
+    }
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+void frame_scheduler_init(struct frame_scheduler *scheduler, struct wl_surface *surface,
+                          frame_render_fn render, void *data) {
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->surface = surface;
+    scheduler->render = render;
+    scheduler->data = data;
+}
+
+void frame_scheduler_finish(struct frame_scheduler *scheduler) {
+    if (scheduler->callback) {
+        wl_callback_destroy(scheduler->callback);
+        scheduler->callback = NULL;
+    }
+    scheduler->dirty = false;
+}
+
+void frame_scheduler_set_refresh(struct frame_scheduler *scheduler, int32_t refresh_mhz) {
+    scheduler->refresh = refresh_mhz > 0 ? (uint32_t)((1000000 + refresh_mhz / 2) / refresh_mhz) : 0;
+}
+
+void frame_scheduler_schedule(struct frame_scheduler *scheduler) {
+    scheduler->stats.requests++;
+    if (scheduler->dirty || scheduler->callback || scheduler->rendering) {
+        // 已经有一帧在路上：等它的帧回调时一起画
+        if (scheduler->dirty) {
+            scheduler->stats.coalesced++;
+        }
+        scheduler->dirty = true;
+        return;
+    }
+
+    // 空闲：立即渲染，这一帧与上一帧之间没有可比的间隔
+    scheduler->dirty = true;
+    scheduler->chained = false;
+    render_now(scheduler, 0);
+}
+
+void frame_scheduler_prepare_commit(struct frame_scheduler *scheduler) {
+    if (!scheduler->callback) {
+        scheduler->callback = wl_surface_frame(scheduler->surface);
+        wl_callback_add_listener(scheduler->callback, &frame_listener, scheduler);
+    }
+    scheduler->stats.frames++;
+}
+
+void frame_scheduler_commit(struct frame_scheduler *scheduler) {
+    frame_scheduler_prepare_commit(scheduler);
+    wl_surface_commit(scheduler->surface);
+}
+
+void frame_stats_print(const struct frame_stats *stats, FILE *out) {
+    fprintf(out, "frames: %llu rendered, %llu requests (%llu coalesced), %llu missed vblanks\n",
+            (unsigned long long)stats->frames, (unsigned long long)stats->requests,
+            (unsigned long long)stats->coalesced, (unsigned long long)stats->missed);
+    fprintf(out, "interval: nominal %u ms, min %u ms, max %u ms\n",
+            stats->interval, stats->min_interval, stats->max_interval);
+
+    uint32_t lower = 0;
+    for (int i = 0; i < FRAME_STATS_BUCKETS; i++) {
+        if (i < FRAME_STATS_BUCKETS - 1) {
+            fprintf(out, "  %3u-%-3u ms: %llu\n", lower, bucket_limits[i],
+                    (unsigned long long)stats->histogram[i]);
+            lower = bucket_limits[i];
+        } else {
+            fprintf(out, "  >%-6u ms: %llu\n", lower, (unsigned long long)stats->histogram[i]);
+        }
+    }
+}
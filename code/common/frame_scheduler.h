@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-client.h>
+
+// 由帧回调驱动的渲染调度器。
+// - frame_scheduler_schedule 只标记“需要重绘”，多次请求合并为一次；
+// - 每个帧回调最多渲染一次，没有待绘内容时不渲染，也不再申请帧回调；
+// - 空闲时（没有等待中的帧回调）收到请求会立即渲染，保证首帧与 configure 及时提交。
+// 渲染函数通过 frame_scheduler_commit 提交，调度器借此挂上下一次帧回调。
+
+// 帧间隔直方图的桶上界（毫秒），最后一个桶收纳更长的间隔
+#define FRAME_STATS_BUCKETS 8
+
+struct frame_stats {
+    uint64_t frames;      // 实际渲染的帧数
+    uint64_t requests;    // 重绘请求总数
+    uint64_t coalesced;   // 被合并掉的请求
+    uint64_t missed;      // 连续动画中错过的 vblank 数
+    uint32_t interval;    // 名义帧间隔（毫秒），未知时为 0
+    uint32_t min_interval;
+    uint32_t max_interval;
+    uint64_t histogram[FRAME_STATS_BUCKETS];
+};
+
+// time 是帧回调给出的毫秒时间戳；空闲后立即渲染的那一帧为 0
+typedef void (*frame_render_fn)(void *data, uint32_t time);
+
+struct frame_scheduler {
+    struct wl_surface *surface;
+    frame_render_fn render;
+    void *data;
+
+    struct wl_callback *callback; // 等待中的帧回调
+    bool dirty;
+    bool rendering;
+    bool chained;                 // 本帧紧接上一帧渲染，帧间隔有效
+    uint32_t last_time;
+    uint32_t refresh;             // 输出的刷新间隔（毫秒），0 表示用观测到的最小间隔
+
+    struct frame_stats stats;
+};
+
+// 1. 初始化与销毁
+void frame_scheduler_init(struct frame_scheduler *scheduler, struct wl_surface *surface,
+                          frame_render_fn render, void *data);
+void frame_scheduler_finish(struct frame_scheduler *scheduler);
+
+// 2. 已知输出刷新率（wl_output.mode 的 refresh，单位 mHz）时设置，用于判断掉帧
+void frame_scheduler_set_refresh(struct frame_scheduler *scheduler, int32_t refresh_mhz);
+
+// 3. 请求重绘；在渲染函数内调用表示下一帧还要继续画（动画）
+void frame_scheduler_schedule(struct frame_scheduler *scheduler);
+
+// 4. 渲染函数里代替 wl_surface_commit 使用。提交由别处完成时（例如 eglSwapBuffers
+//    内部的 commit），在提交之前调用 frame_scheduler_prepare_commit 挂上帧回调
+void frame_scheduler_commit(struct frame_scheduler *scheduler);
+void frame_scheduler_prepare_commit(struct frame_scheduler *scheduler);
+
+// 5. 输出统计
+void frame_stats_print(const struct frame_stats *stats, FILE *out);
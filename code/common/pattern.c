@@ -0,0 +1,157 @@
+#include "pattern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "fill.h"
+#include "shm_file.h"
+
+struct pattern_entry {
+    struct pattern pattern;
+    int width, height;
+    uint32_t format;
+    struct wl_buffer *buffer;
+    struct pattern_entry *next;
+};
+
+struct pattern_cache {
+    struct wl_shm *shm;
+    struct pattern_entry *entries;
+};
+
+// 图案在竖直方向上的周期（行数）
+static int pattern_period(const struct pattern *pattern) {
+    switch (pattern->kind) {
+    case PATTERN_CHECKERBOARD:
+        return 2 * pattern->cell;
+    case PATTERN_STRIPES:
+        return pattern->cell * pattern->count;
+    case PATTERN_SOLID:
+    default:
+        return 1;
+    }
+}
+
+void pattern_render(const struct pattern *pattern, void *data,
+                    int width, int height, int stride) {
+    int period = pattern_period(pattern);
+    if (period > height) {
+        period = height;
+    }
+
+    // 只渲染第一个周期
+    switch (pattern->kind) {
+    case PATTERN_CHECKERBOARD:
+        fill_checkerboard(data, width, period, stride, pattern->cell,
+                          pattern->colors[0], pattern->colors[1]);
+        break;
+    case PATTERN_STRIPES:
+        fill_diagonal_stripes(data, width, period, stride, pattern->cell,
+                              pattern->colors, pattern->count);
+        break;
+    case PATTERN_SOLID:
+    default:
+        fill_span(data, width, pattern->colors[0]);
+        break;
+    }
+    fill_repeat_rows(data, width, height, stride, period);
+
+    if (pattern->mark_size > 0) {
+        int size = pattern->mark_size;
+        int x = (width - size) / 2;
+        int y = (height - size) / 2;
+        for (int row = y < 0 ? 0 : y; row < y + size && row < height; row++) {
+            uint32_t *line = (uint32_t *)((unsigned char *)data + (size_t)row * stride);
+            int left = x < 0 ? 0 : x;
+            int right = x + size > width ? width : x + size;
+            fill_span(line + left, right - left, pattern->mark_color);
+        }
+    }
+}
+
+struct pattern_cache *pattern_cache_create(struct wl_shm *shm) {
+    struct pattern_cache *cache = calloc(1, sizeof(struct pattern_cache));
+    if (cache) {
+        cache->shm = shm;
+    }
+    return cache;
+}
+
+void pattern_cache_destroy(struct pattern_cache *cache) {
+    if (!cache) {
+        return;
+    }
+    struct pattern_entry *entry = cache->entries;
+    while (entry) {
+        struct pattern_entry *next = entry->next;
+        wl_buffer_destroy(entry->buffer);
+        free(entry);
+        entry = next;
+    }
+    free(cache);
+}
+
+static struct wl_buffer *render_buffer(struct wl_shm *shm, const struct pattern *pattern,
+                                       int width, int height, uint32_t format) {
+    int stride = width * 4;
+    struct shm_file file;
+    if (shm_file_create(&file, (size_t)stride * height, SHM_FILE_DEFAULT) < 0) {
+        return NULL;
+    }
+
+    pattern_render(pattern, file.data, width, height, stride);
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(shm, file.fd, file.size);
+    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, format);
+    wl_shm_pool_destroy(pool);
+
+    // 合成器持有自己的引用，内容不再改动，本地映射可以立即释放
+    shm_file_destroy(&file);
+    return buffer;
+}
+
+struct wl_buffer *pattern_cache_get(struct pattern_cache *cache,
+                                    const struct pattern *pattern,
+                                    int width, int height, uint32_t format) {
+    for (struct pattern_entry *entry = cache->entries; entry; entry = entry->next) {
+        if (entry->width == width && entry->height == height && entry->format == format &&
+            memcmp(&entry->pattern, pattern, sizeof(struct pattern)) == 0) {
+            return entry->buffer;
+        }
+    }
+
+    struct pattern_entry *entry = calloc(1, sizeof(struct pattern_entry));
+    if (!entry) {
+        return NULL;
+    }
+    entry->buffer = render_buffer(cache->shm, pattern, width, height, format);
+    if (!entry->buffer) {
+        free(entry);
+        return NULL;
+    }
+    entry->pattern = *pattern;
+    entry->width = width;
+    entry->height = height;
+    entry->format = format;
+    entry->next = cache->entries;
+    cache->entries = entry;
+    return entry->buffer;
+}
+
+bool pattern_is_opaque(const struct pattern *pattern) {
+    int count = 1;
+    if (pattern->kind == PATTERN_CHECKERBOARD) {
+        count = 2;
+    } else if (pattern->kind == PATTERN_STRIPES) {
+        count = pattern->count;
+    }
+    for (int i = 0; i < count && i < PATTERN_MAX_COLORS; i++) {
+        if ((pattern->colors[i] >> 24) != 0xFF) {
+            return false;
+        }
+    }
+    return pattern->mark_size == 0 || (pattern->mark_color >> 24) == 0xFF;
+}
+
+uint32_t pattern_format(const struct pattern *pattern) {
+    return pattern_is_opaque(pattern) ? WL_SHM_FORMAT_XRGB8888 : WL_SHM_FORMAT_ARGB8888;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+// 静态图案引擎：每种图案只渲染一个周期（一行或一组行），
+// 其余行用 fill_repeat_rows 复制；渲染结果按 (图案, 尺寸, 格式) 缓存，
+// 重新显示弹窗或重新映射窗口时直接复用已有的 wl_buffer，不再重绘。
+
+enum pattern_kind {
+    PATTERN_SOLID,        // 纯色 colors[0]
+    PATTERN_CHECKERBOARD, // 边长为 cell 的棋盘格，colors[0] / colors[1]
+    PATTERN_STRIPES,      // 宽度为 cell 的斜条纹，依次使用 colors[0..count)
+};
+
+#define PATTERN_MAX_COLORS 4
+
+// 作为缓存键按字节比较，所有字段都是 32 位整数，没有填充；
+// 用指定初始化器构造，未使用的字段保持为 0
+struct pattern {
+    enum pattern_kind kind;
+    int cell;
+    int count;
+    uint32_t colors[PATTERN_MAX_COLORS];
+    // 可选：叠加在中心的 mark_size x mark_size 纯色方块，0 表示没有
+    int mark_size;
+    uint32_t mark_color;
+};
+
+// 1. 渲染到任意 32 位像素缓冲区，stride 以字节为单位
+void pattern_render(const struct pattern *pattern, void *data,
+                    int width, int height, int stride);
+
+// 2. 缓存：返回的 wl_buffer 内容不可变，归缓存所有，
+//    可以同时挂到多个 surface 上，调用者不要销毁
+struct pattern_cache;
+
+struct pattern_cache *pattern_cache_create(struct wl_shm *shm);
+void pattern_cache_destroy(struct pattern_cache *cache);
+
+struct wl_buffer *pattern_cache_get(struct pattern_cache *cache,
+                                    const struct pattern *pattern,
+                                    int width, int height, uint32_t format);
+
+// 3. 图案用到的颜色是否全都不透明（alpha 为 0xFF），
+//    用于在带 alpha 的格式下推导不透明区域
+bool pattern_is_opaque(const struct pattern *pattern);
+
+// 4. 适合这个图案的 buffer 格式：颜色全不透明时用 XRGB8888，合成器可以整块跳过混合；
+//    否则用 ARGB8888（颜色按预乘 alpha 给出）。用同一个格式取 buffer、推导不透明区域
+uint32_t pattern_format(const struct pattern *pattern);
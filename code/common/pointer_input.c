@@ -0,0 +1,173 @@
+#include "pointer_input.h"
+#include <string.h>
+
+static void begin_frame(struct pointer_input *input) {
+    memset(&input->pending, 0, sizeof(input->pending));
+}
+
+static void flush_frame(struct pointer_input *input) {
+    struct pointer_event *event = &input->pending;
+    if (event->mask == 0) {
+        return;
+    }
+    event->surface = input->focus;
+    event->enter_serial = input->enter_serial;
+    event->x = input->x;
+    event->y = input->y;
+
+    input->handler(input->data, event);
+    begin_frame(input);
+}
+
+// 没有 frame 事件的旧版本 seat：每个事件自成一帧
+static void end_event(struct pointer_input *input) {
+    if (input->version < WL_POINTER_FRAME_SINCE_VERSION) {
+        flush_frame(input);
+    }
+}
+
+static void pointer_enter(void *data, struct wl_pointer *pointer, uint32_t serial,
+                          struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y) {
+    struct pointer_input *input = data;
+    input->focus = surface;
+    input->enter_serial = serial;
+    input->x = wl_fixed_to_double(x);
+    input->y = wl_fixed_to_double(y);
+    input->pending.mask |= POINTER_EVENT_ENTER;
+    end_event(input);
+}
+
+static void pointer_leave(void *data, struct wl_pointer *pointer, uint32_t serial,
+                          struct wl_surface *surface) {
+    struct pointer_input *input = data;
+    input->focus = NULL;
+    input->pending.mask |= POINTER_EVENT_LEAVE;
+    end_event(input);
+}
+
+static void pointer_motion(void *data, struct wl_pointer *pointer, uint32_t time,
+                           wl_fixed_t x, wl_fixed_t y) {
+    struct pointer_input *input = data;
+    // 只保留最后的位置，中间的 motion 直接合并掉
+    input->x = wl_fixed_to_double(x);
+    input->y = wl_fixed_to_double(y);
+    input->pending.time = time;
+    input->pending.motions++;
+    input->pending.mask |= POINTER_EVENT_MOTION;
+    end_event(input);
+}
+
+static void pointer_button(void *data, struct wl_pointer *pointer, uint32_t serial,
+                           uint32_t time, uint32_t button, uint32_t state) {
+    struct pointer_input *input = data;
+    if (input->pending.button_count == POINTER_FRAME_BUTTONS) {
+        flush_frame(input);
+    }
+    struct pointer_event *event = &input->pending;
+    event->buttons[event->button_count++] = (struct pointer_button) {
+        .serial = serial, .time = time, .button = button, .state = state,
+    };
+    event->time = time;
+    event->mask |= POINTER_EVENT_BUTTON;
+    end_event(input);
+}
+
+static struct pointer_axis *get_axis(struct pointer_input *input, uint32_t axis) {
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+        return NULL;
+    }
+    return &input->pending.axes[axis];
+}
+
+static void pointer_axis(void *data, struct wl_pointer *pointer, uint32_t time,
+                         uint32_t axis, wl_fixed_t value) {
+    struct pointer_input *input = data;
+    struct pointer_axis *a = get_axis(input, axis);
+    if (!a) {
+        return;
+    }
+    a->valid = true;
+    a->value += wl_fixed_to_double(value);
+    input->pending.time = time;
+    input->pending.mask |= POINTER_EVENT_AXIS;
+    end_event(input);
+}
+
+static void pointer_frame(void *data, struct wl_pointer *pointer) {
+    flush_frame(data);
+}
+
+static void pointer_axis_source(void *data, struct wl_pointer *pointer, uint32_t source) {
+    struct pointer_input *input = data;
+    input->pending.axis_source = source;
+    input->pending.mask |= POINTER_EVENT_AXIS_SOURCE;
+}
+
+static void pointer_axis_stop(void *data, struct wl_pointer *pointer, uint32_t time,
+                              uint32_t axis) {
+    struct pointer_input *input = data;
+    struct pointer_axis *a = get_axis(input, axis);
+    if (!a) {
+        return;
+    }
+    a->stop = true;
+    input->pending.time = time;
+    input->pending.mask |= POINTER_EVENT_AXIS_STOP;
+}
+
+// 版本 5~7 的滚轮刻度，统一换算成 1/120 的单位
+static void pointer_axis_discrete(void *data, struct wl_pointer *pointer, uint32_t axis,
+                                  int32_t discrete) {
+    struct pointer_input *input = data;
+    struct pointer_axis *a = get_axis(input, axis);
+    if (a) {
+        a->valid = true;
+        a->value120 += discrete * 120;
+        input->pending.mask |= POINTER_EVENT_AXIS;
+    }
+}
+
+// 版本 8 起取代 axis_discrete，高精度滚轮会给出不足 120 的值
+static void pointer_axis_value120(void *data, struct wl_pointer *pointer, uint32_t axis,
+                                  int32_t value120) {
+    struct pointer_input *input = data;
+    struct pointer_axis *a = get_axis(input, axis);
+    if (a) {
+        a->valid = true;
+        a->value120 += value120;
+        input->pending.mask |= POINTER_EVENT_AXIS;
+    }
+}
+
+static const struct wl_pointer_listener pointer_listener = {
+    .enter = pointer_enter,
+    .leave = pointer_leave,
+    .motion = pointer_motion,
+    .button = pointer_button,
+    .axis = pointer_axis,
+    .frame = pointer_frame,
+    .axis_source = pointer_axis_source,
+    .axis_stop = pointer_axis_stop,
+    .axis_discrete = pointer_axis_discrete,
+    .axis_value120 = pointer_axis_value120,
+};
+
+void pointer_input_init(struct pointer_input *input, struct wl_pointer *pointer,
+                        pointer_frame_fn handler, void *data) {
+    memset(input, 0, sizeof(*input));
+    input->pointer = pointer;
+    input->version = wl_pointer_get_version(pointer);
+    input->handler = handler;
+    input->data = data;
+    wl_pointer_add_listener(pointer, &pointer_listener, input);
+}
+
+const struct pointer_button *pointer_event_find_button(const struct pointer_event *event,
+                                                       uint32_t button, uint32_t state) {
+    for (int i = 0; i < event->button_count; i++) {
+        if (event->buttons[i].button == button && event->buttons[i].state == state) {
+            return &event->buttons[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+// 以 wl_pointer.frame 为单位聚合指针事件。
+// 一帧内的 enter/leave/motion/button/axis 在逻辑上同时发生：这里先把它们累积到
+// 一个 pointer_event 里，多次 motion 只保留最后的位置，收到 frame 后一次性交给回调。
+// 高刷新率鼠标的一串 motion 因此只触发一次处理。
+// wl_seat 低于版本 5 时没有 frame 事件，每个事件单独成帧。
+
+// pointer_event.mask 中的位：这一帧里出现过哪些事件
+enum pointer_event_mask {
+    POINTER_EVENT_ENTER       = 1 << 0,
+    POINTER_EVENT_LEAVE       = 1 << 1,
+    POINTER_EVENT_MOTION      = 1 << 2,
+    POINTER_EVENT_BUTTON      = 1 << 3,
+    POINTER_EVENT_AXIS        = 1 << 4,
+    POINTER_EVENT_AXIS_SOURCE = 1 << 5,
+    POINTER_EVENT_AXIS_STOP   = 1 << 6,
+};
+
+// 一帧最多记录的按键数，超出时提前提交当前帧
+#define POINTER_FRAME_BUTTONS 4
+
+struct pointer_button {
+    uint32_t serial;
+    uint32_t time;
+    uint32_t button;     // linux/input-event-codes.h 中的 BTN_*
+    uint32_t state;      // WL_POINTER_BUTTON_STATE_*
+};
+
+// 一个方向上的滚动：value 是连续量（表面坐标），value120 是滚轮刻度的 1/120，
+// 一格滚轮为 120；高精度滚轮会给出不足一格的值。没有滚轮刻度时 value120 为 0
+struct pointer_axis {
+    bool valid;
+    bool stop;           // 这一帧里滚动停止（例如触摸板手指抬起）
+    double value;
+    int32_t value120;
+};
+
+struct pointer_event {
+    uint32_t mask;
+    uint32_t time;       // 这一帧中最后一个带时间戳事件的时间
+
+    // 帧结束后的焦点与位置；leave 之后 surface 为 NULL
+    struct wl_surface *surface;
+    uint32_t enter_serial;
+    double x, y;
+    uint32_t motions;    // 合并进这一帧的 motion 数
+
+    struct pointer_button buttons[POINTER_FRAME_BUTTONS];
+    int button_count;
+
+    uint32_t axis_source;                  // WL_POINTER_AXIS_SOURCE_*
+    struct pointer_axis axes[2];           // 以 WL_POINTER_AXIS_* 为下标
+};
+
+typedef void (*pointer_frame_fn)(void *data, const struct pointer_event *event);
+
+struct pointer_input {
+    struct wl_pointer *pointer;
+    uint32_t version;
+    pointer_frame_fn handler;
+    void *data;
+
+    struct pointer_event pending;
+    // 跨帧保持的状态
+    struct wl_surface *focus;
+    uint32_t enter_serial;
+    double x, y;
+};
+
+// 1. 给已经创建的 wl_pointer 挂上聚合监听器；pointer 仍由调用者销毁
+void pointer_input_init(struct pointer_input *input, struct wl_pointer *pointer,
+                        pointer_frame_fn handler, void *data);
+
+// 2. 查询当前这一帧里第一个符合条件的按键，找不到返回 NULL
+const struct pointer_button *pointer_event_find_button(const struct pointer_event *event,
+                                                       uint32_t button, uint32_t state);
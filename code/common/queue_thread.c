@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include "queue_thread.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+struct queue_task {
+    queue_task_fn fn;
+    void *data;
+    struct queue_task *next;
+};
+
+static int prepare_read(struct queue_thread *thread) {
+    if (thread->queue) {
+        while (wl_display_prepare_read_queue(thread->display, thread->queue) != 0) {
+            if (wl_display_dispatch_queue_pending(thread->display, thread->queue) < 0) {
+                return -1;
+            }
+        }
+    } else {
+        while (wl_display_prepare_read(thread->display) != 0) {
+            if (wl_display_dispatch_pending(thread->display) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int dispatch_pending(struct queue_thread *thread) {
+    if (thread->queue) {
+        return wl_display_dispatch_queue_pending(thread->display, thread->queue);
+    }
+    return wl_display_dispatch_pending(thread->display);
+}
+
+// 取走当前所有任务并执行，返回是否已请求退出
+static bool run_tasks(struct queue_thread *thread) {
+    pthread_mutex_lock(&thread->lock);
+    struct queue_task *task = thread->tasks;
+    thread->tasks = NULL;
+    thread->tail = &thread->tasks;
+    bool quit = thread->quit;
+    pthread_mutex_unlock(&thread->lock);
+
+    while (task) {
+        struct queue_task *next = task->next;
+        task->fn(task->data);
+        free(task);
+        task = next;
+    }
+    return quit;
+}
+
+static void wake(struct queue_thread *thread) {
+    uint64_t one = 1;
+    (void)!write(thread->wake_fd, &one, sizeof(one));
+}
+
+int queue_thread_init(struct queue_thread *thread, struct wl_display *display,
+                      bool default_queue, const char *name) {
+    *thread = (struct queue_thread){
+        .display = display,
+        .name = name,
+        .tail = &thread->tasks,
+    };
+
+    thread->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (thread->wake_fd < 0) {
+        return -1;
+    }
+    if (!default_queue) {
+        thread->queue = wl_display_create_queue(display);
+        if (thread->queue == NULL) {
+            close(thread->wake_fd);
+            return -1;
+        }
+    }
+    pthread_mutex_init(&thread->lock, NULL);
+    return 0;
+}
+
+void queue_thread_finish(struct queue_thread *thread) {
+    queue_thread_join(thread);
+    // 没来得及执行的任务直接丢弃
+    while (thread->tasks) {
+        struct queue_task *next = thread->tasks->next;
+        free(thread->tasks);
+        thread->tasks = next;
+    }
+    if (thread->queue) {
+        wl_event_queue_destroy(thread->queue);
+        thread->queue = NULL;
+    }
+    close(thread->wake_fd);
+    pthread_mutex_destroy(&thread->lock);
+}
+
+int queue_thread_run(struct queue_thread *thread) {
+    struct pollfd fds[2] = {
+        { .fd = wl_display_get_fd(thread->display) },
+        { .fd = thread->wake_fd, .events = POLLIN },
+    };
+
+    while (!run_tasks(thread)) {
+        if (prepare_read(thread) < 0) {
+            return -1;
+        }
+
+        // 写缓冲区满时顺带等待可写，其余请求下一轮再发
+        fds[0].events = POLLIN;
+        if (wl_display_flush(thread->display) < 0) {
+            if (errno != EAGAIN) {
+                wl_display_cancel_read(thread->display);
+                return -1;
+            }
+            fds[0].events |= POLLOUT;
+        }
+
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            wl_display_cancel_read(thread->display);
+            return -1;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            if (wl_display_read_events(thread->display) < 0) {
+                return -1;
+            }
+        } else {
+            wl_display_cancel_read(thread->display);
+        }
+        if (dispatch_pending(thread) < 0) {
+            return -1;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            (void)!read(thread->wake_fd, &count, sizeof(count));
+        }
+    }
+    return 0;
+}
+
+static void *thread_main(void *data) {
+    struct queue_thread *thread = data;
+    if (thread->name) {
+        pthread_setname_np(pthread_self(), thread->name);
+    }
+    queue_thread_run(thread);
+    return NULL;
+}
+
+int queue_thread_start(struct queue_thread *thread) {
+    if (pthread_create(&thread->thread, NULL, thread_main, thread) != 0) {
+        return -1;
+    }
+    thread->started = true;
+    return 0;
+}
+
+void queue_thread_quit(struct queue_thread *thread) {
+    pthread_mutex_lock(&thread->lock);
+    thread->quit = true;
+    pthread_mutex_unlock(&thread->lock);
+    wake(thread);
+}
+
+void queue_thread_join(struct queue_thread *thread) {
+    if (!thread->started) {
+        return;
+    }
+    queue_thread_quit(thread);
+    pthread_join(thread->thread, NULL);
+    thread->started = false;
+}
+
+void *queue_thread_wrap(struct queue_thread *thread, void *proxy) {
+    void *wrapper = wl_proxy_create_wrapper(proxy);
+    if (wrapper && thread->queue) {
+        wl_proxy_set_queue(wrapper, thread->queue);
+    }
+    return wrapper;
+}
+
+int queue_thread_post(struct queue_thread *thread, queue_task_fn fn, void *data) {
+    struct queue_task *task = malloc(sizeof(*task));
+    if (task == NULL) {
+        return -1;
+    }
+    task->fn = fn;
+    task->data = data;
+    task->next = NULL;
+
+    pthread_mutex_lock(&thread->lock);
+    *thread->tail = task;
+    thread->tail = &task->next;
+    pthread_mutex_unlock(&thread->lock);
+    wake(thread);
+    return 0;
+}
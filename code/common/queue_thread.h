@@ -0,0 +1,50 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <wayland-client.h>
+
+// 在一个线程里分发一个 wl_event_queue。
+// 多个线程各自调用 wl_display_prepare_read_queue，等同一个 Wayland fd 可读后
+// wl_display_read_events：最后一个到达的线程负责真正读取，其余线程等它读完，
+// 读到的事件按对象所属的队列分发到对应线程。
+// 线程之间通过 queue_thread_post 投递任务，任务在目标线程中按顺序执行。
+
+typedef void (*queue_task_fn)(void *data);
+
+struct queue_task;
+
+struct queue_thread {
+    struct wl_display *display;
+    struct wl_event_queue *queue; // NULL 表示默认队列
+    const char *name;
+    pthread_t thread;
+    bool started;
+
+    int wake_fd;                  // eventfd：有新任务或请求退出时唤醒
+    pthread_mutex_t lock;
+    struct queue_task *tasks;
+    struct queue_task **tail;
+    bool quit;
+};
+
+// 1. 初始化与销毁：default_queue 为 true 时分发默认队列，否则新建一个队列。
+//    销毁前必须先销毁该队列上的所有对象
+int queue_thread_init(struct queue_thread *thread, struct wl_display *display,
+                      bool default_queue, const char *name);
+void queue_thread_finish(struct queue_thread *thread);
+
+// 2. 在当前线程运行，直到 queue_thread_quit 或连接出错（返回 -1）
+int queue_thread_run(struct queue_thread *thread);
+
+// 3. 新开线程运行；join 会请求退出并等待线程结束
+int queue_thread_start(struct queue_thread *thread);
+void queue_thread_join(struct queue_thread *thread);
+void queue_thread_quit(struct queue_thread *thread);
+
+// 4. 返回 proxy 的包装对象：经由它创建的新对象的事件都进入本线程的队列。
+//    用完后用 wl_proxy_wrapper_destroy 释放
+void *queue_thread_wrap(struct queue_thread *thread, void *proxy);
+
+// 5. 在本线程中执行 fn(data)，任何线程都可以调用，成功返回 0
+int queue_thread_post(struct queue_thread *thread, queue_task_fn fn, void *data);
@@ -0,0 +1,208 @@
+#include "raster_pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// 小块少于这个数时，唤醒线程的开销比省下的时间还多
+#define MIN_PARALLEL_TILES 8
+
+// 每个线程的区段独占一条缓存行，避免取块时互相争抢
+struct raster_range {
+    _Alignas(64) atomic_int next;
+    int end;
+};
+
+struct raster_job {
+    uint32_t *pixels;
+    int stride;
+    int x, y, width, height;
+    int tiles_x;
+    raster_tile_fn fn;
+    void *data;
+};
+
+struct raster_worker {
+    struct raster_pool *pool;
+    int index;
+    pthread_t thread;
+};
+
+struct raster_pool {
+    int threads;
+    struct raster_worker *workers;  // threads - 1 个，编号从 1 开始
+    struct raster_range *ranges;    // threads 个，0 号属于调用者
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation;
+    int active;
+    bool quit;
+
+    struct raster_job job;
+};
+
+static void run_tile(const struct raster_job *job, int index) {
+    int x = job->x + index % job->tiles_x * RASTER_TILE_WIDTH;
+    int y = job->y + index / job->tiles_x * RASTER_TILE_HEIGHT;
+    int width = job->x + job->width - x;
+    int height = job->y + job->height - y;
+    if (width > RASTER_TILE_WIDTH) {
+        width = RASTER_TILE_WIDTH;
+    }
+    if (height > RASTER_TILE_HEIGHT) {
+        height = RASTER_TILE_HEIGHT;
+    }
+    job->fn(job->data, job->pixels, job->stride, x, y, width, height);
+}
+
+// 先做自己的区段，再依次从后面的区段窃取，直到所有区段都取空
+static void work(struct raster_pool *pool, int self) {
+    for (int k = 0; k < pool->threads; k++) {
+        struct raster_range *range = &pool->ranges[(self + k) % pool->threads];
+        for (;;) {
+            int index = atomic_fetch_add_explicit(&range->next, 1, memory_order_relaxed);
+            if (index >= range->end) {
+                break;
+            }
+            run_tile(&pool->job, index);
+        }
+    }
+}
+
+static void *worker_main(void *data) {
+    struct raster_worker *worker = data;
+    struct raster_pool *pool = worker->pool;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->quit) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct raster_pool *raster_pool_create(int threads) {
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    struct raster_pool *pool = calloc(1, sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->ranges = aligned_alloc(_Alignof(struct raster_range),
+                                 sizeof(struct raster_range) * threads);
+    pool->workers = calloc(threads, sizeof(struct raster_worker));
+    if (pool->ranges == NULL || pool->workers == NULL) {
+        free(pool->ranges);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // 线程创建失败时就用已经起来的那些
+    pool->threads = 1;
+    for (int i = 1; i < threads; i++) {
+        struct raster_worker *worker = &pool->workers[i - 1];
+        worker->pool = pool;
+        worker->index = i;
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            break;
+        }
+        pool->threads++;
+    }
+    return pool;
+}
+
+void raster_pool_destroy(struct raster_pool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->threads; i++) {
+        pthread_join(pool->workers[i - 1].thread, NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool->ranges);
+    free(pool);
+}
+
+void raster_pool_run(struct raster_pool *pool, void *pixels, int stride,
+                     int x, int y, int width, int height,
+                     raster_tile_fn fn, void *data) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    struct raster_job job = {
+        .pixels = pixels,
+        .stride = stride,
+        .x = x,
+        .y = y,
+        .width = width,
+        .height = height,
+        .tiles_x = (width + RASTER_TILE_WIDTH - 1) / RASTER_TILE_WIDTH,
+        .fn = fn,
+        .data = data,
+    };
+    int tiles = job.tiles_x * ((height + RASTER_TILE_HEIGHT - 1) / RASTER_TILE_HEIGHT);
+
+    if (pool == NULL || pool->threads == 1 || tiles < MIN_PARALLEL_TILES) {
+        for (int i = 0; i < tiles; i++) {
+            run_tile(&job, i);
+        }
+        return;
+    }
+
+    pool->job = job;
+    for (int i = 0; i < pool->threads; i++) {
+        atomic_store_explicit(&pool->ranges[i].next, (int)((long)tiles * i / pool->threads),
+                              memory_order_relaxed);
+        pool->ranges[i].end = (int)((long)tiles * (i + 1) / pool->threads);
+    }
+
+    // 任务和区段在加锁发布之后才对工作线程可见
+    pthread_mutex_lock(&pool->lock);
+    pool->generation++;
+    pool->active = pool->threads - 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, 0);
+
+    // 所有工作线程都报告结束后，它们写入的像素对调用者可见
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
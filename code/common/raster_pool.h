@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// 分块并行光栅化：把缓冲区中的一个矩形切成适合 L1 缓存的小块，
+// 分给一组工作线程并行填充。调用线程也参与工作，raster_pool_run 返回时
+// 所有小块都已写完，可以直接 wl_surface_attach / commit。
+//
+// 任务分配采用简单的工作窃取：小块按编号切成与线程数相同的连续区段，
+// 每个线程先从自己的区段取块（保持内存局部性），做完后再去别的区段里取。
+
+// 128 x 32 个 32 位像素 = 16 KiB，约为常见 L1 数据缓存的一半
+#define RASTER_TILE_WIDTH  128
+#define RASTER_TILE_HEIGHT 32
+
+// 填充一个小块：pixels 指向整个缓冲区的起点，stride 以字节为单位，
+// (x, y, width, height) 是小块在缓冲区中的绝对位置。不同小块会被并发调用
+typedef void (*raster_tile_fn)(void *data, uint32_t *pixels, int stride,
+                               int x, int y, int width, int height);
+
+struct raster_pool;
+
+// 1. 创建与销毁：threads 为参与的线程总数（含调用者），<= 0 表示使用全部在线 CPU
+struct raster_pool *raster_pool_create(int threads);
+void raster_pool_destroy(struct raster_pool *pool);
+
+// 2. 填充 (x, y, width, height) 覆盖的所有小块，全部完成后返回。
+//    pool 为 NULL 或区域太小时直接在调用线程中完成
+void raster_pool_run(struct raster_pool *pool, void *pixels, int stride,
+                     int x, int y, int width, int height,
+                     raster_tile_fn fn, void *data);
@@ -0,0 +1,187 @@
+#include "registry.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct registry_global {
+    uint32_t name;
+    const struct registry_binding *binding;
+    void *proxy;
+    struct registry_global *next;
+};
+
+struct registry {
+    struct wl_registry *registry;
+    const struct registry_binding *bindings;
+    size_t count;
+    void *data;
+
+    // 接口名到绑定表下标的开放寻址哈希表，-1 为空位
+    int *table;
+    size_t mask;
+
+    struct registry_global *globals;
+};
+
+// FNV-1a
+static uint32_t hash_name(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+static const struct registry_binding *lookup(const struct registry *registry, const char *interface) {
+    for (size_t i = hash_name(interface) & registry->mask;; i = (i + 1) & registry->mask) {
+        int index = registry->table[i];
+        if (index < 0) {
+            return NULL;
+        }
+        const struct registry_binding *binding = &registry->bindings[index];
+        if (strcmp(binding->interface->name, interface) == 0) {
+            return binding;
+        }
+    }
+}
+
+static void **slot_of(const struct registry *registry, const struct registry_binding *binding) {
+    if (binding->slot == REGISTRY_NO_SLOT) {
+        return NULL;
+    }
+    return (void **)((char *)registry->data + binding->slot);
+}
+
+static void handle_global(void *data, struct wl_registry *wl_registry, uint32_t name,
+                          const char *interface, uint32_t version) {
+    struct registry *registry = data;
+    const struct registry_binding *binding = lookup(registry, interface);
+    if (binding == NULL || version < binding->min_version) {
+        return;
+    }
+    // 只保存一个的对象已经有了，后来者不再绑定
+    void **slot = slot_of(registry, binding);
+    if (slot && *slot) {
+        return;
+    }
+
+    struct registry_global *global = calloc(1, sizeof(*global));
+    if (global == NULL) {
+        return;
+    }
+    uint32_t bind_version = version < binding->max_version ? version : binding->max_version;
+    global->name = name;
+    global->binding = binding;
+    global->proxy = wl_registry_bind(wl_registry, name, binding->interface, bind_version);
+    global->next = registry->globals;
+    registry->globals = global;
+
+    if (binding->listener) {
+        wl_proxy_add_listener(global->proxy, (void (**)(void))binding->listener, registry->data);
+    }
+    if (slot) {
+        *slot = global->proxy;
+    }
+    if (binding->bound) {
+        binding->bound(registry->data, global->proxy, bind_version);
+    }
+}
+
+static void handle_global_remove(void *data, struct wl_registry *wl_registry, uint32_t name) {
+    struct registry *registry = data;
+
+    for (struct registry_global **link = &registry->globals; *link; link = &(*link)->next) {
+        struct registry_global *global = *link;
+        if (global->name != name) {
+            continue;
+        }
+        *link = global->next;
+
+        const struct registry_binding *binding = global->binding;
+        void **slot = slot_of(registry, binding);
+        if (slot && *slot == global->proxy) {
+            *slot = NULL;
+        }
+        if (binding->removed) {
+            binding->removed(registry->data, global->proxy);
+        } else {
+            wl_proxy_destroy(global->proxy);
+        }
+        free(global);
+        return;
+    }
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = handle_global,
+    .global_remove = handle_global_remove,
+};
+
+struct registry *registry_create(struct wl_display *display,
+                                 const struct registry_binding *bindings, size_t count,
+                                 void *data) {
+    struct registry *registry = calloc(1, sizeof(*registry));
+    if (registry == NULL) {
+        return NULL;
+    }
+    registry->bindings = bindings;
+    registry->count = count;
+    registry->data = data;
+
+    // 装载率不超过一半，查找几乎总是一次命中
+    size_t size = 8;
+    while (size < count * 2) {
+        size *= 2;
+    }
+    registry->mask = size - 1;
+    registry->table = malloc(size * sizeof(int));
+    if (registry->table == NULL) {
+        free(registry);
+        return NULL;
+    }
+    memset(registry->table, -1, size * sizeof(int));
+    for (size_t n = 0; n < count; n++) {
+        size_t i = hash_name(bindings[n].interface->name) & registry->mask;
+        while (registry->table[i] >= 0) {
+            i = (i + 1) & registry->mask;
+        }
+        registry->table[i] = (int)n;
+    }
+
+    registry->registry = wl_display_get_registry(display);
+    wl_registry_add_listener(registry->registry, &registry_listener, registry);
+    return registry;
+}
+
+void registry_destroy(struct registry *registry) {
+    if (registry == NULL) {
+        return;
+    }
+    while (registry->globals) {
+        struct registry_global *next = registry->globals->next;
+        free(registry->globals);
+        registry->globals = next;
+    }
+    wl_registry_destroy(registry->registry);
+    free(registry->table);
+    free(registry);
+}
+
+const char *registry_missing(const struct registry *registry) {
+    for (size_t n = 0; n < registry->count; n++) {
+        const struct registry_binding *binding = &registry->bindings[n];
+        if (!binding->required) {
+            continue;
+        }
+        bool found = false;
+        for (const struct registry_global *global = registry->globals; global; global = global->next) {
+            if (global->binding == binding) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return binding->interface->name;
+        }
+    }
+    return NULL;
+}
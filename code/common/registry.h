@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+// 声明式的全局对象绑定：每个样例用一张静态表描述需要的接口，
+// registry 负责按接口名查表（哈希，一次查找）、按 min(通告版本, max_version) 绑定、
+// 挂上监听器，并在 global_remove 时清理对应的对象。
+
+// slot 表示“不保存到结构体”，通常配合 bound/removed 回调管理可以有多个的对象
+#define REGISTRY_NO_SLOT ((size_t)-1)
+
+struct registry_binding {
+    const struct wl_interface *interface;
+    uint32_t min_version;   // 通告版本低于此值时不绑定
+    uint32_t max_version;   // 代码（监听器）支持的最高版本
+    size_t slot;            // 绑定结果写到 (char *)data + slot，用 offsetof 取得
+    const void *listener;   // 可选，绑定后以 data 为用户数据添加
+    bool required;          // registry_missing 检查的接口
+
+    // 可选：wl_output、wl_seat 这类会热插拔的对象在绑定后、移除前各通知一次。
+    // 提供 removed 时由它负责销毁 proxy，否则 registry 直接 wl_proxy_destroy
+    void (*bound)(void *data, void *proxy, uint32_t version);
+    void (*removed)(void *data, void *proxy);
+};
+
+struct registry;
+
+// 1. 创建与销毁：创建后需要一次 roundtrip 才能收到初始的全局对象。
+//    销毁只释放 wl_registry 和内部记录，已绑定的对象仍归调用者所有
+struct registry *registry_create(struct wl_display *display,
+                                 const struct registry_binding *bindings, size_t count,
+                                 void *data);
+void registry_destroy(struct registry *registry);
+
+// 2. 返回第一个 required 但尚未绑定的接口名，全部就绪时返回 NULL
+const char *registry_missing(const struct registry *registry);
@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include "shm_file.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// x86_64 / aarch64 上 MFD_HUGETLB 的默认大页大小
+#define SHM_FILE_HUGE_PAGE_SIZE (2u * 1024 * 1024)
+
+static size_t round_size(size_t size, unsigned flags) {
+    if (flags & SHM_FILE_HUGETLB) {
+        return (size + SHM_FILE_HUGE_PAGE_SIZE - 1) & ~((size_t)SHM_FILE_HUGE_PAGE_SIZE - 1);
+    }
+    return size;
+}
+
+static int truncate_fd(int fd, size_t size) {
+    int ret;
+    do {
+        ret = ftruncate(fd, size);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static int create_memfd(unsigned flags) {
+    unsigned int mfd_flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+    if (flags & SHM_FILE_HUGETLB) {
+        mfd_flags |= MFD_HUGETLB;
+    }
+    return memfd_create("wayland-shm", mfd_flags);
+}
+
+// 没有 memfd_create 的旧内核：shm_open 同样位于 /dev/shm (tmpfs)
+static int create_posix_shm(void) {
+    int retries = 100;
+    do {
+        char name[] = "/wl_shm-XXXXXX";
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        long r = ts.tv_nsec;
+        for (int i = 0; i < 6; ++i) {
+            name[sizeof(name) - 7 + i] = 'A' + (r & 15) + (r & 16) * 2;
+            r >>= 5;
+        }
+        --retries;
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd >= 0) {
+            shm_unlink(name);
+            return fd;
+        }
+    } while (retries > 0 && errno == EEXIST);
+    return -1;
+}
+
+static void advise_mapping(struct shm_file *file) {
+    if (file->flags & SHM_FILE_THP) {
+        // 仅是建议：内核未开启 shmem THP 时会被忽略
+        madvise(file->data, file->size, MADV_HUGEPAGE);
+    }
+}
+
+static int try_create(struct shm_file *file, size_t size, unsigned flags) {
+    size = round_size(size, flags);
+
+    int sealed = 1;
+    int fd = create_memfd(flags);
+    if (fd < 0) {
+        if (flags & SHM_FILE_HUGETLB) {
+            return -1;
+        }
+        sealed = 0;
+        fd = create_posix_shm();
+        if (fd < 0) {
+            fprintf(stderr, "shm allocation failed: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    if (truncate_fd(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // 禁止任何一方（包括合成器）把文件截短，避免访问映射时触发 SIGBUS
+    if (sealed) {
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK);
+    }
+
+    // 大页在 mmap 时才真正预留，没有可用大页会在这里失败
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    file->fd = fd;
+    file->data = data;
+    file->size = size;
+    file->flags = flags;
+    advise_mapping(file);
+    return 0;
+}
+
+int shm_file_create(struct shm_file *file, size_t size, unsigned flags) {
+    file->fd = -1;
+    file->data = NULL;
+    file->size = 0;
+    file->flags = 0;
+
+    if (try_create(file, size, flags) == 0) {
+        return 0;
+    }
+    if (flags & SHM_FILE_HUGETLB) {
+        // 回退到普通页，并以透明大页作为替代
+        flags = (flags & ~SHM_FILE_HUGETLB) | SHM_FILE_THP;
+        if (try_create(file, size, flags) == 0) {
+            return 0;
+        }
+    }
+    fprintf(stderr, "Failed to allocate %zu bytes of shared memory\n", size);
+    return -1;
+}
+
+int shm_file_grow(struct shm_file *file, size_t size) {
+    if (size <= file->size) {
+        return 0;
+    }
+    size = round_size(size, file->flags);
+
+    if (truncate_fd(file->fd, size) < 0) {
+        fprintf(stderr, "ftruncate failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    void *data = mremap(file->data, file->size, size, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) {
+        // 部分内核不支持 mremap 大页映射；文件内容保留在 fd 中，重新映射即可
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+            return -1;
+        }
+        munmap(file->data, file->size);
+    }
+
+    file->data = data;
+    file->size = size;
+    advise_mapping(file);
+    return 0;
+}
+
+void shm_file_destroy(struct shm_file *file) {
+    // 创建成功时 data 一定非空，这样零初始化的结构体也可以安全销毁
+    if (!file->data) {
+        return;
+    }
+    munmap(file->data, file->size);
+    close(file->fd);
+    file->data = NULL;
+    file->fd = -1;
+    file->size = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+
+// 像素缓冲区的后备内存分配方式
+enum shm_file_flags {
+    SHM_FILE_DEFAULT = 0,
+    // 尝试使用 MFD_HUGETLB（需要系统预留大页），失败时自动回退
+    SHM_FILE_HUGETLB = 1 << 0,
+    // 对映射调用 madvise(MADV_HUGEPAGE)，让大表面使用透明大页
+    SHM_FILE_THP = 1 << 1,
+};
+
+// 一段匿名共享内存：文件描述符可直接交给 wl_shm_create_pool。
+// 优先使用带 F_SEAL_SHRINK 封印的 memfd，不支持时回退到 shm_open，
+// 两种方式都位于内存文件系统中，不会产生磁盘回写。
+struct shm_file {
+    int fd;
+    void *data;
+    size_t size;
+    unsigned flags; // 实际生效的分配方式（可能已从 HUGETLB 回退）
+};
+
+// 1. 创建并映射，成功返回 0。大页模式下 size 会向上取整到大页大小
+int shm_file_create(struct shm_file *file, size_t size, unsigned flags);
+
+// 2. 扩容到至少 size 字节。注意：file->data 可能移动
+int shm_file_grow(struct shm_file *file, size_t size);
+
+// 3. 解除映射并关闭文件描述符
+void shm_file_destroy(struct shm_file *file);
@@ -0,0 +1,211 @@
+#include "shm_pool.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// wl_shm.create_pool 与 wl_shm_pool.resize 的 size 参数都是 int32
+#define SHM_POOL_MAX_SIZE ((size_t)INT32_MAX)
+
+// 几何级数扩容，避免连续的 configure 每次都触发一次增长
+static size_t grow_size(size_t current, size_t wanted) {
+    size_t size = current > 0 ? current : 4096;
+    while (size < wanted) {
+        size *= 2;
+    }
+    if (size > SHM_POOL_MAX_SIZE) {
+        size = SHM_POOL_MAX_SIZE;
+    }
+    return size;
+}
+
+struct shm_pool *shm_pool_create(struct wl_shm *shm, size_t size) {
+    if (size == 0 || size > SHM_POOL_MAX_SIZE) {
+        return NULL;
+    }
+
+    struct shm_pool *pool = calloc(1, sizeof(struct shm_pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->shm = shm;
+
+    // 窗口可能被拉伸到 4K，提前为映射申请透明大页
+    if (shm_file_create(&pool->file, size, SHM_FILE_THP) < 0) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->pool = wl_shm_create_pool(shm, pool->file.fd, pool->file.size);
+    return pool;
+}
+
+void shm_pool_destroy(struct shm_pool *pool) {
+    if (!pool) {
+        return;
+    }
+    if (pool->pool) {
+        wl_shm_pool_destroy(pool->pool);
+    }
+    shm_file_destroy(&pool->file);
+    free(pool);
+}
+
+int shm_pool_ensure(struct shm_pool *pool, size_t size) {
+    if (size <= pool->file.size) {
+        return 0;
+    }
+    if (size > SHM_POOL_MAX_SIZE) {
+        fprintf(stderr, "shm pool too large: %zu bytes\n", size);
+        return -1;
+    }
+
+    if (shm_file_grow(&pool->file, grow_size(pool->file.size, size)) < 0) {
+        return -1;
+    }
+
+    // wl_shm_pool 只能增大，不能缩小
+    wl_shm_pool_resize(pool->pool, pool->file.size);
+    return 0;
+}
+
+struct wl_buffer *shm_pool_create_buffer(struct shm_pool *pool, int32_t offset,
+                                         int32_t width, int32_t height,
+                                         int32_t stride, uint32_t format) {
+    if ((size_t)offset + (size_t)stride * height > pool->file.size) {
+        return NULL;
+    }
+    return wl_shm_pool_create_buffer(pool->pool, offset, width, height, stride, format);
+}
+
+static void destroy_slot(struct shm_slot *slot) {
+    if (slot->wl_buffer) {
+        wl_buffer_destroy(slot->wl_buffer);
+    }
+    slot->wl_buffer = NULL;
+    slot->busy = false;
+}
+
+static void slot_release(void *data, struct wl_buffer *wl_buffer) {
+    struct shm_slot *slot = data;
+    struct shm_slots *slots = slot->slots;
+    slot->busy = false;
+    if (slots->release) {
+        slots->release(slots->data);
+    }
+}
+
+static const struct wl_buffer_listener slot_listener = {
+    .release = slot_release,
+};
+
+static size_t slot_size(const struct shm_slot *slot) {
+    return (size_t)slot->width * 4 * slot->height;
+}
+
+// 给 self 找一个放得下 size 字节的位置：从 0 开始，取第一个不和任何仍被
+// 占用的 buffer 重叠的偏移。候选只有 0 和各个被占用 buffer 的末尾，所以
+// 池子最多需要“最远的被占用 buffer 末尾 + size”，拖动缩放时不会一直往后长
+static size_t place_slot(const struct shm_slots *slots, const struct shm_slot *self,
+                         size_t size) {
+    size_t best = SIZE_MAX;
+    for (int i = -1; i < SHM_SLOTS; i++) {
+        size_t offset = 0;
+        if (i >= 0) {
+            const struct shm_slot *busy = &slots->buffers[i];
+            if (busy == self || !busy->busy) {
+                continue;
+            }
+            offset = busy->offset + slot_size(busy);
+        }
+        bool fits = true;
+        for (int j = 0; j < SHM_SLOTS && fits; j++) {
+            const struct shm_slot *other = &slots->buffers[j];
+            if (other != self && other->busy) {
+                size_t start = other->offset;
+                fits = offset + size <= start || offset >= start + slot_size(other);
+            }
+        }
+        if (fits && offset < best) {
+            best = offset;
+        }
+    }
+    return best;
+}
+
+void shm_slots_init(struct shm_slots *slots, struct wl_shm *shm, uint32_t format,
+                    shm_slots_release_fn release, void *data) {
+    memset(slots, 0, sizeof(*slots));
+    slots->shm = shm;
+    slots->format = format;
+    slots->release = release;
+    slots->data = data;
+}
+
+void shm_slots_finish(struct shm_slots *slots) {
+    for (int i = 0; i < SHM_SLOTS; i++) {
+        destroy_slot(&slots->buffers[i]);
+    }
+    shm_pool_destroy(slots->pool);
+    slots->pool = NULL;
+}
+
+void shm_slots_set_format(struct shm_slots *slots, uint32_t format) {
+    slots->format = format;
+}
+
+struct shm_slot *shm_slots_acquire(struct shm_slots *slots, int width, int height) {
+    int stride = width * 4;
+    size_t size = (size_t)stride * height;
+    if (size == 0) {
+        return NULL;
+    }
+
+    for (int i = 0; i < SHM_SLOTS; i++) {
+        struct shm_slot *slot = &slots->buffers[i];
+        if (slot->busy) {
+            continue;
+        }
+        size_t place = place_slot(slots, slot, size);
+        if (size > SHM_POOL_MAX_SIZE || place > SHM_POOL_MAX_SIZE - size) {
+            return NULL;
+        }
+        if (!slots->pool) {
+            slots->pool = shm_pool_create(slots->shm, place + size);
+            if (!slots->pool) {
+                return NULL;
+            }
+        } else if (shm_pool_ensure(slots->pool, place + size) < 0) {
+            return NULL;
+        }
+
+        int32_t offset = (int32_t)place;
+        if (slot->wl_buffer && slot->width == width && slot->height == height &&
+            slot->format == slots->format && slot->offset == offset) {
+            return slot;
+        }
+
+        destroy_slot(slot);
+        slot->wl_buffer = shm_pool_create_buffer(slots->pool, offset, width, height, stride,
+                                                 slots->format);
+        if (!slot->wl_buffer) {
+            return NULL;
+        }
+        wl_buffer_add_listener(slot->wl_buffer, &slot_listener, slot);
+        slot->slots = slots;
+        slot->offset = offset;
+        slot->width = width;
+        slot->height = height;
+        slot->format = slots->format;
+        return slot;
+    }
+    return NULL;
+}
+
+void *shm_slot_data(const struct shm_slot *slot) {
+    return (char *)slot->slots->pool->file.data + slot->offset;
+}
+
+void shm_slot_submit(struct shm_slot *slot) {
+    slot->busy = true;
+}
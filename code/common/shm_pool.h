@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+#include "shm_file.h"
+
+// 可原地增长的共享内存池：一个文件描述符、一个 wl_shm_pool、一段映射。
+// 窗口尺寸变化时只需重建 wl_buffer，池本身按几何级数扩容，
+// 通过 ftruncate + wl_shm_pool_resize + mremap 完成，不再重新创建文件。
+struct shm_pool {
+    struct wl_shm *shm;
+    struct wl_shm_pool *pool;
+    struct shm_file file;
+};
+
+// 1. 创建与销毁
+struct shm_pool *shm_pool_create(struct wl_shm *shm, size_t size);
+void shm_pool_destroy(struct shm_pool *pool);
+
+// 2. 确保池至少有 size 字节，成功返回 0。
+//    注意：扩容后 pool->file.data 可能移动，之前取得的指针全部失效。
+int shm_pool_ensure(struct shm_pool *pool, size_t size);
+
+// 3. 在池中指定偏移处创建缓冲区
+struct wl_buffer *shm_pool_create_buffer(struct shm_pool *pool, int32_t offset,
+                                         int32_t width, int32_t height,
+                                         int32_t stride, uint32_t format);
+
+// 4. 多缓冲：在一个池里轮流使用 SHM_SLOTS 块同尺寸的 buffer（stride 为 width * 4）。
+//    提交后的 buffer 一直算作被占用，直到合成器发出 wl_buffer.release，
+//    在此之前不会再被取出来重画。每块 buffer 放在池里第一个不和被占用的
+//    buffer 重叠的位置（从 0 开始找），既不改写合成器正在读的内存，
+//    拖动缩放时池子也只需要当前尺寸的几倍大。
+#define SHM_SLOTS 2
+
+struct shm_slots;
+
+// 任何一块 buffer 被释放时调用，例如重新提交之前因为没有空闲 buffer 而跳过的帧
+typedef void (*shm_slots_release_fn)(void *data);
+
+struct shm_slot {
+    struct wl_buffer *wl_buffer;
+    struct shm_slots *slots;
+    int32_t offset;
+    int width;
+    int height;
+    uint32_t format;
+    bool busy;
+};
+
+struct shm_slots {
+    struct wl_shm *shm;
+    uint32_t format;
+    shm_slots_release_fn release;
+    void *data;
+
+    struct shm_pool *pool;  // 第一次取 buffer 时创建
+    struct shm_slot buffers[SHM_SLOTS];
+};
+
+void shm_slots_init(struct shm_slots *slots, struct wl_shm *shm, uint32_t format,
+                    shm_slots_release_fn release, void *data);
+void shm_slots_finish(struct shm_slots *slots);
+
+// 格式变化时已有的 buffer 在下次取用时重建
+void shm_slots_set_format(struct shm_slots *slots, uint32_t format);
+
+// 取一块空闲的 width x height buffer，必要时重建或扩容；全部被占用或出错时返回 NULL。
+// 像素地址用 shm_slot_data 获取（扩容后映射可能移动，不要跨帧保存）；
+// attach 并提交之后调用 shm_slot_submit，标记为被占用
+struct shm_slot *shm_slots_acquire(struct shm_slots *slots, int width, int height);
+void *shm_slot_data(const struct shm_slot *slot);
+void shm_slot_submit(struct shm_slot *slot);
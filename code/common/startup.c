@@ -0,0 +1,86 @@
+#include "startup.h"
+#include <stdlib.h>
+#include <string.h>
+
+static double elapsed_ms(const struct startup_timer *timer) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - timer->start.tv_sec) * 1000.0 +
+           (now.tv_nsec - timer->start.tv_nsec) / 1000000.0;
+}
+
+void startup_begin(struct startup_timer *timer) {
+    memset(timer, 0, sizeof(*timer));
+    timer->globals_ms = -1;
+    timer->commit_ms = -1;
+    timer->frame_ms = -1;
+
+    const char *budget = getenv("STARTUP_BUDGET_MS");
+    if (budget && *budget) {
+        timer->budget_ms = strtod(budget, NULL);
+    }
+    const char *exit_on_frame = getenv("STARTUP_EXIT");
+    timer->exit_on_frame = exit_on_frame && *exit_on_frame && strcmp(exit_on_frame, "0") != 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &timer->start);
+}
+
+int startup_roundtrip(struct startup_timer *timer, struct wl_display *display) {
+    int ret = wl_display_roundtrip(display);
+    timer->roundtrips++;
+    if (timer->globals_ms < 0) {
+        timer->globals_ms = elapsed_ms(timer);
+    }
+    return ret;
+}
+
+static void frame_done(void *data, struct wl_callback *callback, uint32_t time) {
+    struct startup_timer *timer = data;
+    wl_callback_destroy(callback);
+    timer->frame = NULL;
+    timer->frame_ms = elapsed_ms(timer);
+
+    int ret = startup_report(timer, stderr);
+    if (timer->exit_on_frame) {
+        exit(ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+void startup_first_commit(struct startup_timer *timer, struct wl_surface *surface) {
+    if (timer->commit_ms >= 0) {
+        return;
+    }
+    timer->commit_ms = elapsed_ms(timer);
+
+    // 帧回调随这次 commit 一起生效，合成器真正显示这一帧后才返回
+    timer->frame = wl_surface_frame(surface);
+    wl_callback_add_listener(timer->frame, &frame_listener, timer);
+}
+
+bool startup_finished(const struct startup_timer *timer) {
+    return timer->frame_ms >= 0;
+}
+
+int startup_report(const struct startup_timer *timer, FILE *out) {
+    bool over = timer->frame_ms < 0 ||
+                (timer->budget_ms > 0 && timer->frame_ms > timer->budget_ms);
+
+    fprintf(out, "startup: roundtrips=%d globals_ms=%.2f commit_ms=%.2f frame_ms=%.2f",
+            timer->roundtrips, timer->globals_ms, timer->commit_ms, timer->frame_ms);
+    if (timer->budget_ms > 0) {
+        fprintf(out, " budget_ms=%.0f", timer->budget_ms);
+    }
+    fprintf(out, " status=%s\n", over ? "over" : "ok");
+    return over ? -1 : 0;
+}
+
+void startup_finish(struct startup_timer *timer) {
+    if (timer->frame) {
+        wl_callback_destroy(timer->frame);
+        timer->frame = NULL;
+    }
+}
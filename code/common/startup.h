@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <wayland-client.h>
+
+// 启动耗时测量：从连接显示服务器开始，记录
+// - 全局对象绑定完成（第一次 roundtrip 返回）；
+// - 第一次提交带内容的 buffer；
+// - 第一帧被合成器显示（第一次提交上挂的帧回调返回），即 time-to-first-frame。
+// 启动阶段应当只有一次 roundtrip：所有 bind 和初始 surface 设置在这一次同步里批量发出，
+// 之后的 configure 通过监听器异步处理。
+//
+// 第一帧返回时向 stderr 输出一行便于脚本解析的结果：
+//   startup: roundtrips=1 globals_ms=1.84 commit_ms=6.02 frame_ms=17.35 status=ok
+// 环境变量：
+// - STARTUP_BUDGET_MS：第一帧的时间预算（毫秒），超出时 status=over；
+// - STARTUP_EXIT：设置后第一帧显示即退出，未超预算返回 0，否则返回 1，供 CI 断言。
+
+struct startup_timer {
+    struct timespec start;
+    double globals_ms;    // 以下时间均相对 start，未发生时为负数
+    double commit_ms;
+    double frame_ms;
+    int roundtrips;
+
+    double budget_ms;     // 0 表示不限
+    bool exit_on_frame;
+    struct wl_callback *frame;
+};
+
+// 1. 在 wl_display_connect 之前调用
+void startup_begin(struct startup_timer *timer);
+
+// 2. 启动阶段代替 wl_display_roundtrip 使用，统计同步次数
+int startup_roundtrip(struct startup_timer *timer, struct wl_display *display);
+
+// 3. 在第一次提交内容的 wl_surface_commit 之前调用，之后的调用被忽略
+void startup_first_commit(struct startup_timer *timer, struct wl_surface *surface);
+
+// 4. 查询与输出；startup_report 返回 0 表示在预算内
+bool startup_finished(const struct startup_timer *timer);
+int startup_report(const struct startup_timer *timer, FILE *out);
+
+// 5. 提前退出时释放还没返回的帧回调
+void startup_finish(struct startup_timer *timer);
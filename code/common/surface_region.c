@@ -0,0 +1,63 @@
+#include "surface_region.h"
+#include <string.h>
+
+bool shm_format_has_alpha(uint32_t format) {
+    switch (format) {
+    case WL_SHM_FORMAT_XRGB8888:
+    case WL_SHM_FORMAT_XBGR8888:
+    case WL_SHM_FORMAT_RGBX8888:
+    case WL_SHM_FORMAT_BGRX8888:
+    case WL_SHM_FORMAT_RGB565:
+    case WL_SHM_FORMAT_BGR565:
+    case WL_SHM_FORMAT_RGB888:
+    case WL_SHM_FORMAT_BGR888:
+    case WL_SHM_FORMAT_XRGB2101010:
+    case WL_SHM_FORMAT_XBGR2101010:
+        return false;
+    default:
+        return true;
+    }
+}
+
+void surface_region_init(struct surface_region *region, struct wl_compositor *compositor,
+                         struct wl_surface *surface) {
+    memset(region, 0, sizeof(*region));
+    region->compositor = compositor;
+    region->surface = surface;
+}
+
+static bool region_equal(const struct damage_region *a, const struct damage_region *b) {
+    return a->count == b->count &&
+           memcmp(a->rects, b->rects, sizeof(struct damage_rect) * a->count) == 0;
+}
+
+void surface_region_set_opaque(struct surface_region *region, int width, int height,
+                               bool opaque, const struct damage_region *known) {
+    struct damage_region rects;
+    damage_region_clear(&rects);
+    if (opaque) {
+        damage_region_add(&rects, 0, 0, width, height);
+    } else if (known) {
+        rects = *known;
+    }
+
+    if (region->sent && region_equal(&region->opaque, &rects)) {
+        return;
+    }
+    region->opaque = rects;
+    region->sent = true;
+
+    // 空区域直接传 NULL，省去创建 wl_region
+    if (rects.count == 0) {
+        wl_surface_set_opaque_region(region->surface, NULL);
+        return;
+    }
+    struct wl_region *wl_region = wl_compositor_create_region(region->compositor);
+    for (int i = 0; i < rects.count; i++) {
+        const struct damage_rect *r = &rects.rects[i];
+        wl_region_add(wl_region, r->x, r->y, r->width, r->height);
+    }
+    wl_surface_set_opaque_region(region->surface, wl_region);
+    // 请求里已经带上了区域的内容，马上销毁不影响结果
+    wl_region_destroy(wl_region);
+}
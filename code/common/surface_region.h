@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+#include "damage.h"
+
+// 不透明区域：告诉合成器哪些像素完全不透明，合成器就可以跳过这些像素的混合，
+// 并剔除被完全挡住的窗口和表面。
+// - 没有 alpha 通道的格式（XRGB8888 等）整块不透明，不管像素里写了什么；
+// - 有 alpha 通道时，只有渲染器确认用不透明颜色填满的矩形才算数。
+// 区域属于表面的双缓冲状态，下一次 commit 时生效；只有内容变化时才重新发送，
+// 所以每帧都可以放心调用。坐标是表面坐标，等于 buffer scale 为 1 时的 buffer 坐标。
+
+struct surface_region {
+    struct wl_compositor *compositor;
+    struct wl_surface *surface;
+    bool sent;
+    struct damage_region opaque;   // 最近一次发送的区域
+};
+
+// 1. 格式本身是否带 alpha 通道
+bool shm_format_has_alpha(uint32_t format);
+
+// 2. 初始化，还没有发送任何区域（协议默认不透明区域为空）
+void surface_region_init(struct surface_region *region, struct wl_compositor *compositor,
+                         struct wl_surface *surface);
+
+// 3. 设置不透明区域：opaque 为 true 时是整个 width x height，
+//    否则是 known 里渲染器确认不透明的矩形（可为 NULL，表示没有）
+void surface_region_set_opaque(struct surface_region *region, int width, int height,
+                               bool opaque, const struct damage_region *known);
@@ -0,0 +1,162 @@
+#include "surface_tree.h"
+#include <stdlib.h>
+
+// 之前因为没有空闲 buffer 而跳过的重画
+static void buffer_release(void *data) {
+    struct surface_layer *layer = data;
+    if (layer->dirty) {
+        surface_layer_commit(layer);
+    }
+}
+
+// 先提交子层（同步子层的状态缓存起来，等这一层提交时一起生效），再提交这一层。
+// 返回 1 表示这一层提交了
+static int commit_tree(struct surface_layer *layer) {
+    bool needed = !layer->draw || layer->dirty;
+
+    for (struct surface_layer *child = layer->children; child; child = child->next) {
+        if (commit_tree(child) > 0 && child->sync) {
+            needed = true;
+        }
+        if (child->moved) {
+            child->moved = false;
+            needed = true;
+        }
+    }
+    if (!needed) {
+        return 0;
+    }
+
+    if (layer->dirty && layer->width > 0 && layer->height > 0) {
+        struct shm_slot *buffer = shm_slots_acquire(&layer->buffers, layer->width, layer->height);
+        if (buffer) {
+            layer->draw(layer->data, layer, shm_slot_data(buffer), layer->width * 4);
+            wl_surface_attach(layer->surface, buffer->wl_buffer, 0, 0);
+            wl_surface_damage(layer->surface, 0, 0, layer->width, layer->height);
+            surface_region_set_opaque(&layer->region, layer->width, layer->height,
+                                      !shm_format_has_alpha(layer->format), NULL);
+            shm_slot_submit(buffer);
+            layer->dirty = false;
+        }
+    }
+    wl_surface_commit(layer->surface);
+    return 1;
+}
+
+struct surface_layer *surface_layer_create(struct wl_compositor *compositor,
+                                           struct wl_subcompositor *subcompositor,
+                                           struct wl_shm *shm,
+                                           struct surface_layer *parent,
+                                           surface_layer_draw_fn draw, void *data) {
+    struct surface_layer *layer = calloc(1, sizeof(struct surface_layer));
+    if (!layer) {
+        return NULL;
+    }
+    layer->compositor = compositor;
+    layer->subcompositor = subcompositor;
+    layer->shm = shm;
+    layer->draw = draw;
+    layer->data = data;
+    layer->format = WL_SHM_FORMAT_XRGB8888;
+    shm_slots_init(&layer->buffers, shm, layer->format, buffer_release, layer);
+
+    layer->surface = wl_compositor_create_surface(compositor);
+    if (!layer->surface) {
+        free(layer);
+        return NULL;
+    }
+    surface_region_init(&layer->region, compositor, layer->surface);
+    if (parent) {
+        layer->parent = parent;
+        layer->sync = true;
+        layer->subsurface = wl_subcompositor_get_subsurface(subcompositor, layer->surface,
+                                                            parent->surface);
+        // 新的子表面默认叠在兄弟之上，链表保持同样的顺序
+        struct surface_layer **link = &parent->children;
+        while (*link) {
+            link = &(*link)->next;
+        }
+        *link = layer;
+    }
+    return layer;
+}
+
+void surface_layer_destroy(struct surface_layer *layer) {
+    if (!layer) {
+        return;
+    }
+    while (layer->children) {
+        surface_layer_destroy(layer->children);
+    }
+    if (layer->parent) {
+        struct surface_layer **link = &layer->parent->children;
+        while (*link != layer) {
+            link = &(*link)->next;
+        }
+        *link = layer->next;
+    }
+
+    shm_slots_finish(&layer->buffers);
+    if (layer->subsurface) {
+        wl_subsurface_destroy(layer->subsurface);
+    }
+    wl_surface_destroy(layer->surface);
+    free(layer);
+}
+
+void surface_layer_set_format(struct surface_layer *layer, uint32_t format) {
+    if (layer->format != format) {
+        layer->format = format;
+        // 已有的 buffer 格式不对了，让它们在下次取用时重建
+        shm_slots_set_format(&layer->buffers, format);
+        layer->dirty = true;
+    }
+}
+
+void surface_layer_set_size(struct surface_layer *layer, int width, int height) {
+    if (layer->width != width || layer->height != height) {
+        layer->width = width;
+        layer->height = height;
+        layer->dirty = true;
+    }
+}
+
+void surface_layer_set_position(struct surface_layer *layer, int x, int y) {
+    if (!layer->subsurface || (layer->x == x && layer->y == y)) {
+        return;
+    }
+    layer->x = x;
+    layer->y = y;
+    wl_subsurface_set_position(layer->subsurface, x, y);
+    layer->moved = true;
+}
+
+void surface_layer_set_sync(struct surface_layer *layer, bool sync) {
+    if (!layer->subsurface || layer->sync == sync) {
+        return;
+    }
+    layer->sync = sync;
+    if (sync) {
+        wl_subsurface_set_sync(layer->subsurface);
+    } else {
+        wl_subsurface_set_desync(layer->subsurface);
+    }
+}
+
+void surface_layer_damage(struct surface_layer *layer) {
+    layer->dirty = true;
+}
+
+int surface_layer_commit(struct surface_layer *layer) {
+    int committed = commit_tree(layer);
+
+    // 同步子层的提交、以及任何子层的位置，都要等父层提交才生效；
+    // 父层自己也可能是同步子层，一直往上直到不需要为止
+    while (layer->parent && (layer->moved || (committed && layer->sync))) {
+        layer->moved = false;
+        wl_surface_commit(layer->parent->surface);
+        committed = 1;
+        layer = layer->parent;
+    }
+    return committed;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+#include "shm_pool.h"
+#include "surface_region.h"
+
+// 表面树：把一个窗口拆成若干层，每层是一个 wl_surface，子层通过 wl_subsurface
+// 挂在父层上方（后创建的在上）。
+// - 每层有自己的 shm_pool 和两块 buffer，只有被标记为脏的层才重画、重新上传，
+//   例如按钮的悬停效果只上传按钮那一小块，而不是整个窗口；
+// - 子层可以是同步模式（提交缓存到父层下一次 commit 时一起生效，适合和父层
+//   保持一致的内容），也可以是非同步模式（提交立即生效，父层完全不动）；
+// - surface_layer_commit 只提交真正变化了的层，并自动补上让它生效所需的父层提交；
+// - 有绘制回调的层按 buffer 格式自动声明不透明区域，尺寸变化时随之更新。
+// 没有绘制回调的层由调用者自己 attach（例如用 pattern_cache 的静态 buffer），
+// 不透明区域也由调用者通过 layer->region 设置；提交它时总会调用 wl_surface_commit。
+
+struct surface_layer;
+
+// 整层重画；pixels 指向这一层的 buffer，stride 以字节为单位
+typedef void (*surface_layer_draw_fn)(void *data, struct surface_layer *layer,
+                                      uint32_t *pixels, int stride);
+
+struct surface_layer {
+    struct wl_compositor *compositor;
+    struct wl_subcompositor *subcompositor;
+    struct wl_shm *shm;
+
+    struct wl_surface *surface;
+    struct wl_subsurface *subsurface;   // 根层为 NULL
+    struct surface_region region;
+    struct surface_layer *parent;
+    struct surface_layer *children;     // 按叠放顺序从下到上
+    struct surface_layer *next;
+
+    surface_layer_draw_fn draw;         // NULL 表示内容由调用者管理
+    void *data;
+    uint32_t format;
+
+    int x, y;                           // 相对父层的位置
+    int width, height;
+    bool sync;
+    bool dirty;                         // 内容需要重画
+    bool moved;                         // 位置变化要等父层提交才生效
+
+    // 两块轮流使用的 buffer，被合成器占用的不会被重画
+    struct shm_slots buffers;
+};
+
+// 1. 创建与销毁。parent 为 NULL 时创建根层；子层默认是同步模式，
+//    位于 (0, 0)，叠在已有的兄弟层之上。销毁一层会先销毁它的所有子层
+struct surface_layer *surface_layer_create(struct wl_compositor *compositor,
+                                           struct wl_subcompositor *subcompositor,
+                                           struct wl_shm *shm,
+                                           struct surface_layer *parent,
+                                           surface_layer_draw_fn draw, void *data);
+void surface_layer_destroy(struct surface_layer *layer);
+
+// 2. 修改属性。尺寸变化会把这一层标记为脏；默认格式为 XRGB8888
+void surface_layer_set_format(struct surface_layer *layer, uint32_t format);
+void surface_layer_set_size(struct surface_layer *layer, int width, int height);
+void surface_layer_set_position(struct surface_layer *layer, int x, int y);
+void surface_layer_set_sync(struct surface_layer *layer, bool sync);
+
+// 3. 标记内容需要重画
+void surface_layer_damage(struct surface_layer *layer);
+
+// 4. 重画并提交这一层及其子树中变化了的层，再按需提交上层让结果生效。
+//    返回 1 表示有提交，0 表示没有变化。某层两块 buffer 都被占用时先跳过它，
+//    等 buffer 释放后自动重新提交
+int surface_layer_commit(struct surface_layer *layer);